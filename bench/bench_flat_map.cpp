@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ckv.hpp>
+
+/*
+ * Compares ckv::FlatMap with std::unordered_map<std::string, std::string>
+ * as the result of importing a ckv file: time to import, time to look
+ * every key up and heap memory held by the result.
+ *
+ * Usage: bench_flat_map [key count]
+ */
+
+static size_t heap_in_use()
+{
+	return mallinfo2().uordblks;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+static void report(const std::string &name, double import_secs, double lookup_secs, size_t lookups, size_t heap)
+{
+	std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(10) << import_secs * 1000 << " ms import"
+		<< std::setw(10) << lookup_secs * 1e9 / lookups << " ns/lookup"
+		<< std::setw(10) << heap / double(1 << 20) << " MiB heap\n";
+}
+
+int main(int argc, char *argv[])
+{
+	size_t key_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500000;
+	std::string file_name = "bench_flat_map.ckv";
+	std::vector<std::string> keys;
+	std::mt19937 rng(1);
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+
+		for (size_t i = 0; i < key_count; i++) {
+			keys.push_back("SERVICE_" + std::to_string(rng() % 1000) + "_SETTING_" + std::to_string(i));
+			out << keys.back() << " =\n\t" << std::string(8 + rng() % 48, 'v') << "\n\n";
+		}
+	}
+
+	std::shuffle(keys.begin(), keys.end(), rng);
+
+	{
+		std::unordered_map<std::string, std::string> map;
+		size_t heap_before = heap_in_use();
+		auto start = std::chrono::steady_clock::now();
+		{
+			// the key index of the ConfigFile goes away with it
+			ckv::ConfigFile file(file_name);
+			map = file.import_to_map();
+		}
+		double import_secs = seconds_since(start);
+		size_t heap = heap_in_use() - heap_before;
+
+		size_t found = 0;
+		start = std::chrono::steady_clock::now();
+		for (int round = 0; round < 5; round++) {
+			for (auto &key : keys) {
+				found += map.find(key) != map.end();
+			}
+		}
+		double lookup_secs = seconds_since(start);
+
+		report("unordered_map", import_secs, lookup_secs, found, heap);
+	}
+
+	{
+		ckv::FlatMap map;
+		size_t heap_before = heap_in_use();
+		auto start = std::chrono::steady_clock::now();
+		{
+			ckv::ConfigFile file(file_name);
+			map = file.import_to_flat_map();
+		}
+		double import_secs = seconds_since(start);
+		size_t heap = heap_in_use() - heap_before;
+
+		size_t found = 0;
+		start = std::chrono::steady_clock::now();
+		for (int round = 0; round < 5; round++) {
+			for (auto &key : keys) {
+				found += map.find(key) != map.end();
+			}
+		}
+		double lookup_secs = seconds_since(start);
+
+		report("ckv::FlatMap", import_secs, lookup_secs, found, heap);
+	}
+
+	std::remove(file_name.c_str());
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <ckv.hpp>
+#include <ckv_directory.hpp>
+
+/*
+ * Compares loading a directory of ckv files one after the other
+ * with ConfigFile::import_to_map() against ckv::load_directory().
+ *
+ * Usage: bench_load_directory [file count] [keys per file]
+ */
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+	size_t file_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000;
+	size_t key_count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+	std::string dir_name = "bench_load_directory";
+	std::vector<std::string> paths;
+
+	std::filesystem::remove_all(dir_name);
+
+	for (size_t i = 0; i < file_count; i++) {
+		std::string sub_dir = dir_name + "/component_" + std::to_string(i % 64);
+
+		std::filesystem::create_directories(sub_dir);
+		paths.push_back(sub_dir + "/service_" + std::to_string(i) + ".ckv");
+
+		std::ofstream out(paths.back());
+
+		for (size_t j = 0; j < key_count; j++) {
+			out << "SETTING_" << j << " =\n\tvalue of setting " << j << " in file " << i << "\n\n";
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	size_t keys = 0;
+
+	for (auto &path : paths) {
+		ckv::ConfigFile file(path);
+		keys += file.import_to_map().size();
+	}
+
+	double serial_secs = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	ckv::LoadedDirectory loaded = ckv::load_directory(dir_name);
+	double parallel_secs = seconds_since(start);
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< file_count << " files, " << keys << " keys, " << ckv::default_thread_pool().size() << " threads\n"
+		<< std::left << std::setw(20) << "import_to_map" << std::right << std::setw(10) << serial_secs * 1000 << " ms\n"
+		<< std::left << std::setw(20) << "load_directory" << std::right << std::setw(10) << parallel_secs * 1000 << " ms\n";
+
+	if (loaded.files.size() != file_count || !loaded.errors.empty()) {
+		std::cerr << "load_directory() loaded " << loaded.files.size() << " files with "
+			<< loaded.errors.size() << " errors\n";
+		return (EXIT_FAILURE);
+	}
+
+	std::filesystem::remove_all(dir_name);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ckv.hpp>
+#include "ckv_corpus.hpp"
+
+/*
+ * Measures the throughput and latency of the ConfigFile operations
+ * on a generated corpus, and prints them as text or JSON so runs
+ * from different commits can be compared.
+ *
+ * Usage: bench_ops [options]
+ *   --keys N                key count (100000)
+ *   --value-size MIN:MAX    value size range in bytes (8:128)
+ *   --skewed                mostly small values instead of uniform sizes
+ *   --multi-line RATIO      share of multi-line values (0.1)
+ *   --continuation RATIO    share of values with '+' continuation lines (0.05)
+ *   --odd-whitespace RATIO  share of oddly spaced keys (0.05)
+ *   --seed N                corpus seed (1)
+ *   --iterations N          lookups measured (10000)
+ *   --write-iterations N    sets and removals measured, each one
+ *                           writes the file (200)
+ *   --import-iterations N   imports measured, each one parses the
+ *                           whole file (10)
+ *   --atomic                write with WriteMode::Atomic
+ *   --json                  print JSON instead of text
+ *   --output FILE           print to FILE instead of stdout
+ */
+
+/*
+ * Timings of one operation.
+ */
+struct Result {
+	std::string name;
+	std::vector<double> latencies_ns;
+	double total_secs = 0;
+};
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0;
+	}
+
+	size_t index = static_cast<size_t>(p / 100 * (sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+/*
+ * Calls op(i) for i from 0 to count - 1, timing each call.
+ */
+static Result measure(const std::string &name, size_t count, const std::function<void(size_t)> &op)
+{
+	Result result;
+
+	result.name = name;
+	result.latencies_ns.reserve(count);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < count; i++) {
+		auto op_start = std::chrono::steady_clock::now();
+		op(i);
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - op_start;
+		result.latencies_ns.push_back(elapsed.count());
+	}
+
+	std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+	result.total_secs = total.count();
+
+	std::sort(result.latencies_ns.begin(), result.latencies_ns.end());
+	return result;
+}
+
+static void print_text(std::ostream &out, size_t corpus_size, const std::vector<Result> &results)
+{
+	out << "corpus: " << corpus_size << " bytes\n"
+		<< std::left << std::setw(20) << "operation" << std::right
+		<< std::setw(12) << "ops/s" << std::setw(12) << "p50 ns" << std::setw(12) << "p90 ns"
+		<< std::setw(12) << "p99 ns" << std::setw(12) << "max ns" << "\n";
+
+	for (auto &result : results) {
+		out << std::left << std::setw(20) << result.name << std::right << std::fixed << std::setprecision(0)
+			<< std::setw(12) << result.latencies_ns.size() / result.total_secs
+			<< std::setw(12) << percentile(result.latencies_ns, 50)
+			<< std::setw(12) << percentile(result.latencies_ns, 90)
+			<< std::setw(12) << percentile(result.latencies_ns, 99)
+			<< std::setw(12) << result.latencies_ns.back() << "\n";
+	}
+}
+
+static void print_json(std::ostream &out, const ckv_bench::CorpusOptions &options, size_t corpus_size,
+		const std::vector<Result> &results)
+{
+	out << std::fixed << std::setprecision(1)
+		<< "{\n  \"corpus\": " << ckv_bench::corpus_options_to_json(options) << ",\n"
+		<< "  \"corpus_bytes\": " << corpus_size << ",\n"
+		<< "  \"results\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result &result = results[i];
+
+		out << "    {\"operation\": \"" << result.name << "\""
+			<< ", \"count\": " << result.latencies_ns.size()
+			<< ", \"ops_per_sec\": " << result.latencies_ns.size() / result.total_secs
+			<< ", \"p50_ns\": " << percentile(result.latencies_ns, 50)
+			<< ", \"p90_ns\": " << percentile(result.latencies_ns, 90)
+			<< ", \"p99_ns\": " << percentile(result.latencies_ns, 99)
+			<< ", \"max_ns\": " << result.latencies_ns.back() << "}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+
+	out << "  ]\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+	ckv_bench::CorpusOptions options;
+	size_t iterations = 10000;
+	size_t write_iterations = 200;
+	size_t import_iterations = 10;
+	bool atomic = false;
+	bool json = false;
+	std::string output;
+	std::string file_name = "bench_ops.ckv";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (arg == "--skewed") {
+			options.value_size_distribution = ckv_bench::SizeDistribution::Skewed;
+		} else if (arg == "--atomic") {
+			atomic = true;
+		} else if (arg == "--json") {
+			json = true;
+		} else if (value == nullptr) {
+			std::cerr << "Unknown option or missing value: " << arg << "\n";
+			return (EXIT_FAILURE);
+		} else if (arg == "--keys") {
+			options.key_count = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--value-size") {
+			char *colon;
+			options.min_value_size = std::strtoul(argv[++i], &colon, 10);
+			options.max_value_size = *colon == ':' ? std::strtoul(colon + 1, nullptr, 10) : options.min_value_size;
+		} else if (arg == "--multi-line") {
+			options.multi_line_ratio = std::strtod(argv[++i], nullptr);
+		} else if (arg == "--continuation") {
+			options.continuation_ratio = std::strtod(argv[++i], nullptr);
+		} else if (arg == "--odd-whitespace") {
+			options.odd_whitespace_ratio = std::strtod(argv[++i], nullptr);
+		} else if (arg == "--seed") {
+			options.seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--iterations") {
+			iterations = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--write-iterations") {
+			write_iterations = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--import-iterations") {
+			import_iterations = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--output") {
+			output = argv[++i];
+		} else {
+			std::cerr << "Unknown option: " << arg << "\n";
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (options.key_count == 0 || options.max_value_size < options.min_value_size
+			|| iterations == 0 || write_iterations == 0 || import_iterations == 0) {
+		std::cerr << "Need at least one key and iteration and a valid value size range\n";
+		return (EXIT_FAILURE);
+	}
+
+	ckv_bench::Corpus corpus = ckv_bench::generate_corpus(options);
+	std::vector<Result> results;
+	std::mt19937 rng(options.seed);
+
+	auto write_corpus = [&file_name, &corpus]() {
+		std::ofstream out(file_name, std::ios::trunc);
+		out << corpus.contents;
+	};
+
+	// keys picked at random, the same for every run with the same seed
+	std::vector<size_t> picks(iterations);
+	for (auto &pick : picks) {
+		pick = rng() % corpus.values.size();
+	}
+
+	write_corpus();
+
+	try {
+		ckv::ConfigFile file(file_name);
+
+		// the first lookup of each key may extend the index,
+		// the rest are served from it
+		results.push_back(measure("get_value_for_key", iterations, [&](size_t i) {
+			auto &expected = corpus.values[picks[i]];
+
+			if (file.get_value_for_key(expected.first) != expected.second) {
+				std::cerr << "Wrong value for key " << expected.first << "\n";
+				std::exit(EXIT_FAILURE);
+			}
+		}));
+
+		results.push_back(measure("import_to_map", import_iterations, [&](size_t) {
+			// a fresh object so the whole file is parsed each time
+			ckv::ConfigFile import_file(file_name);
+
+			if (import_file.import_to_map().size() != corpus.values.size()) {
+				std::cerr << "import_to_map() lost keys\n";
+				std::exit(EXIT_FAILURE);
+			}
+		}));
+
+		file.set_write_mode(atomic ? ckv::WriteMode::Atomic : ckv::WriteMode::InPlace);
+
+		results.push_back(measure("set_value_for_key", write_iterations, [&](size_t i) {
+			auto &pair = corpus.values[picks[i]];
+
+			// same size, alternating between two values
+			std::string value = pair.second;
+			if (!value.empty()) {
+				value[0] = (i % 2 == 0) ? '#' : '%';
+			}
+			file.set_value_for_key(pair.first, value);
+		}));
+
+		write_corpus();
+
+		// each removal takes a different key
+		std::vector<size_t> order(corpus.values.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::shuffle(order.begin(), order.end(), rng);
+		order.resize(std::min(write_iterations, order.size()));
+
+		results.push_back(measure("remove_key", order.size(), [&](size_t i) {
+			file.remove_key(corpus.values[order[i]].first);
+		}));
+	} catch (std::exception &e) {
+		std::cerr << "Benchmark failed: " << e.what() << "\n";
+		std::remove(file_name.c_str());
+		return (EXIT_FAILURE);
+	}
+
+	std::remove(file_name.c_str());
+
+	std::ofstream output_file;
+	if (!output.empty()) {
+		output_file.open(output, std::ios::trunc);
+	}
+	std::ostream &out = output.empty() ? std::cout : output_file;
+
+	if (json) {
+		print_json(out, options, corpus.contents.size(), results);
+	} else {
+		print_text(out, corpus.contents.size(), results);
+	}
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,164 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <ckv.hpp>
+#include <ckv_scan.hpp>
+
+/*
+ * Measures how fast value blocks are parsed.
+ *
+ * The corpus is made of long multi-line values, like embedded
+ * certificates and scripts, which is where in_block_parse() spends
+ * its time. It compares the char by char stream loop ConfigFile used
+ * before the mmap parser with ckv::BlockParser using each scan mode.
+ *
+ * Usage: bench_scan [size in MiB]
+ */
+
+static std::string make_corpus(size_t target_size)
+{
+	std::string corpus;
+	size_t key_no = 0;
+
+	std::srand(1);
+
+	while (corpus.size() < target_size) {
+		corpus += "CERTIFICATE_" + std::to_string(key_no++) + " =\n";
+
+		size_t lines = 20 + std::rand() % 40;
+		for (size_t i = 0; i < lines; i++) {
+			// every 5th line is joined to the previous one
+			corpus += (i % 5 == 4) ? '+' : '\t';
+			for (size_t j = 0; j < 64; j++) {
+				corpus += static_cast<char>('A' + std::rand() % 26);
+			}
+			corpus += '\n';
+		}
+		corpus += '\n';
+	}
+
+	return corpus;
+}
+
+/*
+ * The stream based parser ConfigFile used before ckv::BlockParser,
+ * without its error checks.
+ */
+static size_t legacy_parse(std::istream &file_reader)
+{
+	size_t bytes = 0;
+	unsigned char ch;
+
+	file_reader >> std::noskipws;
+
+	while (file_reader.peek() != EOF) {
+		std::string key;
+
+		while (file_reader >> ch) {
+			if (ch == '\n') {
+				if (!key.empty()) {
+					break;
+				}
+			} else if (ch != '=' && ch != ' ' && ch != '\t') {
+				key += ch;
+			}
+		}
+
+		if (key.empty()) {
+			break;
+		}
+
+		std::string value;
+		file_reader >> ch;
+
+		while (file_reader >> ch) {
+			if (ch == '\n') {
+				char next = file_reader.peek();
+				if (next == '\t') {
+					value += ch;
+				} else if (next != '+') {
+					break;
+				}
+				file_reader >> ch;
+				continue;
+			}
+			value += ch;
+		}
+
+		bytes += value.size();
+	}
+
+	return bytes;
+}
+
+static size_t block_parse(const std::string &corpus)
+{
+	ckv::BlockParser parser(corpus);
+	std::string buffer;
+	size_t bytes = 0;
+
+	while (!parser.at_end()) {
+		std::string_view key = parser.out_block_parse();
+
+		if (key.empty()) {
+			break;
+		}
+
+		bytes += ckv::decode_value(parser.in_block_parse(), buffer).size();
+	}
+
+	return bytes;
+}
+
+template <typename F>
+static void report(const std::string &name, size_t corpus_size, F func)
+{
+	double best = 0;
+	size_t bytes = 0;
+
+	for (int run = 0; run < 5; run++) {
+		auto start = std::chrono::steady_clock::now();
+		bytes = func();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		double mib_per_sec = corpus_size / elapsed.count() / (1 << 20);
+		if (mib_per_sec > best) {
+			best = mib_per_sec;
+		}
+	}
+
+	std::cout << std::left << std::setw(24) << name << std::right << std::setw(12)
+		<< std::fixed << std::setprecision(1) << best << " MiB/s"
+		<< "  (" << bytes << " value bytes)\n";
+}
+
+int main(int argc, char *argv[])
+{
+	size_t size_mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+	std::string corpus = make_corpus(size_mib << 20);
+
+	std::cout << "Corpus: " << corpus.size() << " bytes\n";
+
+	report("legacy stream loop", corpus.size(), [&corpus]() {
+		std::istringstream in(corpus);
+		return legacy_parse(in);
+	});
+
+	const char *names[] = {"BlockParser scalar", "BlockParser SSE2", "BlockParser AVX2"};
+	ckv::ScanMode modes[] = {ckv::ScanMode::Scalar, ckv::ScanMode::SSE2, ckv::ScanMode::AVX2};
+
+	for (int i = 0; i < 3; i++) {
+		if (!ckv::set_scan_mode(modes[i])) {
+			std::cout << names[i] << ": not supported on this CPU\n";
+			continue;
+		}
+		report(names[i], corpus.size(), [&corpus]() {
+			return block_parse(corpus);
+		});
+	}
+
+	return (EXIT_SUCCESS);
+}
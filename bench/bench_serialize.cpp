@@ -0,0 +1,116 @@
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <unistd.h>
+#include <ckv.hpp>
+#include <ckv_writer.hpp>
+#include "ckv_corpus.hpp"
+
+/*
+ * Measures writing all the keys and values of a generated corpus
+ * as a ckv file: the way ConfigFile used to encode each block, with
+ * a regex and an std::endl per block, against ckv::Writer on an
+ * ofstream and ckv::Writer on a file descriptor.
+ *
+ * Usage: bench_serialize [key count] [max value size]
+ */
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+static void report(const std::string &name, double secs, size_t bytes)
+{
+	std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(10) << secs * 1000 << " ms"
+		<< std::setw(10) << bytes / secs / (1 << 20) << " MiB/s\n";
+}
+
+static size_t file_size(const std::string &file_name)
+{
+	std::ifstream in(file_name, std::ios::binary | std::ios::ate);
+	return in.tellg();
+}
+
+int main(int argc, char *argv[])
+{
+	ckv_bench::CorpusOptions options;
+	std::string file_name = "bench_serialize.ckv";
+
+	options.key_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+	options.max_value_size = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 256;
+	options.multi_line_ratio = 0.3;
+
+	ckv_bench::Corpus corpus = ckv_bench::generate_corpus(options);
+
+	{
+		std::remove(file_name.c_str());
+		auto start = std::chrono::steady_clock::now();
+		std::ofstream out(file_name, std::ios::trunc);
+
+		for (auto &pair : corpus.values) {
+			std::string value_to_print = std::regex_replace(pair.second, std::regex("\n"), "\n\t");
+			out << pair.first << " =\n";
+			out << '\t' << value_to_print;
+			out << std::endl;
+			out << std::endl;
+		}
+		out.close();
+
+		report("regex + endl", seconds_since(start), file_size(file_name));
+	}
+
+	try {
+		{
+			// truncating the last output would be timed too
+			std::remove(file_name.c_str());
+			auto start = std::chrono::steady_clock::now();
+			std::ofstream out(file_name, std::ios::trunc);
+			{
+				ckv::Writer writer(out);
+				writer.write_all(corpus.values);
+				writer.flush();
+			}
+			out.close();
+
+			report("Writer ofstream", seconds_since(start), file_size(file_name));
+		}
+
+		{
+			std::remove(file_name.c_str());
+			auto start = std::chrono::steady_clock::now();
+			int fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+			{
+				ckv::Writer writer(fd);
+				writer.write_all(corpus.values);
+				writer.flush();
+			}
+			close(fd);
+
+			report("Writer fd", seconds_since(start), file_size(file_name));
+		}
+
+		// what was written reads back
+		ckv::ConfigFile file(file_name);
+		if (file.import_to_map().size() != corpus.values.size()) {
+			std::cerr << "Keys lost writing the corpus\n";
+			std::remove(file_name.c_str());
+			return (EXIT_FAILURE);
+		}
+	} catch (std::exception &e) {
+		std::cerr << "Benchmark failed: " << e.what() << "\n";
+		std::remove(file_name.c_str());
+		return (EXIT_FAILURE);
+	}
+
+	std::remove(file_name.c_str());
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,123 @@
+#include <random>
+#include <sstream>
+#include "ckv_corpus.hpp"
+
+/*
+ * Picks the size of the next value.
+ */
+static size_t pick_value_size(const ckv_bench::CorpusOptions &options, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	double u = unit(rng);
+	size_t range = options.max_value_size - options.min_value_size;
+
+	if (options.value_size_distribution == ckv_bench::SizeDistribution::Skewed) {
+		// cubing keeps most values near the minimum
+		u = u * u * u;
+	}
+
+	return options.min_value_size + static_cast<size_t>(u * range);
+}
+
+/*
+ * Random text without newlines, the only character a value can't hold.
+ */
+static std::string random_text(size_t length, std::mt19937 &rng)
+{
+	static const char charset[] =
+		"0123456789"
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+		"abcdefghijklmnopqrstuvwxyz"
+		" _-./:=[]{}";
+	std::uniform_int_distribution<size_t> pick(0, sizeof(charset) - 2);
+	std::string text(length, ' ');
+
+	for (auto &ch : text) {
+		ch = charset[pick(rng)];
+	}
+
+	return text;
+}
+
+/*
+ * Generates a ckv file shaped by options. The same
+ * options always give the same corpus.
+ */
+ckv_bench::Corpus ckv_bench::generate_corpus(const CorpusOptions &options)
+{
+	std::mt19937 rng(options.seed);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	Corpus corpus;
+
+	corpus.values.reserve(options.key_count);
+
+	for (size_t i = 0; i < options.key_count; i++) {
+		std::string key = "COMPONENT_" + std::to_string(rng() % 1000) + "_KEY_" + std::to_string(i);
+		std::string value = random_text(pick_value_size(options, rng), rng);
+		bool odd_whitespace = unit(rng) < options.odd_whitespace_ratio;
+		std::string block;
+
+		if (odd_whitespace) {
+			// like wierdly_formatted.ckv
+			block += "   " + key + " \t\t=  \n";
+		} else {
+			block += key + " =\n";
+		}
+
+		if (unit(rng) < options.multi_line_ratio && value.size() > 1) {
+			// newlines in the value, each written as a newline and a tab
+			for (size_t cut = 1 + rng() % 32; cut < value.size(); cut += 1 + rng() % 32) {
+				value[cut] = '\n';
+			}
+		}
+
+		block += '\t';
+
+		for (size_t start = 0; start <= value.size(); ) {
+			size_t newline = value.find('\n', start);
+			std::string line = value.substr(start, newline == std::string::npos ? std::string::npos : newline - start);
+
+			if (unit(rng) < options.continuation_ratio && line.size() > 2) {
+				// the second half is joined back to the first one
+				size_t half = line.size() / 2;
+				block += line.substr(0, half) + "\n+" + line.substr(half);
+			} else {
+				block += line;
+			}
+
+			if (newline == std::string::npos) {
+				break;
+			}
+
+			block += "\n\t";
+			start = newline + 1;
+		}
+
+		block += odd_whitespace ? "\n\n\n" : "\n\n";
+
+		corpus.contents += block;
+		corpus.values.emplace_back(std::move(key), std::move(value));
+	}
+
+	return corpus;
+}
+
+/*
+ * Describes options as a JSON object, for the results.
+ */
+std::string ckv_bench::corpus_options_to_json(const CorpusOptions &options)
+{
+	std::ostringstream json;
+
+	json << "{\"key_count\": " << options.key_count
+		<< ", \"min_value_size\": " << options.min_value_size
+		<< ", \"max_value_size\": " << options.max_value_size
+		<< ", \"value_size_distribution\": \""
+		<< (options.value_size_distribution == SizeDistribution::Skewed ? "skewed" : "uniform") << "\""
+		<< ", \"multi_line_ratio\": " << options.multi_line_ratio
+		<< ", \"continuation_ratio\": " << options.continuation_ratio
+		<< ", \"odd_whitespace_ratio\": " << options.odd_whitespace_ratio
+		<< ", \"seed\": " << options.seed << "}";
+
+	return json.str();
+}
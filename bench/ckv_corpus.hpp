@@ -0,0 +1,52 @@
+#ifndef __CKV_CORPUS_HPP__
+#define __CKV_CORPUS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Generator of synthetic ckv files for the benchmarks.
+ */
+namespace ckv_bench {
+
+/*
+ * How value sizes are picked between CorpusOptions::min_value_size
+ * and CorpusOptions::max_value_size.
+ */
+enum class SizeDistribution {
+	Uniform, // every size equally likely
+	Skewed   // mostly small values with a long tail of large ones
+};
+
+/*
+ * Shape of a generated corpus. Ratios are the share of
+ * keys, from 0 to 1, getting the feature.
+ */
+struct CorpusOptions {
+	size_t key_count = 100000;
+	size_t min_value_size = 8;
+	size_t max_value_size = 128;
+	SizeDistribution value_size_distribution = SizeDistribution::Uniform;
+	double multi_line_ratio = 0.1;   // values split over tabbed lines
+	double continuation_ratio = 0.05; // values with lines joined by '+'
+	double odd_whitespace_ratio = 0.05; // keys indented, spaced out or followed by blank lines
+	uint32_t seed = 1;
+};
+
+/*
+ * A generated corpus.
+ */
+struct Corpus {
+	std::string contents; // text of the ckv file
+	std::vector<std::pair<std::string, std::string>> values; // each key and its decoded value, in file order
+};
+
+Corpus generate_corpus(const CorpusOptions &options);
+std::string corpus_options_to_json(const CorpusOptions &options);
+
+}
+
+#endif /* __CKV_CORPUS_HPP__ */
@@ -1,181 +1,2337 @@
 #include <ckv.hpp>
+#include <ckv_convert.hpp>
+#include <ckv_snapshot.hpp>
+#include <ckv_thread_pool.hpp>
+#include <ckv_writer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
 #include <fstream>
-#include <regex>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
 
-bool tab_or_space(char ch)
+/**
+ * Least number of bytes each thread gets in ParseMode::Parallel,
+ * below that the cost of the threads outweighs the gain.
+ */
+static const std::size_t parallel_chunk_size = 1 << 20;
+
+/**
+ * Writes all of data to fd at offset, retrying short writes.
+ *
+ * \return true on success.
+ */
+static bool write_all(int fd, std::string_view data, std::size_t offset)
+{
+	while (!data.empty()) {
+		ssize_t written = pwrite(fd, data.data(), data.size(), offset);
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+
+		data.remove_prefix(written);
+		offset += written;
+	}
+
+	return true;
+}
+
+namespace {
+
+/**
+ * Exclusive flock() on a journal, released when it goes out of
+ * scope. compact() removes the journal under the lock, so once
+ * it is taken the journal is checked to still be at its path,
+ * otherwise the one there now is locked instead.
+ */
+class JournalLock {
+private:
+	int fd = -1;
+
+public:
+	/**
+	 * \param create
+	 * Whether to create the journal if it doesn't exist. If not,
+	 * a missing journal leaves the lock not taken.
+	 */
+	JournalLock(const std::string &path, bool create)
+	{
+		int flags = O_RDWR | O_APPEND | O_CLOEXEC | (create ? O_CREAT : 0);
+		struct stat locked, current;
+
+		while ((fd = ::open(path.c_str(), flags, 0666)) >= 0) {
+			int result = flock(fd, LOCK_EX);
+
+			if (result != 0 && errno == EINTR) {
+				::close(fd);
+				continue;
+			}
+
+			// compaction may have removed it while the lock was waited for
+			bool try_again = false;
+
+			if (result == 0 && fstat(fd, &locked) == 0) {
+				if (stat(path.c_str(), &current) != 0) {
+					try_again = create && errno == ENOENT;
+				} else if (locked.st_dev == current.st_dev && locked.st_ino == current.st_ino) {
+					return;
+				} else {
+					try_again = true;
+				}
+			}
+
+			::close(fd);
+			fd = -1;
+
+			if (!try_again) {
+				return;
+			}
+		}
+	}
+
+	~JournalLock()
+	{
+		if (fd >= 0) {
+			::close(fd);
+		}
+	}
+
+	JournalLock(const JournalLock &) = delete;
+	JournalLock &operator=(const JournalLock &) = delete;
+
+	bool is_locked() const {
+		return fd >= 0;
+	}
+
+	int get_fd() const {
+		return fd;
+	}
+};
+
+}
+
+/**
+ * Maps file file_path in mapping.
+ *
+ * If it is already mapped and the file's inode, size and mtime
+ * haven't changed since, the mapping and key_index built on it
+ * are kept. Otherwise the file is mapped again and key_index
+ * starts over. A compressed file is told by its first bytes and
+ * is then parsed as a stream, without key_index.
+ *
+ * If reads look in the journal, whatever was added to it since
+ * is read first. compact() replaces the file before it removes
+ * the journal, so the file is never older than the journal.
+ *
+ * \return
+ * ErrorCode::None or ErrorCode::FileOpenFailed.
+ */
+ckv::ErrorCode ckv::ConfigFile::try_open_file()
+{
+	ckv::FileIdentity identity;
+
+	if (get_read_journal()) {
+		sync_journal();
+	} else if (journal_identity.size >= 0) {
+		clear_journal();
+	}
+
+	if (mapping.is_open() && ckv::get_file_identity(file_path, identity)
+			&& identity == mapping.get_identity()) {
+		return ckv::ErrorCode::None;
+	}
+
+	close_file();
+
+	if (!mapping.try_open(file_path)) {
+		err_line_no = 0;
+		return ckv::ErrorCode::FileOpenFailed;
+	}
+
+	reset_index();
+	compression = ckv::detect_compression(mapping.view());
+
+	// a fresh snapshot saves parsing the file at all
+	if (!compiled.open(ckv::compiled_path_for(file_path))
+			|| !compiled.is_fresh(mapping.get_identity(), mapping.view())) {
+		compiled.close();
+	}
+
+	return ckv::ErrorCode::None;
+}
+
+/**
+ * Same as try_open_file() but throws on failure.
+ *
+ * \throws FileOpenFailed
+ */
+void ckv::ConfigFile::open_file()
+{
+	check(try_open_file());
+}
+
+/**
+ * Unmaps file_path and drops key_index along with it.
+ * Must be called before the file is written to.
+ */
+void ckv::ConfigFile::close_file()
+{
+	key_index.clear();
+	value_cache.clear();
+	index_complete = false;
+	index_error = ckv::ErrorCode::None;
+	index_parser = ckv::BlockParser();
+	drop_ordered_index();
+	compiled.close();
+	mapping.close();
+	compression = ckv::Compression::None;
+}
+
+/**
+ * Empties key_index so it gets built again from the start of mapping.
+ */
+void ckv::ConfigFile::reset_index()
+{
+	key_index.clear();
+	value_cache.clear();
+	index_complete = false;
+	index_error = ckv::ErrorCode::None;
+	index_parser = ckv::BlockParser(mapping.view());
+	drop_ordered_index();
+}
+
+/**
+ * Reads the records added to journal_path since it was last read
+ * into journal. Nothing is read while its identity stays the same.
+ * If the journal was replaced or cut down, as by compaction, it is
+ * read again from the start. A record cut short by a crash is left
+ * out, append_to_journal() cuts it off before the next record.
+ */
+void ckv::ConfigFile::sync_journal()
+{
+	ckv::FileIdentity identity;
+
+	if (!ckv::get_file_identity(journal_path, identity)) {
+		if (journal_identity.size >= 0) {
+			clear_journal();
+		}
+		return;
+	}
+
+	if (identity == journal_identity) {
+		return;
+	}
+
+	if (identity.device != journal_identity.device || identity.inode != journal_identity.inode
+			|| static_cast<std::size_t>(identity.size) < journal_offset) {
+		clear_journal();
+	}
+
+	int fd = ::open(journal_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		return;
+	}
+
+	std::string data(identity.size - journal_offset, '\0');
+	std::size_t read_bytes = 0;
+
+	while (read_bytes < data.size()) {
+		ssize_t got = pread(fd, &data[read_bytes], data.size() - read_bytes, journal_offset + read_bytes);
+
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (got <= 0) {
+			break;
+		}
+
+		read_bytes += got;
+	}
+
+	::close(fd);
+
+	journal_offset += ckv::parse_journal(std::string_view(data).substr(0, read_bytes),
+		[this](std::string_view key, std::string_view value, bool removed) {
+			apply_journal_record(key, value, removed);
+		});
+
+	if (read_bytes == data.size()) {
+		journal_identity = identity;
+	}
+}
+
+/**
+ * Forgets everything read from the journal.
+ */
+void ckv::ConfigFile::clear_journal()
+{
+	journal.clear();
+	journal_keys.clear();
+	journal_offset = 0;
+	journal_identity = ckv::FileIdentity();
+	journal_records = 0;
+	drop_ordered_index();
+}
+
+/**
+ * Records in journal that key is set to value, or removed.
+ * Applying the same records again in the same order changes
+ * nothing, so a change made by this object can be applied
+ * right away and once more when it is read back.
+ */
+void ckv::ConfigFile::apply_journal_record(std::string_view key, std::string_view value, bool removed)
+{
+	auto it = journal.find(key);
+
+	if (it == journal.end()) {
+		journal_keys.emplace_back(key);
+		it = journal.emplace(journal_keys.back(), JournalEntry()).first;
+		it->second.order = journal_records++;
+	}
+
+	it->second.value = value;
+	it->second.removed = removed;
+
+	// the ordered index may have to gain or lose key
+	drop_ordered_index();
+}
+
+/**
+ * \returns The latest change of key in the journal,
+ * nullptr if the journal doesn't have key.
+ */
+const ckv::ConfigFile::JournalEntry *ckv::ConfigFile::find_in_journal(std::string_view key) const
+{
+	if (journal.empty()) {
+		return nullptr;
+	}
+
+	auto it = journal.find(key);
+
+	return it == journal.end() ? nullptr : &it->second;
+}
+
+/**
+ * Appends record to journal_path with a single write under an
+ * exclusive lock, creating the journal if needed.
+ *
+ * Writers and compact() all take the lock, so nobody is halfway
+ * through a record while it is held. Bytes after the last complete
+ * record are then what a crash left of one, and are cut off first
+ * so the records after them can be read. A short write is cut off
+ * the same way and reported as a failure.
+ *
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ *
+ * \return
+ *  Size of the journal after the write.
+ */
+std::size_t ckv::ConfigFile::append_to_journal(const std::string &record)
+{
+	JournalLock lock(journal_path, true);
+	struct stat st;
+	ssize_t count;
+
+	if (!lock.is_locked()) {
+		err_line_no = 0;
+		throw ckv::FileOpenFailed(journal_path);
+	}
+
+	sync_journal();
+
+	bool written = fstat(lock.get_fd(), &st) == 0;
+	std::size_t size = written ? st.st_size : 0;
+
+	// only once sync_journal() has read it all up to here
+	if (written && size > journal_offset && journal_identity.device == st.st_dev
+			&& journal_identity.inode == st.st_ino && static_cast<std::size_t>(journal_identity.size) == size) {
+		written = ftruncate(lock.get_fd(), journal_offset) == 0;
+		size = journal_offset;
+	}
+
+	do {
+		count = written ? ::write(lock.get_fd(), record.data(), record.size()) : -1;
+	} while (count < 0 && errno == EINTR);
+
+	if (count != static_cast<ssize_t>(record.size())) {
+		if (count > 0) {
+			// a partial record would hide the ones after it
+			int ignored = ftruncate(lock.get_fd(), size);
+			(void)ignored;
+		}
+
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(journal_path);
+	}
+
+	CKV_STATS_ADD(stats, RewriteBytes, record.size());
+	return size + record.size();
+}
+
+/**
+ * Parses the key after the last indexed one and adds it to key_index.
+ *
+ * If the key was already indexed, the previous entry is kept
+ * since the first occurrence of a key is the one that counts.
+ * On a parse error err_line_no and err_token are set and the
+ * error is kept in index_error, so every later call reaching
+ * that point returns it again without parsing anything. The
+ * keys indexed before it and their decoded values are kept.
+ *
+ * \param key
+ *  Set to the key parsed, or an empty view if there
+ *  are no more keys in the file.
+ *
+ * \return
+ *  ErrorCode::None or the syntax error found.
+ */
+ckv::ErrorCode ckv::ConfigFile::try_index_next_key(std::string_view &key)
+{
+	std::string_view value;
+	unsigned int line;
+
+	key = std::string_view();
+
+	if (index_complete) {
+		return ckv::ErrorCode::None;
+	}
+
+	if (index_error != ckv::ErrorCode::None) {
+		err_line_no = index_error_line;
+		err_token = index_error_token;
+		return index_error;
+	}
+
+	CKV_STATS_ADD(stats, FullRescans, index_parser.get_offset() == 0 ? 1 : 0);
+
+	std::size_t offset = index_parser.get_offset();
+	ckv::ErrorCode error = index_parser.parse_key(key);
+
+	if (error != ckv::ErrorCode::None) {
+		CKV_STATS_ADD(stats, BytesScanned, index_parser.get_offset() - offset);
+		err_line_no = index_parser.get_line();
+		err_token = index_parser.get_error_token();
+		index_error = error;
+		index_error_line = err_line_no;
+		index_error_token = err_token;
+		return error;
+	}
+
+	if (key.empty()) {
+		CKV_STATS_ADD(stats, BytesScanned, index_parser.get_offset() - offset);
+		index_complete = true;
+		return error;
+	}
+
+	// parse_key() has already moved past the key's line
+	line = index_parser.get_line() - 1;
+	value = index_parser.in_block_parse();
+
+	CKV_STATS_ADD(stats, BytesScanned, index_parser.get_offset() - offset);
+	index_complete = index_parser.at_end();
+	key_index.emplace(key, IndexEntry{
+		static_cast<std::size_t>(value.data() - mapping.view().data()), value.size(), line
+	});
+
+	return error;
+}
+
+/**
+ * Same as try_index_next_key() but throws the error found.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \return
+ *  The key parsed, or an empty view if there
+ *  are no more keys in the file.
+ */
+std::string_view ckv::ConfigFile::index_next_key()
+{
+	std::string_view key;
+
+	check(try_index_next_key(key));
+	return key;
+}
+
+/**
+ * Looks key up in key_index, extending the index
+ * through the file until it is found.
+ *
+ * \param key
+ *  Key to look up.
+ *
+ * \param entry
+ *  Set to the index entry for key or nullptr if the file doesn't have it.
+ *
+ * \return
+ *  ErrorCode::None or the syntax error found on the way.
+ */
+ckv::ErrorCode ckv::ConfigFile::try_find_key(std::string_view key, const IndexEntry *&entry)
+{
+	auto it = key_index.find(key);
+	std::string_view cur_key;
+
+	entry = nullptr;
+	CKV_STATS_ADD(stats, Lookups, 1);
+
+	if (it != key_index.end()) {
+		entry = &it->second;
+		return ckv::ErrorCode::None;
+	}
+
+	while (!index_complete) {
+		ckv::ErrorCode error = try_index_next_key(cur_key);
+
+		CKV_STATS_ADD(stats, KeysVisited, 1);
+
+		if (error != ckv::ErrorCode::None) {
+			return error;
+		}
+
+		// an empty key is the end of the file, not a match for ""
+		if (cur_key.empty()) {
+			break;
+		}
+
+		if (cur_key == key) {
+			entry = &key_index.find(key)->second;
+			break;
+		}
+	}
+
+	return ckv::ErrorCode::None;
+}
+
+/**
+ * Same as try_find_key() but throws the error found.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \return
+ *  Index entry for key or nullptr if the file doesn't have it.
+ */
+const ckv::ConfigFile::IndexEntry *ckv::ConfigFile::find_key(std::string_view key)
+{
+	const IndexEntry *entry;
+
+	check(try_find_key(key, entry));
+	return entry;
+}
+
+/**
+ * Throws the exception for error, unless it is ErrorCode::None.
+ * The exceptions are built only here, so the paths reporting
+ * errors by code never pay for them.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+void ckv::ConfigFile::check(ckv::ErrorCode error)
+{
+	if (error == ckv::ErrorCode::None) {
+		return;
+	}
+
+	if (error == ckv::ErrorCode::FileOpenFailed || error == ckv::ErrorCode::DecompressionFailed) {
+		ckv::throw_error(error, file_path);
+	}
+
+	ckv::throw_error(error, err_token);
+}
+
+/**
+ * Parses mapping from offset to its end in parallel, if
+ * parse_mode asks for it and there is enough left to parse.
+ *
+ * offset has to be where a key may start, such as the start of
+ * the file or the offset of index_parser. The rest of the file is
+ * cut by split_at_keys() and each chunk parsed by its own task on
+ * default_thread_pool(). Line numbers are then shifted by the number
+ * of lines in the chunks before, so they are the same as a serial
+ * parse gives.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \param offset
+ *  Offset in mapping to start parsing at.
+ *
+ * \param first_line
+ *  Line number at offset.
+ *
+ * \param chunks
+ *  Set to the keys of each chunk, in file order.
+ *
+ * \return
+ *  false if the file should be parsed serially instead,
+ *  chunks is left untouched then.
+ */
+bool ckv::ConfigFile::parse_in_parallel(std::size_t offset, unsigned int first_line,
+		std::vector<std::vector<ParsedKey>> &chunks)
+{
+	std::string_view contents = mapping.view().substr(offset);
+	ckv::ThreadPool &pool = ckv::default_thread_pool();
+	std::size_t chunk_count = std::min(pool.size() * 4, contents.size() / parallel_chunk_size);
+
+	if (parse_mode != ckv::ParseMode::Parallel || chunk_count < 2) {
+		return false;
+	}
+
+	// how far the parse of each chunk went
+	struct ChunkResult {
+		ckv::ErrorCode error = ckv::ErrorCode::None;
+		unsigned int lines = 0;      /**< Lines in the chunk, or up to the error */
+		std::string_view error_token;
+	};
+
+	std::vector<std::string_view> pieces = ckv::split_at_keys(contents, chunk_count);
+	std::vector<ChunkResult> results(pieces.size());
+
+	chunks.assign(pieces.size(), std::vector<ParsedKey>());
+	CKV_STATS_ADD(stats, FullRescans, offset == 0 ? 1 : 0);
+	CKV_STATS_ADD(stats, BytesScanned, contents.size());
+
+	pool.run(pieces.size(), [&pieces, &results, &chunks](std::size_t i) {
+		ckv::BlockParser parser(pieces[i]);
+		std::string_view key;
+
+		while (true) {
+			results[i].error = parser.parse_key(key);
+
+			if (results[i].error != ckv::ErrorCode::None) {
+				results[i].error_token = parser.get_error_token();
+				break;
+			}
+
+			if (key.empty()) {
+				break;
+			}
+
+			// parse_key() has already moved past the key's line
+			unsigned int line = parser.get_line() - 1;
+			chunks[i].push_back(ParsedKey{key, parser.in_block_parse(), line});
+		}
+
+		results[i].lines = parser.get_line() - 1;
+	});
+
+	// line numbers so far are from the start of each chunk
+	unsigned int lines_before = first_line - 1;
+
+	for (std::size_t i = 0; i < pieces.size(); i++) {
+		if (results[i].error != ckv::ErrorCode::None) {
+			// the first error in the file, as a serial parse would find
+			err_line_no = lines_before + results[i].lines + 1;
+			err_token = results[i].error_token;
+			chunks.clear();
+			check(results[i].error);
+		}
+
+		for (auto &parsed : chunks[i]) {
+			parsed.line += lines_before;
+		}
+
+		lines_before += results[i].lines;
+	}
+
+	return true;
+}
+
+/**
+ * Extends key_index to the end of the file, in parallel
+ * if parse_in_parallel() says so.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+void ckv::ConfigFile::complete_index()
+{
+	std::vector<std::vector<ParsedKey>> chunks;
+
+	if (index_complete) {
+		return;
+	}
+
+	// a sticky error stops the index where it was found,
+	// parsing in parallel would skip past it
+	if (index_error != ckv::ErrorCode::None) {
+		err_line_no = index_error_line;
+		err_token = index_error_token;
+		check(index_error);
+	}
+
+	if (!parse_in_parallel(index_parser.get_offset(), index_parser.get_line(), chunks)) {
+		while (!index_complete) {
+			index_next_key();
+		}
+		return;
+	}
+
+	std::size_t key_count = key_index.size();
+
+	for (auto &chunk : chunks) {
+		key_count += chunk.size();
+	}
+
+	key_index.reserve(key_count);
+
+	// in file order, so the first occurrence of a key is kept
+	for (auto &chunk : chunks) {
+		for (auto &parsed : chunk) {
+			key_index.emplace(parsed.key, IndexEntry{
+				static_cast<std::size_t>(parsed.raw_value.data() - mapping.view().data()),
+				parsed.raw_value.size(), parsed.line
+			});
+		}
+	}
+
+	index_complete = true;
+}
+
+/**
+ * Parses the compressed mapping while decompressing it, calling
+ * on_key for each key in file order, as StreamParser::parse() does.
+ * Only a chunk of the file and the key block being parsed are held
+ * in memory at a time.
+ *
+ * On an error err_line_no and err_token are set, err_token
+ * pointing into err_token_buffer.
+ *
+ * \return
+ *  ErrorCode::None, ErrorCode::DecompressionFailed or the syntax error found.
+ */
+ckv::ErrorCode ckv::ConfigFile::try_stream_blocks(const std::function<bool(std::string_view key,
+	std::string_view raw_value, unsigned int line)> &on_key)
+{
+	ckv::StreamParser parser(mapping.view(), compression);
+	ckv::ErrorCode error = parser.parse(on_key);
+
+	CKV_STATS_ADD(stats, FullRescans, 1);
+	CKV_STATS_ADD(stats, BytesScanned, parser.get_bytes_parsed());
+
+	if (error != ckv::ErrorCode::None) {
+		err_line_no = parser.get_line();
+		err_token_buffer = std::string(parser.get_error_token());
+		err_token = err_token_buffer;
+	}
+
+	return error;
+}
+
+/**
+ * Returns the keys of the file in lexicographic order, sorting
+ * them the first time only. The keys are views into whatever
+ * lookups are served from: mapping through key_index, compiled,
+ * or, for a compressed file, copies kept in ordered_key_storage.
+ * Keys added by the journal view journal_keys and those it
+ * removes are left out. The index is kept until the file or
+ * the journal changes.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+const ckv::OrderedIndex &ckv::ConfigFile::get_ordered_index()
+{
+	std::vector<std::string_view> keys;
+
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
+
+	if (ordered_index_ready) {
+		return ordered_index;
+	}
+
+	if (compiled.is_open()) {
+		keys.reserve(compiled.size());
+		compiled.visit([&keys](std::string_view key, std::string_view) {
+			keys.push_back(key);
+			return true;
+		});
+	} else if (compression != ckv::Compression::None) {
+		ordered_key_storage.clear();
+		check(try_stream_blocks([this](std::string_view key, std::string_view, unsigned int) {
+			ordered_key_storage.emplace_back(key);
+			return true;
+		}));
+		keys.assign(ordered_key_storage.begin(), ordered_key_storage.end());
+	} else {
+		try {
+			complete_index();
+		} catch(...) {
+			throw;
+		}
+
+		keys.reserve(key_index.size());
+
+		for (auto &pair : key_index) {
+			keys.push_back(pair.first);
+		}
+	}
+
+	if (!journal.empty()) {
+		keys.erase(std::remove_if(keys.begin(), keys.end(), [this](std::string_view key) {
+			return journal.count(key) != 0;
+		}), keys.end());
+
+		for (auto &pair : journal) {
+			if (!pair.second.removed) {
+				keys.push_back(pair.first);
+			}
+		}
+	}
+
+	ordered_index = ckv::OrderedIndex(std::move(keys));
+	ordered_index_ready = true;
+	return ordered_index;
+}
+
+/**
+ * Throws away ordered_index, which has to be done whenever
+ * what its keys view goes away.
+ */
+void ckv::ConfigFile::drop_ordered_index()
+{
+	ordered_index.clear();
+	ordered_index_ready = false;
+	ordered_key_storage.clear();
+}
+
+/**
+ * Calls visitor for each key of range, which comes from
+ * get_ordered_index(), and its value, in key order.
+ *
+ * Values of a compressed file are gathered in a single
+ * pass over it, the others are looked up in the index.
+ * Values in the journal are taken from there.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+void ckv::ConfigFile::visit_ordered(ckv::OrderedIndex::Range range,
+	const std::function<bool(std::string_view key, std::string_view value)> &visitor)
+{
+	std::string_view value;
+	std::string buffer;
+
+	CKV_STATS_ADD(stats, Lookups, range.size());
+
+	if (compression != ckv::Compression::None && !compiled.is_open()) {
+		std::unordered_map<std::string_view, std::string> values;
+		std::unordered_set<std::string_view> keys_left;
+
+		values.reserve(range.size());
+
+		for (std::string_view key : range) {
+			if (const JournalEntry *change = find_in_journal(key)) {
+				values.emplace(key, change->value);
+			} else {
+				keys_left.insert(key);
+			}
+		}
+
+		if (!keys_left.empty()) {
+			check(try_stream_blocks([&](std::string_view key, std::string_view raw_value, unsigned int) {
+				// the first occurrence of a key is the one that counts
+				auto it = keys_left.find(key);
+
+				if (it != keys_left.end()) {
+					values.emplace(*it, ckv::decode_value(raw_value, buffer));
+					keys_left.erase(it);
+				}
+				return !keys_left.empty();
+			}));
+		}
+
+		for (std::string_view key : range) {
+			if (!visitor(key, values[key])) {
+				break;
+			}
+		}
+		return;
+	}
+
+	for (std::string_view key : range) {
+		if (const JournalEntry *change = find_in_journal(key)) {
+			value = change->value;
+		} else if (compiled.is_open()) {
+			compiled.find(key, value);
+		} else {
+			value = decoded_value(key_index.find(key)->second);
+		}
+
+		if (!visitor(key, value)) {
+			break;
+		}
+	}
+}
+
+/**
+ * \returns Raw value block of entry in mapping.
+ */
+std::string_view ckv::ConfigFile::raw_value(const IndexEntry &entry) const
+{
+	return mapping.view().substr(entry.value_offset, entry.value_length);
+}
+
+/**
+ * \returns What is kept of the value of entry, added to
+ * value_cache if nothing was yet.
+ */
+ckv::ConfigFile::CachedValue &ckv::ConfigFile::cache_for(const IndexEntry &entry)
+{
+	if (entry.cached == 0) {
+		value_cache.emplace_back();
+		entry.cached = value_cache.size();
+	}
+
+	return value_cache[entry.cached - 1];
+}
+
+/**
+ * Returns the value of entry, decoding it the first time only.
+ *
+ * The index holds raw value blocks, so stripping the tabs and
+ * joining the continuation lines of a value is left until it
+ * is asked for. The decoded value is then kept until the file
+ * changes. A single line value needs no decoding and is a view
+ * into mapping.
+ *
+ * \return
+ *  The value, valid until the file changes.
+ */
+std::string_view ckv::ConfigFile::decoded_value(const IndexEntry &entry)
+{
+	if (entry.cached != 0 && value_cache[entry.cached - 1].is_decoded) {
+		return value_cache[entry.cached - 1].decoded;
+	}
+
+	std::string_view raw = raw_value(entry);
+	std::string buffer;
+	std::string_view value = ckv::decode_value(raw, buffer);
+
+	if (value.data() >= raw.data() && value.data() <= raw.data() + raw.size()) {
+		// a view into raw, nothing to keep
+		return value;
+	}
+
+	CachedValue &cache = cache_for(entry);
+
+	cache.decoded = std::move(buffer);
+	cache.is_decoded = true;
+	return cache.decoded;
+}
+
+/**
+ * It returns the value for the param key.
+ *
+ * Keys are indexed as the file is read, so looking up a key
+ * that has been seen before doesn't read the file again until
+ * the file changes on disk.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws KeyNotFound
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \param key
+ *  Key whose value should be returned.
+ *
+ * \return
+ * 	value for key param1.
+ */
+std::string ckv::ConfigFile::get_value_for_key(std::string key)
+{
+	CKV_STATS_TIME(stats, GetValueForKey);
+	std::string buffer;
+	ckv::LookupResult result = try_get_value_for_key(key, buffer);
+
+	if (result.error == ckv::ErrorCode::KeyNotFound) {
+		ckv::throw_error(result.error, key);
+	}
+
+	check(result.error);
+	return std::string(result.value);
+}
+
+/**
+ * Same as get_value_for_key() but errors are returned instead of
+ * thrown. A missing key, a missing file and a syntax error neither
+ * throw nor allocate, which makes it the one to use for probing
+ * keys that may well not be there.
+ *
+ * err_line_no is set as get_value_for_key() would set it.
+ *
+ * \param key
+ *  Key whose value should be returned.
+ *
+ * \param buffer
+ *  Holds the value of a key of a compressed file, which isn't
+ *  kept by the ConfigFile. Unused otherwise.
+ *
+ * \return
+ *  The value of key and its line, or the error and its line.
+ */
+ckv::LookupResult ckv::ConfigFile::try_get_value_for_key(std::string_view key, std::string &buffer)
+{
+	CKV_STATS_TIME(stats, TryGetValueForKey);
+	ckv::LookupResult result;
+	const IndexEntry *entry;
+
+	result.error = try_open_file();
+
+	if (result.error != ckv::ErrorCode::None) {
+		return result;
+	}
+
+	if (const JournalEntry *change = find_in_journal(key)) {
+		CKV_STATS_ADD(stats, Lookups, 1);
+
+		if (change->removed) {
+			err_line_no = 0;
+			result.error = ckv::ErrorCode::KeyNotFound;
+		} else {
+			result.value = change->value;
+		}
+		return result;
+	}
+
+	if (compiled.is_open()) {
+		CKV_STATS_ADD(stats, Lookups, 1);
+
+		if (!compiled.find(key, result.value, &result.line)) {
+			err_line_no = 0;
+			result.error = ckv::ErrorCode::KeyNotFound;
+		}
+		return result;
+	}
+
+	if (compression != ckv::Compression::None) {
+		bool found = false;
+
+		CKV_STATS_ADD(stats, Lookups, 1);
+		result.error = try_stream_blocks([&](std::string_view cur_key, std::string_view raw_value, unsigned int line) {
+			std::string decoded;
+
+			CKV_STATS_ADD(stats, KeysVisited, 1);
+
+			if (cur_key != key) {
+				return true;
+			}
+
+			buffer = std::string(ckv::decode_value(raw_value, decoded));
+			result.line = line;
+			found = true;
+			return false;
+		});
+
+		if (result.error != ckv::ErrorCode::None) {
+			result.line = err_line_no;
+		} else if (!found) {
+			err_line_no = 0;
+			result.error = ckv::ErrorCode::KeyNotFound;
+		} else {
+			result.value = buffer;
+		}
+		return result;
+	}
+
+	result.error = try_find_key(key, entry);
+
+	if (result.error != ckv::ErrorCode::None) {
+		result.line = err_line_no;
+		return result;
+	}
+
+	if (entry == nullptr) {
+		err_line_no = 0;
+		result.error = ckv::ErrorCode::KeyNotFound;
+		return result;
+	}
+
+	result.value = decoded_value(*entry);
+	result.line = entry->line;
+	return result;
+}
+
+/**
+ * It returns the values for all of the param keys.
+ *
+ * Keys not indexed yet are looked up together in a single
+ * pass over the file which stops as soon as all of them
+ * have been found.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws KeyNotFound
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \param keys
+ *  Keys whose values should be returned.
+ *
+ * \return
+ * 	map from each of keys to its value.
+ */
+std::unordered_map<std::string, std::string> ckv::ConfigFile::get_values_for_keys(const std::vector<std::string> &keys)
+{
+	std::unordered_map<std::string, std::string> values;
+	std::unordered_set<std::string_view> keys_left;
+
+	CKV_STATS_TIME(stats, GetValuesForKeys);
+	CKV_STATS_ADD(stats, Lookups, keys.size());
+
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
+
+	if (!journal.empty()) {
+		std::vector<std::string> file_keys;
+
+		for (auto &key : keys) {
+			const JournalEntry *change = find_in_journal(key);
+
+			if (change == nullptr) {
+				file_keys.push_back(key);
+			} else if (change->removed) {
+				err_line_no = 0;
+				throw ckv::KeyNotFound(key);
+			} else {
+				values.emplace(key, change->value);
+			}
+		}
+
+		if (file_keys.size() < keys.size()) {
+			// none of file_keys is in the journal, they go to the file
+			values.merge(get_values_for_keys(file_keys));
+			return values;
+		}
+	}
+
+	if (compiled.is_open()) {
+		std::string_view value;
+
+		for (auto &key : keys) {
+			if (!compiled.find(key, value)) {
+				err_line_no = 0;
+				throw ckv::KeyNotFound(key);
+			}
+			values.emplace(key, value);
+		}
+
+		return values;
+	}
+
+	if (compression != ckv::Compression::None) {
+		std::string buffer;
+
+		keys_left.insert(keys.begin(), keys.end());
+		check(try_stream_blocks([&](std::string_view key, std::string_view raw_value, unsigned int) {
+			CKV_STATS_ADD(stats, KeysVisited, 1);
+
+			// the first occurrence of a key is the one that counts
+			auto it = keys_left.find(key);
+
+			if (it != keys_left.end()) {
+				values.emplace(*it, ckv::decode_value(raw_value, buffer));
+				keys_left.erase(it);
+			}
+			return !keys_left.empty();
+		}));
+
+		if (!keys_left.empty()) {
+			err_line_no = 0;
+			throw ckv::KeyNotFound(std::string(*keys_left.begin()));
+		}
+
+		return values;
+	}
+
+	for (auto &key : keys) {
+		if (key_index.find(key) == key_index.end()) {
+			keys_left.insert(key);
+		}
+	}
+
+	try {
+		while (!keys_left.empty() && !index_complete) {
+			std::string_view key = index_next_key();
+
+			CKV_STATS_ADD(stats, KeysVisited, 1);
+
+			// an empty key is the end of the file, not a match for ""
+			if (key.empty()) {
+				break;
+			}
+
+			keys_left.erase(key);
+		}
+	} catch (...) {
+		throw;
+	}
+
+	if (!keys_left.empty()) {
+		err_line_no = 0;
+		throw ckv::KeyNotFound(std::string(*keys_left.begin()));
+	}
+
+	values.reserve(keys.size());
+
+	for (auto &key : keys) {
+		values.emplace(key, decoded_value(key_index.find(key)->second));
+	}
+
+	return values;
+}
+
+/**
+ * Converts the value of key with convert, keeping the result
+ * next to the key in key_index so the same conversion isn't
+ * done again until the file changes. Only the last conversion
+ * of a key is kept.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws InvalidValue
+ * \throws KeyNotFound
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \return
+ *  The converted value, valid until the file changes or key is read
+ *  as another type. From the compiled snapshot, a compressed file or
+ *  the journal, where nothing is kept, only until the next typed
+ *  getter call.
+ */
+template <typename T>
+const T &ckv::ConfigFile::get_typed(const std::string &key, const char *type_name,
+		bool (*convert)(std::string_view, T &))
+{
+	std::string_view value;
+	unsigned int line;
+	T converted;
+
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
+
+	if (compiled.is_open() && find_in_journal(key) == nullptr) {
+		if (!compiled.find(key, value, &line)) {
+			err_line_no = 0;
+			throw ckv::KeyNotFound(key);
+		}
+
+		if (!convert(value, converted)) {
+			err_line_no = line;
+			throw ckv::InvalidValue(key, line, type_name);
+		}
+
+		compiled_value = std::move(converted);
+		return std::get<T>(compiled_value);
+	}
+
+	if (compression != ckv::Compression::None || find_in_journal(key) != nullptr) {
+		std::string buffer;
+		ckv::LookupResult result = try_get_value_for_key(key, buffer);
+
+		if (result.error == ckv::ErrorCode::KeyNotFound) {
+			throw ckv::KeyNotFound(key);
+		}
+
+		check(result.error);
+
+		if (!convert(result.value, converted)) {
+			err_line_no = result.line;
+			throw ckv::InvalidValue(key, result.line, type_name);
+		}
+
+		compiled_value = std::move(converted);
+		return std::get<T>(compiled_value);
+	}
+
+	const IndexEntry *entry;
+
+	try {
+		entry = find_key(key);
+	} catch(...) {
+		throw;
+	}
+
+	if (entry == nullptr) {
+		err_line_no = 0;
+		throw ckv::KeyNotFound(key);
+	}
+
+	if (entry->cached != 0) {
+		if (const T *cached = std::get_if<T>(&value_cache[entry->cached - 1].typed)) {
+			return *cached;
+		}
+	}
+
+	value = decoded_value(*entry);
+
+	if (!convert(value, converted)) {
+		err_line_no = entry->line;
+		throw ckv::InvalidValue(key, entry->line, type_name);
+	}
+
+	TypedValue &typed = cache_for(*entry).typed;
+
+	typed = std::move(converted);
+	return std::get<T>(typed);
+}
+
+/**
+ * Returns the value of key as an integer, in decimal or in
+ * hexadecimal after 0x. The conversion is cached, so reading
+ * the same key again costs a single lookup until the file
+ * changes.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws InvalidValue
+ * \throws KeyNotFound
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+std::int64_t ckv::ConfigFile::get_int(const std::string &key)
+{
+	return get_typed<std::int64_t>(key, "integer", ckv::parse_int);
+}
+
+/**
+ * Same as get_int() but for a floating point number.
+ */
+double ckv::ConfigFile::get_double(const std::string &key)
+{
+	return get_typed<double>(key, "floating point number", ckv::parse_double);
+}
+
+/**
+ * Same as get_int() but for a bool: true, yes, on or 1
+ * and false, no, off or 0, in any case.
+ */
+bool ckv::ConfigFile::get_bool(const std::string &key)
+{
+	return get_typed<bool>(key, "bool", ckv::parse_bool);
+}
+
+/**
+ * Same as get_int() but for a duration like 250ms or 1h30m.
+ * See parse_duration() for the units.
+ */
+std::chrono::nanoseconds ckv::ConfigFile::get_duration(const std::string &key)
+{
+	return get_typed<std::chrono::nanoseconds>(key, "duration", ckv::parse_duration);
+}
+
+/**
+ * Same as get_int() but for a size in bytes like 4096 or 64MiB.
+ * See parse_size() for the units.
+ */
+std::uint64_t ckv::ConfigFile::get_size(const std::string &key)
+{
+	return get_typed<std::uint64_t>(key, "size", ckv::parse_size);
+}
+
+/**
+ * Same as get_int() but for a list of tab separated items.
+ *
+ * \return
+ *  The items, valid until the file changes or key is read as another type.
+ */
+const std::vector<std::string> &ckv::ConfigFile::get_list(const std::string &key)
+{
+	return get_typed<std::vector<std::string>>(key, "list", ckv::parse_list);
+}
+
+/**
+ * Works out the change to make to the file for setting
+ * key to new_value.
+ *
+ * The first block of key is replaced if it exists, otherwise
+ * a new block is appended after the last one.
+ * mapping should be open, it is taken as empty otherwise.
+ * A compressed file can't be written to.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+ckv::ConfigFile::Splice ckv::ConfigFile::splice_for_set(const std::string &key, const std::string &new_value)
+{
+	std::string_view contents = mapping.view();
+	std::string block;
+	Splice splice;
+
+	if (compression != ckv::Compression::None) {
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(file_path);
+	}
+
+	ckv::encode_block(block, key, new_value);
+
+	if (mapping.is_open() && find_key(key) != nullptr) {
+		auto it = key_index.find(key);
+		std::size_t start = block_start(it->first);
+		std::size_t end = it->second.value_offset + it->second.value_length;
+
+		if (end < contents.size()) {
+			// the newline terminating the value
+			end++;
+		}
+
+		splice.offset = start;
+		splice.length = end - start;
+		splice.replacement = std::move(block);
+		return splice;
+	}
+
+	splice.offset = contents.size();
+	splice.length = 0;
+
+	// keep a blank line between blocks
+	if (contents.empty()) {
+		splice.replacement = std::move(block);
+	} else if (contents.back() != '\n') {
+		splice.replacement = "\n\n" + block;
+	} else if (contents.size() < 2 || contents[contents.size() - 2] != '\n') {
+		splice.replacement = "\n" + block;
+	} else {
+		splice.replacement = std::move(block);
+	}
+
+	return splice;
+}
+
+/**
+ * Works out the change to make to the file for removing
+ * every block of key along with the blank line following
+ * each of them. A compressed file can't be written to.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+ckv::ConfigFile::Splice ckv::ConfigFile::splice_for_remove(const std::string &key)
+{
+	std::string_view contents = mapping.view();
+	std::string_view cur_key, value;
+	std::size_t kept_from = 0;
+	ckv::BlockParser parser(contents);
+	Splice splice;
+
+	if (compression != ckv::Compression::None) {
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(file_path);
+	}
+
+	splice.offset = contents.size();
+	splice.length = 0;
+	CKV_STATS_ADD(stats, FullRescans, 1);
+	CKV_STATS_ADD(stats, BytesScanned, contents.size());
+
+	while (!parser.at_end()) {
+		ckv::ErrorCode error = parser.parse_key(cur_key);
+
+		if (error != ckv::ErrorCode::None) {
+			err_line_no = parser.get_line();
+			err_token = parser.get_error_token();
+			check(error);
+		}
+
+		if (cur_key.empty()) {
+			break;
+		}
+
+		value = parser.in_block_parse();
+
+		if (cur_key != key) {
+			continue;
+		}
+
+		std::size_t start = block_start(cur_key);
+		std::size_t end = parser.get_offset();
+
+		if (end < contents.size() && contents[end] == '\n') {
+			// blank line after the block
+			end++;
+		}
+
+		if (splice.length == 0) {
+			splice.offset = start;
+		} else {
+			// blocks in between removed ones stay
+			splice.replacement.append(contents.substr(kept_from, start - kept_from));
+		}
+
+		splice.length = end - splice.offset;
+		kept_from = end;
+	}
+
+	return splice;
+}
+
+/**
+ * \returns Offset of the start of the line key is on.
+ * key has to be a view into mapping.
+ */
+std::size_t ckv::ConfigFile::block_start(std::string_view key) const
+{
+	std::string_view contents = mapping.view();
+	std::size_t offset = key.data() - contents.data();
+	std::size_t newline = contents.rfind('\n', offset);
+
+	return newline == std::string_view::npos ? 0 : newline + 1;
+}
+
+/**
+ * Outputs the contents of the file with splice applied to out.
+ *
+ * \throws InvalidOutputStream
+ */
+void ckv::ConfigFile::write_splice(const Splice &splice, std::ostream &out)
+{
+	std::string_view contents = mapping.view();
+
+	out << contents.substr(0, splice.offset) << splice.replacement
+		<< contents.substr(splice.offset + splice.length);
+
+	if (!out) {
+		err_line_no = 0;
+		throw ckv::InvalidOutputStream();
+	}
+}
+
+/**
+ * Applies splice to the file itself.
+ *
+ * With WriteMode::InPlace only the part of the file from the
+ * splice onwards is written. If the size of the spliced region
+ * doesn't change, that is just the replacement, otherwise
+ * everything after it gets shifted.
+ * With WriteMode::Atomic the whole file is replaced by
+ * replace_file().
+ * The file is created if it doesn't exist and its compiled
+ * snapshot, if any, is removed.
+ *
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ */
+void ckv::ConfigFile::write_splice(const Splice &splice)
+{
+	std::string_view contents = mapping.view();
+	std::size_t new_size = contents.size() - splice.length + splice.replacement.size();
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+	std::string data;
+
+	if (write_mode == WriteMode::Atomic) {
+		data.reserve(new_size);
+		data.append(contents.substr(0, splice.offset));
+		data.append(splice.replacement);
+		data.append(contents.substr(splice.offset + splice.length));
+
+		close_file();
+		replace_file(file_path, data);
+		return;
+	}
+
+	if (!mapping.is_open()) {
+		// whatever is there couldn't be read, start afresh
+		flags |= O_TRUNC;
+	}
+
+	// the snapshot could still look fresh if the size and mtime
+	// of the file happen to stay the same, so it goes first
+	unlink(ckv::compiled_path_for(file_path).c_str());
+
+	if (splice.length == splice.replacement.size()) {
+		data = splice.replacement;
+	} else {
+		data.reserve(new_size - splice.offset);
+		data.append(splice.replacement);
+		data.append(contents.substr(splice.offset + splice.length));
+	}
+
+	// mapping must go before the file under it changes
+	close_file();
+
+	int fd = ::open(file_path.c_str(), flags, 0666);
+
+	if (fd < 0) {
+		err_line_no = 0;
+		throw ckv::FileOpenFailed(file_path);
+	}
+
+	bool written = write_all(fd, data, splice.offset);
+
+	if (written && new_size < contents.size()) {
+		written = ftruncate(fd, new_size) == 0;
+	}
+
+	if (::close(fd) != 0) {
+		written = false;
+	}
+
+	if (!written) {
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(file_path);
+	}
+
+	CKV_STATS_ADD(stats, RewriteBytes, data.size());
+}
+
+/**
+ * Replaces the file at path with one having contents, so that
+ * the file is seen either as it was or with all of contents.
+ *
+ * contents are written to a temporary file next to path
+ * in a single write and synced to disk, then it is renamed
+ * over path and the directory is synced too.
+ *
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ */
+void ckv::ConfigFile::replace_file(const std::string &path, std::string_view contents)
+{
+	static std::atomic<unsigned int> tmp_no{0};
+	std::string tmp_path = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(tmp_no++);
+	std::size_t slash = path.rfind('/');
+	std::string dir_path = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+	struct stat st;
+
+	// 0666 so that umask applies like for any new file
+	int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+
+	if (fd < 0) {
+		err_line_no = 0;
+		throw ckv::FileOpenFailed(tmp_path);
+	}
+
+	bool written = write_all(fd, contents, 0);
+
+	CKV_STATS_ADD(stats, RewriteBytes, written ? contents.size() : 0);
+
+	// keep the permissions of the file being replaced
+	if (written && stat(path.c_str(), &st) == 0) {
+		written = fchmod(fd, st.st_mode & 07777) == 0;
+	}
+
+	if (written) {
+		written = fsync(fd) == 0;
+	}
+
+	if (::close(fd) != 0) {
+		written = false;
+	}
+
+	if (written) {
+		written = rename(tmp_path.c_str(), path.c_str()) == 0;
+	}
+
+	if (!written) {
+		unlink(tmp_path.c_str());
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(path);
+	}
+
+	// make the rename itself durable
+	int dir_fd = ::open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (dir_fd < 0 || fsync(dir_fd) != 0) {
+		if (dir_fd >= 0) {
+			::close(dir_fd);
+		}
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(path);
+	}
+
+	::close(dir_fd);
+}
+
+/**
+ * Builds the contents of the file with changes, the journal or
+ * a copy of it, folded in, in a single pass over the file. The
+ * first block of a key set in changes gets its new value, every
+ * block of a removed key goes along with the blank line following
+ * it, and keys the file doesn't have are appended in the order
+ * they were added. The file has to be open and not compressed.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+std::string ckv::ConfigFile::merged_contents(const std::unordered_map<std::string_view, JournalEntry> &changes)
 {
-	return (ch == '\t' || ch == ' ');
+	std::string_view contents = mapping.view();
+	std::string_view key;
+	std::size_t kept_from = 0;
+	std::unordered_set<std::string_view> written;
+	std::vector<const std::pair<const std::string_view, JournalEntry> *> added;
+	ckv::BlockParser parser(contents);
+	std::string merged;
+
+	merged.reserve(contents.size());
+	CKV_STATS_ADD(stats, FullRescans, 1);
+	CKV_STATS_ADD(stats, BytesScanned, contents.size());
+
+	while (!parser.at_end()) {
+		ckv::ErrorCode error = parser.parse_key(key);
+
+		if (error != ckv::ErrorCode::None) {
+			err_line_no = parser.get_line();
+			err_token = parser.get_error_token();
+			check(error);
+		}
+
+		if (key.empty()) {
+			break;
+		}
+
+		parser.in_block_parse();
+
+		auto it = changes.find(key);
+
+		// later blocks of a key set anew are shadowed anyway and stay
+		if (it == changes.end() || (!it->second.removed && written.count(it->first) != 0)) {
+			continue;
+		}
+
+		std::size_t start = block_start(key);
+		std::size_t end = parser.get_offset();
+
+		merged.append(contents.substr(kept_from, start - kept_from));
+
+		if (it->second.removed) {
+			if (end < contents.size() && contents[end] == '\n') {
+				// blank line after the block
+				end++;
+			}
+		} else {
+			ckv::encode_block(merged, key, it->second.value);
+			written.insert(it->first);
+		}
+
+		kept_from = end;
+	}
+
+	merged.append(contents.substr(kept_from));
+
+	for (auto &pair : changes) {
+		if (!pair.second.removed && written.count(pair.first) == 0) {
+			added.push_back(&pair);
+		}
+	}
+
+	std::sort(added.begin(), added.end(), [](auto *a, auto *b) {
+		return a->second.order < b->second.order;
+	});
+
+	for (auto *pair : added) {
+		// keep a blank line between blocks
+		if (!merged.empty() && merged.back() != '\n') {
+			merged += "\n\n";
+		} else if (!merged.empty() && (merged.size() < 2 || merged[merged.size() - 2] != '\n')) {
+			merged += '\n';
+		}
+
+		ckv::encode_block(merged, pair->first, pair->second.value);
+	}
+
+	return merged;
 }
 
 /**
- * Returns true if the character used in the key is
- * invalid.
+ * Folds the journal back into the file and removes it.
+ *
+ * The file is replaced as by WriteMode::Atomic, then the
+ * journal is removed. Its records set and remove keys to
+ * what the new file already has, so a crash in between, or
+ * a reader reading the new file with the old journal, sees
+ * the same values. Done before any write not in
+ * WriteMode::Journal, and by compact_in_background().
  *
- * \param ch Character to check.
- * \return true if character is valid and false if not.
+ * It holds the lock append_to_journal() takes, so records
+ * other processes append wait for it and go to a new journal.
+ * Nothing is done if there is no journal.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
  */
-bool is_char_invalid(char ch)
+void ckv::ConfigFile::compact()
 {
-	return (!std::isalnum(ch) && ch != '_' && ch != '-');
+	JournalLock lock(journal_path, false);
+	std::string merged;
+
+	if (!lock.is_locked()) {
+		return;
+	}
+
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
+
+	// whatever the write mode, all of it has to be read
+	sync_journal();
+
+	if (journal.empty()) {
+		// at most a record cut short, which would never be read
+		unlink(journal_path.c_str());
+		clear_journal();
+		return;
+	}
+
+	if (compression != ckv::Compression::None) {
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(file_path);
+	}
+
+	try {
+		merged = merged_contents(journal);
+	} catch(...) {
+		throw;
+	}
+
+	close_file();
+	replace_file(file_path, merged);
+
+	if (unlink(journal_path.c_str()) != 0 && errno != ENOENT) {
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(journal_path);
+	}
+
+	clear_journal();
 }
 
+/**
+ * Compacts the journal on default_thread_pool() with a ConfigFile
+ * of its own, unless a compaction started here is still running.
+ * Called by set_value_for_key() and remove_key() in
+ * WriteMode::Journal once the journal is past get_journal_limit(),
+ * so the write crossing it doesn't wait for the whole file to be
+ * written. Writes meanwhile go on appending, as compact() holds
+ * the lock only while it folds the journal in. If the journal is
+ * past the limit again once it is done, it starts over.
+ *
+ * Errors are left for the next write past the limit, or compact()
+ * called directly, to report.
+ */
+void ckv::ConfigFile::compact_in_background()
+{
+	std::shared_ptr<std::atomic<bool>> pending = compaction_pending;
+	std::string path = file_path;
+	std::string journal_file = journal_path;
+	std::size_t limit = journal_limit;
+
+	if (pending->exchange(true)) {
+		return;
+	}
+
+	ckv::default_thread_pool().submit([pending, path, journal_file, limit]() {
+		struct stat info;
+		bool failed;
+
+		do {
+			failed = false;
+
+			try {
+				ckv::ConfigFile(path).compact();
+			} catch(...) {
+				failed = true;
+			}
+
+			// a write past the limit while this ran left it to us
+			pending->store(false);
+		} while (!failed && stat(journal_file.c_str(), &info) == 0
+				&& static_cast<std::size_t>(info.st_size) > limit && !pending->exchange(true));
+	});
+}
 
 /**
- * Opens file file_path in file_reader.
+ * Outputs to out the contents of the file with the journal and
+ * the change of key folded in, as compact() would write them
+ * with that change. Neither the file nor the journal is touched.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws InvalidOutputStream
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
  */
-void ckv::ConfigFile::open_file()
+void ckv::ConfigFile::write_merged(std::string_view key, std::string_view value, bool removed, std::ostream &out)
 {
-	if (!file_reader.is_open()) {
-		file_reader.open(file_path);
-		if (!file_reader) {
-			err_line_no = 0;
-			throw ckv::FileOpenFailed(file_path);
+	std::unordered_map<std::string_view, JournalEntry> changes = journal;
+
+	if (compression != ckv::Compression::None) {
+		err_line_no = 0;
+		throw ckv::FileWriteFailed(file_path);
+	}
+
+	auto it = changes.find(key);
+
+	if (it == changes.end()) {
+		it = changes.emplace(key, JournalEntry()).first;
+		it->second.order = journal_records;
+	}
+
+	it->second.value = value;
+	it->second.removed = removed;
+
+	out << merged_contents(changes);
+
+	if (!out) {
+		err_line_no = 0;
+		throw ckv::InvalidOutputStream();
+	}
+}
+
+/**
+ * It sets the value for the param key to param value.
+ * It outputs the resulting file ouput to param out.
+ *
+ * Blocks other than that of key are output as they are
+ * in the file, in the same order. Changes in the journal,
+ * if any, are in the output too, the file and the journal
+ * are left as they are.
+ *
+ * \param key
+ *  Key whose value needs to be changes
+ *
+ * \param new_value
+ * 	new value for param1
+ *
+ * \param out
+ * 	ostream to output the updated contents
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws InvalidOutputStream
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+void ckv::ConfigFile::set_value_for_key(std::string key, std::string new_value, std::ostream &out)
+{
+	CKV_STATS_TIME(stats, SetValueForKey);
+
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
+
+	if (!out) {
+		err_line_no = 0;
+		throw ckv::InvalidOutputStream();
+	}
+
+	// changes in the journal, whoever made them, are output too
+	sync_journal();
+
+	if (!journal.empty()) {
+		try {
+			write_merged(key, new_value, false, out);
+		} catch (...) {
+			throw;
+		}
+		return;
+	}
+
+	try {
+		write_splice(splice_for_set(key, new_value), out);
+	} catch (...) {
+		throw;
+	}
+
+}
+
+/**
+ * It sets the value for the param key to param value
+ * in the same file.
+ *
+ * A new key is appended to the end of the file. The file is
+ * replaced as a whole, see WriteMode::Atomic. In WriteMode::InPlace
+ * only the block of key is written if the size of the value
+ * doesn't change, otherwise the blocks after it are shifted too.
+ *
+ * In WriteMode::Journal a record is appended to the journal
+ * instead, unless the file doesn't exist yet. Otherwise the
+ * journal, if any, is compacted first.
+ * A journal grown past get_journal_limit() is compacted in
+ * the background, see compact_in_background().
+ *
+ * \param key
+ * 	Key whose value needs to be changes
+ *
+ * \param new_value
+ * 	New value for param1
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+void ckv::ConfigFile::set_value_for_key(std::string key, std::string new_value)
+{
+	CKV_STATS_TIME(stats, SetValueForKey);
+
+	try {
+		// a file that doesn't exist yet gets created
+		open_file();
+	} catch(...) {
+		close_file();
+	}
+
+	if (write_mode == WriteMode::Journal && mapping.is_open()
+			&& compression == ckv::Compression::None) {
+		std::string record;
+		std::size_t journal_size;
+
+		ckv::encode_journal_set(record, key, new_value);
+
+		try {
+			journal_size = append_to_journal(record);
+			apply_journal_record(key, new_value, false);
+
+			if (journal_size > journal_limit) {
+				compact_in_background();
+			}
+		} catch(...) {
+			throw;
+		}
+		return;
+	}
+
+	if (access(journal_path.c_str(), F_OK) == 0) {
+		// the file has to have the journal's changes first
+		try {
+			compact();
+			open_file();
+		} catch(...) {
+			throw;
 		}
 	}
+
+	try {
+		write_splice(splice_for_set(key, new_value));
+	} catch (...) {
+		throw;
+	}
+
 }
 
 /**
- * Prints key value pair in a readable form.
+ * It removes the param key.
+ * It outputs the resulting file ouput to param out.
+ *
+ * Blocks other than that of key are output as they are
+ * in the file, in the same order. Changes in the journal,
+ * if any, are in the output too, the file and the journal
+ * are left as they are.
+ *
+ * \param key
+ * 	Key to remove
  *
- * Basically it replaces all newlines in the value with a newline followed by a tab.
- * This is because ckv files require a tab to indicate value.
+ * \param out
+ * 	ostream to output the updated contents
  *
- * \param out The output stream where key & value should be written.
- * \param key Key to output
- * \param value Value corresponding to the key
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws InvalidOutputStream
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
  */
-void ckv::ConfigFile::print_key_val(std::ostream &out, std::string key, std::string value)
+void ckv::ConfigFile::remove_key(std::string key, std::ostream &out)
 {
-	std::string value_to_print = std::regex_replace(value, std::regex("\n"), "\n\t");
-	out << key << " =\n";
-	out << '\t' << value_to_print;
-	out << std::endl;
+	CKV_STATS_TIME(stats, RemoveKey);
+
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
+
+	if (!out) {
+		err_line_no = 0;
+		throw ckv::InvalidOutputStream();
+	}
+
+	// changes in the journal, whoever made them, are output too
+	sync_journal();
+
+	if (!journal.empty()) {
+		try {
+			write_merged(key, std::string_view(), true, out);
+		} catch (...) {
+			throw;
+		}
+		return;
+	}
+
+	try {
+		write_splice(splice_for_remove(key), out);
+	} catch (...) {
+		throw;
+	}
 }
 
 /**
- * Parses untabbed lines.
+ * It removes the param key in the same file itself.
  *
- * This parses the untabbed values and returns the key name.
- * Further in_block_parse() should be called to go
- * through the value of key.
- * This function checks the correctness of the file
- * only until the point it parses and throws exceptions
- * accordingly. For example, if the key it was looking for
- * has been found, it won't read the file further and exit.
+ * Nothing is written if the file doesn't have key. The file
+ * is replaced as a whole, see WriteMode::Atomic. In
+ * WriteMode::InPlace only the part of the file from the first
+ * block of key onwards is written.
  *
+ * In WriteMode::Journal a record is appended to the journal
+ * instead, whether the file has key or not. Otherwise the
+ * journal, if any, is compacted first.
+ * A journal grown past get_journal_limit() is compacted in
+ * the background, see compact_in_background().
+ *
+ * \param key
+ * 	Key to remove
+ *
+ * \throws DecompressionFailed
  * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
  * \throws InvalidCharacter
  * \throws MissingEqualTo
  * \throws NoValueFoundForKey
  * \throws TrailingCharsAfterEqualTo
  * \throws ValueWithoutAKey
- *
- * \return
- *  It returns the next key found.
- *  If the key is empty, means there is
- *  no data further in file and in_block_parse()
- *  should NOT be called in such a case.
  */
-std::string ckv::ConfigFile::out_block_parse()
+void ckv::ConfigFile::remove_key(std::string key)
 {
-	bool next_is_value_start = false;
-	bool next_is_equal_to = false;
-	unsigned char ch;
-	std::string key;
+	CKV_STATS_TIME(stats, RemoveKey);
 
-	file_reader >> std::noskipws;
-
-	while (file_reader >> ch) {
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
 
-		if (ch == '\n') {
+	if (write_mode == WriteMode::Journal && compression == ckv::Compression::None) {
+		std::string record;
+		std::size_t journal_size;
 
-			if (next_is_value_start) {
-				if (file_reader.peek() != '\t') {
-					throw ckv::NoValueFoundForKey(key);
-				}
-				return key;
-			} else if (!key.empty()) {
-				throw ckv::MissingEqualTo();
-			}
+		ckv::encode_journal_remove(record, key);
 
-			err_line_no++;
-		} else if (ch == '=') {
-			next_is_equal_to = false;
-			next_is_value_start = true;
+		try {
+			journal_size = append_to_journal(record);
+			apply_journal_record(key, std::string_view(), true);
 
-			if (key.empty()) {
-				throw ckv::EqualToWithoutAKey();
+			if (journal_size > journal_limit) {
+				compact_in_background();
 			}
-		} else if (next_is_equal_to && !tab_or_space(ch)) {
-			throw ckv::MissingEqualTo();
-		} else if (next_is_value_start && !tab_or_space(ch)) {
-			// this occurs after =
-			throw ckv::TrailingCharsAfterEqualTo();
-		} else if (!key.empty() && tab_or_space(ch) && !next_is_value_start) {
-			// This cond is if a tab/space is used after the key
-			next_is_equal_to = true;
-		} else if (std::isspace(ch)) {
-			continue;
-		} else if (is_char_invalid(ch)) {
-			// chars except 0-9, A-Z, a-z, _ and - are invalid.
-			throw ckv::InvalidCharacter(ch);
-		} else {
-			// this is key's char, add it.
-			key += ch;
+		} catch(...) {
+			throw;
 		}
+		return;
 	}
 
-	if (next_is_value_start) {
-		throw ckv::NoValueFoundForKey(key);
-	} else if (next_is_equal_to || !key.empty()) {
-		throw ckv::MissingEqualTo();
+	if (access(journal_path.c_str(), F_OK) == 0) {
+		// the file has to have the journal's changes first
+		try {
+			compact();
+			open_file();
+		} catch(...) {
+			throw;
+		}
 	}
 
-	return key;
+	try {
+		Splice splice = splice_for_remove(key);
+
+		if (splice.length != 0) {
+			write_splice(splice);
+		}
+	} catch (...) {
+		throw;
+	}
 }
 
 /**
- * Parses tabbed lines or lines followed by '+'.
+ * It goes though all the keys in the ckv file
+ * and store the key value pairs in an unordered_map
+ * and returns.
  *
- * This parses the tabbed values for a key.
- * Should strictly be called after out_block_parse() iff
- * key returned from it isn't empty.
- * It goes till EOF or the line not starting with tab or '+'.
+ * With ParseMode::Parallel a large file is parsed
+ * on several threads.
  *
- * \return
- *  returns the value of key
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
  */
-std::string ckv::ConfigFile::in_block_parse()
+std::unordered_map<std::string, std::string> ckv::ConfigFile::import_to_map()
 {
-	unsigned char ch;
-	std::string value;
+	std::unordered_map<std::string, std::string> imported_map;
+	std::string buffer;
 
-	file_reader >> std::noskipws;
+	CKV_STATS_TIME(stats, ImportToMap);
 
-	file_reader >> ch;
+	try {
+		open_file();
+	} catch(...) {
+		throw;
+	}
 
-	while (file_reader >> ch) {
-		if (ch == '\n') {
-			char next = file_reader.peek();
-			if (next == '\t') {
-				value += ch;
-			} else if (next != '+') {
-				return value;
-			}
-			err_line_no++;
-			file_reader >> ch;
-			continue;
+	if (compiled.is_open() && journal.empty()) {
+		imported_map.reserve(compiled.size());
+		compiled.visit([&imported_map](std::string_view key, std::string_view value) {
+			imported_map.emplace(key, value);
+			return true;
+		});
+		return imported_map;
+	}
+
+	if (compression != ckv::Compression::None || !journal.empty()) {
+		try {
+			visit([&imported_map](std::string_view key, std::string_view value) {
+				// the first occurrence of a key is kept
+				imported_map.emplace(key, value);
+				return true;
+			});
+		} catch(...) {
+			throw;
 		}
-		value += ch;
+		return imported_map;
+	}
+
+	try {
+		complete_index();
+	} catch(...) {
+		throw;
+	}
+
+	imported_map.reserve(key_index.size());
+
+	for (auto &pair : key_index) {
+		imported_map.emplace(std::string(pair.first), std::string(ckv::decode_value(raw_value(pair.second), buffer)));
 	}
 
-	return "";
+	return imported_map;
 }
 
 /**
- * It returns the value for the param key.
+ * Same as import_to_map() but the key value pairs are
+ * stored in a FlatMap, in the order they appear in the
+ * file, which costs a few large allocations instead of
+ * a few per pair.
  *
+ * \throws DecompressionFailed
  * \throws EqualToWithoutAKey
  * \throws FileOpenFailed
  * \throws InvalidCharacter
@@ -183,17 +2339,20 @@ std::string ckv::ConfigFile::in_block_parse()
  * \throws NoValueFoundForKey
  * \throws TrailingCharsAfterEqualTo
  * \throws ValueWithoutAKey
- *
- * \param key
- *  Key whose value should be returned.
- *
- * \return
- * 	value for key param1.
  */
-std::string ckv::ConfigFile::get_value_for_key(std::string key)
+ckv::FlatMap ckv::ConfigFile::import_to_flat_map()
 {
-	bool key_found = false;
-	std::string cur_key;
+	ckv::FlatMap imported_map;
+	std::vector<std::vector<ParsedKey>> chunks;
+	std::string buffer;
+
+	auto insert = [&imported_map](std::string_view key, std::string_view value) {
+		// the first occurrence of a key is kept
+		imported_map.insert(key, value);
+		return true;
+	};
+
+	CKV_STATS_TIME(stats, ImportToFlatMap);
 
 	try {
 		open_file();
@@ -201,59 +2360,77 @@ std::string ckv::ConfigFile::get_value_for_key(std::string key)
 		throw;
 	}
 
-	// necessay cuz if some other func calls out_block_parse()
-	// it may leave file_reader to EOF
-	file_reader.seekg(0, std::ios::beg);
-	err_line_no = 1;
-
 	try {
-		while (file_reader.peek() != EOF) {
-			cur_key = out_block_parse();
-			key_found = key == cur_key ? true : false;
+		if (compiled.is_open() && journal.empty()) {
+			imported_map.reserve(compiled.size());
+			compiled.visit(insert);
+		} else if (compression != ckv::Compression::None || !journal.empty()) {
+			visit(insert);
+			imported_map.shrink_to_fit();
+		} else if (parse_in_parallel(0, 1, chunks)) {
+			std::size_t key_count = 0;
 
-			if (cur_key.empty()) {
-				// no more keys left to read
-				break;
+			for (auto &chunk : chunks) {
+				key_count += chunk.size();
 			}
-			if (!key_found) {
-				in_block_parse();
-			} else {
-				return in_block_parse();
+
+			imported_map.reserve(key_count, mapping.view().size());
+
+			for (auto &chunk : chunks) {
+				for (auto &parsed : chunk) {
+					insert(parsed.key, ckv::decode_value(parsed.raw_value, buffer));
+				}
 			}
+
+			imported_map.shrink_to_fit();
+		} else {
+			// keys and values take at most as many bytes as the file
+			imported_map.reserve(0, mapping.view().size());
+			visit(insert);
+			imported_map.shrink_to_fit();
 		}
-	} catch (...) {
+	} catch(...) {
 		throw;
 	}
 
-	err_line_no = 0;
-	throw ckv::KeyNotFound(key);
+	return imported_map;
 }
 
 /**
- * It sets the value for the param key to param value.
- * It outputs the resulting file ouput to param out.
+ * It goes through all the keys in the ckv file
+ * and calls visitor for each key value pair, in
+ * the order they appear in the file.
  *
- * \param key
- *  Key whose value needs to be changes
+ * Nothing is collected along the way: key and value are
+ * views valid only for the duration of the call and the
+ * key index isn't touched. Duplicate keys are passed to
+ * visitor every time they occur.
  *
- * \param new_value
- * 	new value for param1
+ * A key changed in the journal is passed once, where it
+ * first occurs, with its latest value. Keys removed in the
+ * journal are skipped and keys it adds come last, in the
+ * order they were added.
  *
- * \param out
- * 	ostream to output the updated contents
+ * \param visitor
+ *  Called with each key and its value. Returning false
+ *  from it stops the walk.
  *
+ * \throws DecompressionFailed
  * \throws EqualToWithoutAKey
  * \throws FileOpenFailed
  * \throws InvalidCharacter
- * \throws InvalidOutputStream
  * \throws MissingEqualTo
  * \throws NoValueFoundForKey
  * \throws TrailingCharsAfterEqualTo
  * \throws ValueWithoutAKey
  */
-void ckv::ConfigFile::set_value_for_key(std::string key, std::string new_value, std::ostream &out)
+void ckv::ConfigFile::visit(const std::function<bool(std::string_view key, std::string_view value)> &visitor)
 {
-	bool key_exists = false;
+	std::unordered_set<std::string_view> passed;
+	std::vector<const std::pair<const std::string_view, JournalEntry> *> added;
+	bool go_on = true;
+
+	CKV_STATS_TIME(stats, Visit);
 
 	try {
 		open_file();
@@ -261,151 +2438,198 @@ void ckv::ConfigFile::set_value_for_key(std::string key, std::string new_value,
 		throw;
 	}
 
-	if (!out) {
-		err_line_no = 0;
-		throw ckv::InvalidOutputStream();
+	if (journal.empty()) {
+		visit_file(visitor);
+		return;
 	}
 
-	try {
-		auto key_vals = import_to_map();
+	visit_file([&](std::string_view key, std::string_view value) {
+		auto it = journal.find(key);
 
-		for (auto &pair : key_vals) {
-			if (pair.first == key) {
-				print_key_val(out, key, new_value);
-				key_exists = true;
-			} else {
-				print_key_val(out, pair.first, pair.second);
-			}
+		if (it == journal.end()) {
+			return go_on = visitor(key, value);
+		}
 
-			out << std::endl;
+		if (it->second.removed || !passed.insert(it->first).second) {
+			return true;
 		}
 
-		if (!key_exists) {
-			print_key_val(out, key, new_value);
+		return go_on = visitor(key, it->second.value);
+	});
+
+	for (auto &pair : journal) {
+		if (!pair.second.removed && passed.count(pair.first) == 0) {
+			added.push_back(&pair);
 		}
-	} catch (...) {
-		throw;
 	}
 
+	std::sort(added.begin(), added.end(), [](auto *a, auto *b) {
+		return a->second.order < b->second.order;
+	});
+
+	for (auto *pair : added) {
+		if (!go_on) {
+			break;
+		}
+
+		go_on = visitor(pair->first, pair->second.value);
+	}
 }
 
 /**
- * It sets the value for the param key to param value
- * in the same file.
- *
- * \param key
- * 	Key whose value needs to be changes
- *
- * \param new_value
- * 	New value for param1
+ * Same as visit() but only the file is walked, the journal
+ * is left out. The file has to be open.
  *
+ * \throws DecompressionFailed
  * \throws EqualToWithoutAKey
- * \throws FileOpenFailed
  * \throws InvalidCharacter
  * \throws MissingEqualTo
  * \throws NoValueFoundForKey
  * \throws TrailingCharsAfterEqualTo
  * \throws ValueWithoutAKey
  */
-void ckv::ConfigFile::set_value_for_key(std::string key, std::string new_value)
+void ckv::ConfigFile::visit_file(const std::function<bool(std::string_view key, std::string_view value)> &visitor)
 {
-	bool key_exists = false;
-	bool file_open_failed = false;
-	std::unordered_map<std::string, std::string> key_vals;
+	std::string_view key, value;
+	std::string buffer;
 
-	try {
-		open_file();
-	} catch(...) {
-		file_open_failed = true;
+	if (compression != ckv::Compression::None) {
+		check(try_stream_blocks([&](std::string_view key, std::string_view raw_value, unsigned int) {
+			return visitor(key, ckv::decode_value(raw_value, buffer));
+		}));
+		return;
 	}
 
-	try {
-		if (!file_open_failed) {
-			key_vals = import_to_map();
-			file_reader.close();
-		}
-
-		std::ofstream out(file_path);
+	ckv::BlockParser parser(mapping.view());
 
-		if (!out) {
-			err_line_no = 0;
-			throw ckv::FileOpenFailed(file_path);
-		}
+	CKV_STATS_ADD(stats, FullRescans, 1);
 
-		out.seekp(0, std::ios::beg);
+	while (!parser.at_end()) {
+		try {
+			key = parser.out_block_parse();
 
-		for (auto &pair : key_vals) {
-			if (pair.first == key) {
-				print_key_val(out, key, new_value);
-				key_exists = true;
-			} else {
-				print_key_val(out, pair.first, pair.second);
+			if (key.empty()) {
+				// no more keys left to read
+				break;
 			}
 
-			out << std::endl;
+			value = ckv::decode_value(parser.in_block_parse(), buffer);
+		} catch (...) {
+			CKV_STATS_ADD(stats, BytesScanned, parser.get_offset());
+			err_line_no = parser.get_line();
+			throw;
 		}
 
-		if (!key_exists) {
-			print_key_val(out, key, new_value);
+		if (!visitor(key, value)) {
+			break;
 		}
-	} catch (...) {
-		throw;
 	}
 
+	CKV_STATS_ADD(stats, BytesScanned, parser.get_offset());
 }
 
 /**
- * It removes the param key.
- * It outputs the resulting file ouput to param out.
+ * Takes an immutable snapshot of all the keys and values
+ * in the file, which can be shared between threads.
  *
- * \param key
- * 	Key to remove
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+std::shared_ptr<const ckv::Snapshot> ckv::ConfigFile::snapshot()
+{
+	ckv::FlatMap values;
+
+	CKV_STATS_TIME(stats, Snapshot);
+
+	try {
+		values = import_to_flat_map();
+	} catch(...) {
+		throw;
+	}
+
+	// import_to_flat_map() read the file as it is mapped now, and the journal as last read
+	return std::shared_ptr<const ckv::Snapshot>(new ckv::Snapshot(std::move(values), file_path, mapping.get_identity(),
+		journal_identity));
+}
+
+/**
+ * Returns the keys starting with prefix, in lexicographic order.
  *
- * \param out
- * 	ostream to output the updated contents
+ * The keys are sorted once, on the first call of any of the
+ * ordered queries, and kept until the file changes. Each query
+ * is then a binary search and a walk over the keys it returns,
+ * the other keys aren't looked at.
  *
+ * \throws DecompressionFailed
  * \throws EqualToWithoutAKey
  * \throws FileOpenFailed
  * \throws InvalidCharacter
- * \throws InvalidOutputStream
  * \throws MissingEqualTo
  * \throws NoValueFoundForKey
  * \throws TrailingCharsAfterEqualTo
  * \throws ValueWithoutAKey
+ *
+ * \param prefix
+ *  Prefix of the keys wanted, all keys if it is empty.
+ *
+ * \return
+ *  The keys, views valid until the file changes.
  */
-void ckv::ConfigFile::remove_key(std::string key, std::ostream &out)
+std::vector<std::string_view> ckv::ConfigFile::keys_with_prefix(std::string_view prefix)
 {
+	ckv::OrderedIndex::Range range;
+
 	try {
-		open_file();
+		range = get_ordered_index().with_prefix(prefix);
 	} catch(...) {
 		throw;
 	}
 
-	if (!out) {
-		err_line_no = 0;
-		throw ckv::InvalidOutputStream();
-	}
+	return std::vector<std::string_view>(range.begin(), range.end());
+}
 
+/**
+ * Calls visitor for each key starting with prefix and its
+ * value, in lexicographic order of the keys. Values are as
+ * get_value_for_key() returns them.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \param prefix
+ *  Prefix of the keys wanted.
+ *
+ * \param visitor
+ *  Called with each key and its value. Returning false
+ *  from it stops the walk.
+ */
+void ckv::ConfigFile::visit_prefix(std::string_view prefix,
+	const std::function<bool(std::string_view key, std::string_view value)> &visitor)
+{
 	try {
-		auto key_vals = import_to_map();
-
-		for (auto &pair : key_vals) {
-			if (pair.first != key) {
-				print_key_val(out, pair.first, pair.second);
-				out << std::endl;
-			}
-		}
-	} catch (...) {
+		visit_ordered(get_ordered_index().with_prefix(prefix), visitor);
+	} catch(...) {
 		throw;
 	}
 }
 
 /**
- * It removes the param key in the same file itself.
- *
- * \param key
- * 	Key to remove
+ * Same as visit_prefix() but for the keys from first
+ * included to last excluded, in lexicographic order.
  *
+ * \throws DecompressionFailed
  * \throws EqualToWithoutAKey
  * \throws FileOpenFailed
  * \throws InvalidCharacter
@@ -414,56 +2638,92 @@ void ckv::ConfigFile::remove_key(std::string key, std::ostream &out)
  * \throws TrailingCharsAfterEqualTo
  * \throws ValueWithoutAKey
  */
-void ckv::ConfigFile::remove_key(std::string key)
+void ckv::ConfigFile::visit_range(std::string_view first, std::string_view last,
+	const std::function<bool(std::string_view key, std::string_view value)> &visitor)
 {
 	try {
-		open_file();
+		visit_ordered(get_ordered_index().between(first, last), visitor);
 	} catch(...) {
 		throw;
 	}
+}
 
+/**
+ * Finds the longest key text starts with, such as DB_REPLICA
+ * for DB_REPLICA_1_HOST if there is no DB_REPLICA_1.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \param key
+ *  Set to the key found, a view valid until the file changes.
+ *
+ * \return
+ *  false if no key is a prefix of text.
+ */
+bool ckv::ConfigFile::longest_prefix_match(std::string_view text, std::string_view &key)
+{
 	try {
-		auto key_vals = import_to_map();
-
-		file_reader.close();
-
-		std::ofstream out(file_path);
-
-		if (!out) {
-			err_line_no = 0;
-			throw ckv::FileOpenFailed(file_path);
-		}
-
-		out.seekp(0, std::ios::beg);
-
-		for (auto &pair : key_vals) {
-			if (pair.first != key) {
-				print_key_val(out, pair.first, pair.second);
-				out << std::endl;
-			}
-		}
-	} catch (...) {
+		return get_ordered_index().longest_prefix_of(text, key);
+	} catch(...) {
 		throw;
 	}
 }
 
 /**
- * It goes though all the keys in the ckv file
- * and store the key value pairs in an unordered_map
- * and returns.
+ * Compiles the file into a snapshot at compiled_path_for(file_path),
+ * which ConfigFile objects use instead of parsing the file for as
+ * long as the file doesn't change.
  *
+ * \throws DecompressionFailed
  * \throws EqualToWithoutAKey
  * \throws FileOpenFailed
+ * \throws FileWriteFailed
  * \throws InvalidCharacter
  * \throws MissingEqualTo
  * \throws NoValueFoundForKey
  * \throws TrailingCharsAfterEqualTo
  * \throws ValueWithoutAKey
  */
-std::unordered_map<std::string, std::string> ckv::ConfigFile::import_to_map()
+void ckv::ConfigFile::compile()
 {
-	std::unordered_map<std::string, std::string> imported_map;
-	std::string key, value;
+	compile(ckv::compiled_path_for(file_path));
+}
+
+/**
+ * Compiles the file into a snapshot at ckvb_path.
+ *
+ * Like import_to_map(), only the first occurrence
+ * of a key makes it to the snapshot.
+ *
+ * \param ckvb_path
+ *  Path of the snapshot to write.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws FileWriteFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+void ckv::ConfigFile::compile(const std::string &ckvb_path)
+{
+	ckv::CompiledFileBuilder builder;
+	std::unordered_set<std::string_view> seen_keys;
+	std::string_view key, value;
+	std::string buffer;
+	unsigned int line;
+
+	CKV_STATS_TIME(stats, Compile);
 
 	try {
 		open_file();
@@ -471,25 +2731,56 @@ std::unordered_map<std::string, std::string> ckv::ConfigFile::import_to_map()
 		throw;
 	}
 
-	file_reader.seekg(0, std::ios::beg);
-	err_line_no = 1;
-
-	try {
-		while (file_reader.peek() != EOF) {
-			key = out_block_parse();
+	if (compression != ckv::Compression::None) {
+		std::unordered_set<std::string> seen_strings;
 
-			if (key.empty()) {
-				// no more keys left to read
-				break;
+		// keys are views into a buffer that is reused, so they are copied
+		check(try_stream_blocks([&](std::string_view key, std::string_view raw_value, unsigned int line) {
+			if (seen_strings.emplace(key).second) {
+				builder.add(key, ckv::decode_value(raw_value, buffer), line);
 			}
+			return true;
+		}));
+	} else {
+		ckv::BlockParser parser(mapping.view());
+
+		CKV_STATS_ADD(stats, FullRescans, 1);
 
-			value = in_block_parse();
+		while (!parser.at_end()) {
+			try {
+				key = parser.out_block_parse();
+
+				if (key.empty()) {
+					// no more keys left to read
+					break;
+				}
+
+				line = parser.get_line() - 1;
+				value = ckv::decode_value(parser.in_block_parse(), buffer);
+			} catch (...) {
+				err_line_no = parser.get_line();
+				throw;
+			}
 
-			imported_map.insert({key, value});
+			if (seen_keys.insert(key).second) {
+				builder.add(key, value, line);
+			}
 		}
+
+		CKV_STATS_ADD(stats, BytesScanned, parser.get_offset());
+	}
+
+	try {
+		replace_file(ckvb_path, builder.finish(mapping.get_identity(), mapping.view()));
 	} catch (...) {
 		throw;
 	}
 
-	return imported_map;
+	// it may view the snapshot being replaced
+	drop_ordered_index();
+
+	if (ckvb_path == ckv::compiled_path_for(file_path) && compiled.open(ckvb_path)
+			&& !compiled.is_fresh(mapping.get_identity(), mapping.view())) {
+		compiled.close();
+	}
 }
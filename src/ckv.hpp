@@ -4,31 +4,267 @@
 /** \file */
 
 /// \cond HEADERS
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <deque>
 #include <exception>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <variant>
+#include <vector>
 #include <ckv_config.hpp>
+#include <ckv_compiled.hpp>
+#include <ckv_decompress.hpp>
+#include <ckv_flat_map.hpp>
+#include <ckv_journal.hpp>
+#include <ckv_ordered_index.hpp>
+#include <ckv_parser.hpp>
+#include <ckv_stats.hpp>
 /// \endcond
 
 namespace ckv {
 
+class Snapshot;
+
+/**
+ * How ConfigFile writes changes to its file.
+ */
+enum class WriteMode {
+	/**
+	 * Only the changed part of the file is written, in place.
+	 * Cheapest, but a reader can see a half written file and
+	 * a crash in the middle of a write leaves it that way.
+	 *
+	 * A write making the file smaller truncates it under readers
+	 * that have it mapped, which then die of SIGBUS, in this process
+	 * or any other. Only use it when nothing reads the file while it
+	 * is written.
+	 */
+	InPlace,
+	/**
+	 * The whole file is written to a temporary file which is synced
+	 * and renamed over it. Readers see either the old or the new file
+	 * and a crash never leaves a torn one. Readers having the old file
+	 * mapped keep it until they look again. The default.
+	 */
+	Atomic,
+	/**
+	 * set_value_for_key() and remove_key() append a record to a journal
+	 * next to the file, at journal_path_for(), whatever the size of the
+	 * file. Reads look in the journal before the file, as with
+	 * ConfigFile::set_read_journal(). Once the journal grows past the
+	 * limit set by ConfigFile::set_journal_limit(), it is folded back
+	 * into the file as by ConfigFile::compact(), on default_thread_pool()
+	 * so the write crossing the limit doesn't wait for it.
+	 */
+	Journal
+};
+
+/**
+ * How ConfigFile parses a whole file, when it has to.
+ */
+enum class ParseMode {
+	/**
+	 * The file is parsed from start to end by the calling thread.
+	 */
+	Serial,
+	/**
+	 * A large file is cut into chunks at key boundaries which are
+	 * parsed on default_thread_pool(), then merged in file order.
+	 * Small files are still parsed serially.
+	 */
+	Parallel
+};
+
+/**
+ * Result of ConfigFile::try_get_value_for_key().
+ */
+struct LookupResult {
+	/**
+	 * Value of the key if it was found. It is a view into the file's
+	 * mapping, its compiled snapshot or the decoded values kept by
+	 * the ConfigFile and stays valid until the file changes or the
+	 * ConfigFile writes to it.
+	 */
+	std::string_view value;
+	ckv::ErrorCode error = ckv::ErrorCode::None; /**< What went wrong, ErrorCode::None if the key was found */
+	unsigned int line = 0; /**< Line of the key if found, line of the syntax error if any, 0 otherwise */
+
+	/**
+	 * \returns true if the key was found.
+	 */
+	explicit operator bool() const {
+		return error == ckv::ErrorCode::None;
+	}
+};
+
 /**
  * This class acts on a single ckv file that is accociated to
  * it by constructor.
+ *
+ * It keeps parsing state between calls, so an object must not be
+ * used by several threads at once. Threads sharing a file should
+ * read from a Snapshot instead.
  */
 class ConfigFile {
 private:
-	std::ifstream file_reader; /**< ifstream object associated with file_path */
-	std::string file_path;     /**< Current file name as set by the constructor */
-	unsigned int err_line_no;  /**< Error line number of the most recently read ckv file */
+	/**
+	 * Location of a key's value in the mapped file.
+	 */
+	struct IndexEntry {
+		std::size_t value_offset; /**< Offset of the raw value block in mapping */
+		std::size_t value_length; /**< Length of the raw value block */
+		unsigned int line;        /**< Line number of the key */
+
+		/**
+		 * 1 + index in value_cache of what is kept of the value, 0 if
+		 * nothing is. It fits in what would otherwise be padding.
+		 */
+		mutable std::uint32_t cached = 0;
+	};
+
+	/**
+	 * Latest change of a key in the journal.
+	 */
+	struct JournalEntry {
+		std::string value;      /**< Value the key is set to */
+		bool removed = false;   /**< true if the key is removed instead */
+		std::uint64_t order;    /**< Position of the key's first record, for appending new keys in order */
+	};
+
+	/**
+	 * Value converted by a typed getter.
+	 */
+	using TypedValue = std::variant<std::monostate, std::int64_t, double, bool, std::chrono::nanoseconds,
+		std::uint64_t, std::vector<std::string>>;
+
+	/**
+	 * What is kept of a value between lookups.
+	 */
+	struct CachedValue {
+		std::string decoded;     /**< Decoded value, only kept for values spanning several lines */
+		bool is_decoded = false; /**< true once decoded is set */
+		TypedValue typed;        /**< Last conversion by a typed getter */
+	};
+
+	/**
+	 * Key found by a parser, with its raw value.
+	 */
+	struct ParsedKey {
+		std::string_view key;       /**< Key, a view into mapping */
+		std::string_view raw_value; /**< Raw value block, a view into mapping */
+		unsigned int line;          /**< Line number of the key */
+	};
+
+	/**
+	 * Change to make to the file: length bytes at offset
+	 * get replaced by replacement.
+	 */
+	struct Splice {
+		std::size_t offset;      /**< Offset of the bytes to replace */
+		std::size_t length;      /**< Number of bytes to replace */
+		std::string replacement; /**< Bytes to put in their place */
+	};
+
+	ckv::MappedFile mapping;      /**< Memory mapping of file_path */
+	std::string file_path;        /**< Current file name as set by the constructor */
+	std::string journal_path;     /**< journal_path_for(file_path) */
+	unsigned int err_line_no = 0; /**< Error line number of the most recently read ckv file */
+	std::string_view err_token;   /**< Key or character the most recent syntax error is about, a view into mapping or err_token_buffer */
+	std::string err_token_buffer; /**< Holds err_token when mapping is compressed */
+	ckv::WriteMode write_mode = ckv::WriteMode::Atomic; /**< How changes are written to file_path */
+	ckv::ParseMode parse_mode = ckv::ParseMode::Serial;  /**< How whole files are parsed */
+
+	/**
+	 * Keys parsed so far, as views into mapping. Built lazily by
+	 * index_next_key() and thrown away when mapping changes.
+	 */
+	std::unordered_map<std::string_view, IndexEntry> key_index;
+	ckv::BlockParser index_parser; /**< Parser positioned after the last indexed key */
+	bool index_complete = false;   /**< true once index_parser has gone through the whole file */
+	ckv::ErrorCode index_error = ckv::ErrorCode::None; /**< Syntax error index_parser stopped at, if any */
+	unsigned int index_error_line = 0;   /**< Line of index_error */
+	std::string_view index_error_token;  /**< Token of index_error, a view into mapping */
+	ckv::CompiledFile compiled;    /**< Snapshot of file_path, open only while it is fresh */
+	std::deque<CachedValue> value_cache; /**< Values of key_index kept between lookups, thrown away with it */
+	TypedValue compiled_value;     /**< Last value converted from compiled or a compressed file, which have no key_index */
+	ckv::Compression compression = ckv::Compression::None; /**< Compression of mapping, parsed as a stream unless None */
+
+	/**
+	 * Keys in lexicographic order, views into mapping, compiled or
+	 * ordered_key_storage. Built on the first ordered query and
+	 * thrown away with key_index.
+	 */
+	ckv::OrderedIndex ordered_index;
+	bool ordered_index_ready = false;
+	std::vector<std::string> ordered_key_storage; /**< Keys of a compressed file, which has nothing to view */
+
+	/**
+	 * Changes read from journal_path, or made by this object, that
+	 * override the file. Keys are views into journal_keys.
+	 */
+	std::unordered_map<std::string_view, JournalEntry> journal;
+	std::deque<std::string> journal_keys; /**< Keys of journal, in a container that doesn't move them */
+	std::size_t journal_offset = 0;       /**< Bytes of journal_path read into journal */
+	ckv::FileIdentity journal_identity;   /**< Identity of journal_path when it was last read, size -1 if it wasn't */
+	bool read_journal = false;            /**< Whether reads look in the journal outside of WriteMode::Journal */
+	std::uint64_t journal_records = 0;    /**< Number of keys added to journal so far */
+	std::size_t journal_limit = 1 << 20;  /**< Size of journal_path past which it is compacted */
+
+	/**
+	 * Set while a compaction started by compact_in_background()
+	 * hasn't finished. Shared with it, as it may outlive this object.
+	 */
+	std::shared_ptr<std::atomic<bool>> compaction_pending = std::make_shared<std::atomic<bool>>(false);
+#ifdef CKV_ENABLE_STATS
+	ckv::StatsRecorder stats;      /**< Counters and timings of this object */
+#endif
 
+	ckv::ErrorCode try_open_file();
 	void open_file();
-	void print_key_val(std::ostream &out, std::string key, std::string value);
-	std::string out_block_parse();
-	std::string in_block_parse();
+	void close_file();
+	void reset_index();
+	void sync_journal();
+	void clear_journal();
+	void apply_journal_record(std::string_view key, std::string_view value, bool removed);
+	const JournalEntry *find_in_journal(std::string_view key) const;
+	std::size_t append_to_journal(const std::string &record);
+	void compact_in_background();
+	std::string merged_contents(const std::unordered_map<std::string_view, JournalEntry> &changes);
+	void write_merged(std::string_view key, std::string_view value, bool removed, std::ostream &out);
+	void visit_file(const std::function<bool(std::string_view key, std::string_view value)> &visitor);
+	ckv::ErrorCode try_index_next_key(std::string_view &key);
+	std::string_view index_next_key();
+	ckv::ErrorCode try_find_key(std::string_view key, const IndexEntry *&entry);
+	const IndexEntry *find_key(std::string_view key);
+	void check(ckv::ErrorCode error);
+	bool parse_in_parallel(std::size_t offset, unsigned int first_line, std::vector<std::vector<ParsedKey>> &chunks);
+	void complete_index();
+	ckv::ErrorCode try_stream_blocks(const std::function<bool(std::string_view key, std::string_view raw_value,
+		unsigned int line)> &on_key);
+	const ckv::OrderedIndex &get_ordered_index();
+	void drop_ordered_index();
+	void visit_ordered(ckv::OrderedIndex::Range range,
+		const std::function<bool(std::string_view key, std::string_view value)> &visitor);
+	std::string_view raw_value(const IndexEntry &entry) const;
+	CachedValue &cache_for(const IndexEntry &entry);
+	std::string_view decoded_value(const IndexEntry &entry);
+	std::size_t block_start(std::string_view key) const;
+	Splice splice_for_set(const std::string &key, const std::string &new_value);
+	Splice splice_for_remove(const std::string &key);
+	void write_splice(const Splice &splice, std::ostream &out);
+	void write_splice(const Splice &splice);
+	void replace_file(const std::string &path, std::string_view contents);
+
+	template <typename T>
+	const T &get_typed(const std::string &key, const char *type_name, bool (*convert)(std::string_view, T &));
 
 public:
 	/**
@@ -39,7 +275,7 @@ public:
 	 * \param file_path
 	 * Path to the file.
 	 */
-	ConfigFile(std::string file_path) : file_path(file_path){}
+	ConfigFile(std::string file_path) : file_path(file_path), journal_path(ckv::journal_path_for(file_path)){}
 
 	/**
 	 * Returns the current error line number of the ConfigFile object.
@@ -60,13 +296,153 @@ public:
 		return file_path;
 	}
 
+	/**
+	 * Sets how set_value_for_key() and remove_key() write to the file.
+	 * WriteMode::Atomic is used by default.
+	 *
+	 * \param mode
+	 * Write mode to use from now on.
+	 */
+	void set_write_mode(ckv::WriteMode mode) {
+		write_mode = mode;
+	}
+
+	/**
+	 * \returns Write mode of current ConfigFile object.
+	 */
+	ckv::WriteMode get_write_mode() {
+		return write_mode;
+	}
+
+	/**
+	 * Sets the size in bytes the journal can grow to in
+	 * WriteMode::Journal before it is compacted, 1 MiB by default.
+	 *
+	 * \param limit
+	 * Size limit to use from now on.
+	 */
+	void set_journal_limit(std::size_t limit) {
+		journal_limit = limit;
+	}
+
+	/**
+	 * \returns Size the journal can grow to before it is compacted.
+	 */
+	std::size_t get_journal_limit() {
+		return journal_limit;
+	}
+
+	/**
+	 * Makes reads look in the journal written by objects in
+	 * WriteMode::Journal, which costs a stat() of the journal on
+	 * every lookup. Off by default, reads in WriteMode::Journal
+	 * always look in it.
+	 *
+	 * \param enable
+	 * true to read the journal from now on.
+	 */
+	void set_read_journal(bool enable) {
+		read_journal = enable;
+	}
+
+	/**
+	 * \returns true if reads look in the journal.
+	 */
+	bool get_read_journal() {
+		return read_journal || write_mode == ckv::WriteMode::Journal;
+	}
+
+	/**
+	 * Sets how import_to_map(), import_to_flat_map() and snapshot()
+	 * parse the file. ParseMode::Serial is used by default.
+	 *
+	 * \param mode
+	 * Parse mode to use from now on.
+	 */
+	void set_parse_mode(ckv::ParseMode mode) {
+		parse_mode = mode;
+	}
+
+	/**
+	 * \returns Parse mode of current ConfigFile object.
+	 */
+	ckv::ParseMode get_parse_mode() {
+		return parse_mode;
+	}
+
 	void set_value_for_key(std::string key, std::string new_value, std::ostream &out);
 	std::string get_value_for_key(std::string key);
+	ckv::LookupResult try_get_value_for_key(std::string_view key, std::string &buffer);
+	std::unordered_map<std::string, std::string> get_values_for_keys(const std::vector<std::string> &keys);
 	void remove_key(std::string key, std::ostream &out);
 	std::unordered_map<std::string, std::string> import_to_map();
+	ckv::FlatMap import_to_flat_map();
+	void visit(const std::function<bool(std::string_view key, std::string_view value)> &visitor);
+	std::shared_ptr<const ckv::Snapshot> snapshot();
+
+	std::vector<std::string_view> keys_with_prefix(std::string_view prefix);
+	void visit_prefix(std::string_view prefix,
+		const std::function<bool(std::string_view key, std::string_view value)> &visitor);
+	void visit_range(std::string_view first, std::string_view last,
+		const std::function<bool(std::string_view key, std::string_view value)> &visitor);
+	bool longest_prefix_match(std::string_view text, std::string_view &key);
+
+	std::int64_t get_int(const std::string &key);
+	double get_double(const std::string &key);
+	bool get_bool(const std::string &key);
+	std::chrono::nanoseconds get_duration(const std::string &key);
+	std::uint64_t get_size(const std::string &key);
+	const std::vector<std::string> &get_list(const std::string &key);
 
 	void set_value_for_key(std::string key, std::string new_value);
 	void remove_key(std::string key);
+	void compact();
+
+	void compile();
+	void compile(const std::string &ckvb_path);
+
+	/**
+	 * \returns true if lookups are currently served from
+	 * the compiled snapshot of the file.
+	 */
+	bool uses_compiled() {
+		return compiled.is_open();
+	}
+
+	/**
+	 * \returns Counters and method timings of this object,
+	 * all zeros unless built with CKV_ENABLE_STATS.
+	 */
+	ckv::Stats get_stats() const {
+#ifdef CKV_ENABLE_STATS
+		return stats.get();
+#else
+		return ckv::Stats();
+#endif
+	}
+};
+
+/**
+ * This exception is thrown when a compressed ckv file is
+ * corrupt, cut short or of a compression the library
+ * wasn't built with.
+ */
+class DecompressionFailed : public std::exception {
+	std::string file_path;
+	std::string message;
+public:
+	/**
+	 * \param file_path
+	 * The file path that failed to be decompressed.
+	 */
+	DecompressionFailed(std::string file_path)
+		: file_path(file_path), message("Failed to decompress file " + file_path) {}
+
+	/// \cond WHAT
+	const char *what() const noexcept {
+		return message.c_str();
+	}
+	/// \endcond
 };
 
 /**
@@ -88,26 +464,40 @@ public:
  */
 class FileOpenFailed : public std::exception {
 	std::string file_path;
-	mutable char *ret_str = nullptr;
+	std::string message;
 public:
 	/**
 	 * \param file_path
 	 * The file path that failed to open.
 	 */
-	FileOpenFailed(std::string file_path) : file_path(file_path) {}
+	FileOpenFailed(std::string file_path)
+		: file_path(file_path), message("Failed to open file " + file_path) {}
 
-	~FileOpenFailed() {
-		if (ret_str != nullptr) {
-			delete ret_str;
-		}
+	/// \cond WHAT
+	const char *what() const noexcept {
+		return message.c_str();
 	}
+	/// \endcond
+};
+
+/**
+ * This exception is thrown when writing to the ckv
+ * file fails.
+ */
+class FileWriteFailed : public std::exception {
+	std::string file_path;
+	std::string message;
+public:
+	/**
+	 * \param file_path
+	 * The file path that failed to be written.
+	 */
+	FileWriteFailed(std::string file_path)
+		: file_path(file_path), message("Failed to write file " + file_path) {}
 
 	/// \cond WHAT
 	const char *what() const noexcept {
-		std::ostringstream ret;
-		ret << "Failed to open file " << file_path;
-		ret_str = strdup(ret.str().c_str());
-		return ret_str;
+		return message.c_str();
 	}
 	/// \endcond
 };
@@ -119,26 +509,17 @@ public:
 class InvalidCharacter : public std::exception {
 private:
 	char c;
-	mutable char *ret_str = nullptr;
+	std::string message;
 public:
 	/**
 	 * \param c
 	 * Invalid character
 	 */
-	InvalidCharacter(char c) : c(c) {}
-
-	~InvalidCharacter() {
-		if (ret_str != nullptr) {
-			delete ret_str;
-		}
-	}
+	InvalidCharacter(char c) : c(c), message(std::string("Invalid character ") + c) {}
 
 	/// \cond WHAT
 	const char *what() const noexcept {
-		std::ostringstream ret;
-		ret << "Invalid character " << this->c;
-		ret_str = strdup(ret.str().c_str());
-		return ret_str;
+		return message.c_str();
 	}
 	/// \endcond
 };
@@ -156,32 +537,54 @@ public:
 	/// \endcond
 };
 
+/**
+ * This exception is thrown when a typed getter finds
+ * a value that isn't valid for its type.
+ */
+class InvalidValue : public std::exception {
+private:
+	std::string key;
+	unsigned int line;
+	std::string message;
+public:
+	/**
+	 * \param key
+	 * Key whose value is invalid.
+	 *
+	 * \param line
+	 * Line number of the key.
+	 *
+	 * \param type_name
+	 * Type the value was expected to have.
+	 */
+	InvalidValue(std::string key, unsigned int line, std::string type_name)
+		: key(key), line(line),
+		message("\"" + key + "\" on line " + std::to_string(line) + ": value isn't a valid " + type_name) {}
+
+	/// \cond WHAT
+	const char *what() const noexcept {
+		return message.c_str();
+	}
+	/// \endcond
+};
+
 /**
  * Exception for key not found.
  */
 class KeyNotFound : public std::exception {
 private:
 	std::string key;
-	mutable char *ret_str = nullptr;
+	std::string message;
 public:
 	/**
 	 * \param key
 	 * Key which was being searched and not found.
 	 */
-	KeyNotFound(std::string key) : key(key) {}
-
-	~KeyNotFound() {
-		if(ret_str != nullptr) {
-			delete ret_str;
-		}
-	}
+	KeyNotFound(std::string key) : key(key), message("\"" + key + "\": key not found") {}
 
 	/// \cond WHAT
 	const char *what() const noexcept {
-		std::ostringstream ret;
-		ret << "\"" << this->key << "\"" << ": key not found";
-		ret_str = strdup(ret.str().c_str());
-		return ret_str;
+		return message.c_str();
 	}
 	/// \endcond
 };
@@ -206,26 +609,30 @@ public:
 class NoValueFoundForKey : public std::exception {
 private:
 	std::string key;
-	mutable char *ret_str = nullptr;
+	std::string message;
 public:
 	/**
 	 * \param key
 	 * Key being searched
 	 */
-	NoValueFoundForKey(std::string key) : key(key) {}
+	NoValueFoundForKey(std::string key) : key(key), message("\"" + key + "\": No value found for key.") {}
 
-	~NoValueFoundForKey() {
-		if(ret_str != nullptr) {
-			delete ret_str;
-		}
+	/// \cond WHAT
+	const char *what() const noexcept {
+		return message.c_str();
 	}
+	/// \endcond
+};
 
+/**
+ * This exception is thrown by an async operation
+ * cancelled before it completed.
+ */
+class OperationCancelled : public std::exception {
+public:
 	/// \cond WHAT
 	const char *what() const noexcept {
-		std::ostringstream ret;
-		ret << "\"" << this->key << "\"" << ": No value found for key.";
-		ret_str = strdup(ret.str().c_str());
-		return ret_str;
+		return "Operation cancelled";
 	}
 	/// \endcond
 };
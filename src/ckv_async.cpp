@@ -0,0 +1,139 @@
+#include <ckv_async.hpp>
+
+/**
+ * Runs work on the executor of options, keeping its
+ * result or exception in the future returned.
+ */
+template <typename T>
+static std::future<T> run_async(const ckv::AsyncOptions &options, std::function<T()> work)
+{
+	// std::function needs a copyable task
+	auto promise = std::make_shared<std::promise<T>>();
+	std::future<T> future = promise->get_future();
+	ckv::CancellationToken cancellation = options.cancellation;
+
+	options.get_executor()([promise, cancellation, work]() {
+		try {
+			if (cancellation.is_cancelled()) {
+				throw ckv::OperationCancelled();
+			}
+
+			T result = work();
+
+			if (cancellation.is_cancelled()) {
+				throw ckv::OperationCancelled();
+			}
+
+			promise->set_value(std::move(result));
+		} catch (...) {
+			promise->set_exception(std::current_exception());
+		}
+	});
+
+	return future;
+}
+
+/**
+ * \returns Executor submitting tasks to pool, which
+ * has to outlive the tasks.
+ */
+ckv::Executor ckv::thread_pool_executor(ThreadPool &pool)
+{
+	return [&pool](std::function<void()> task) {
+		pool.submit(std::move(task));
+	};
+}
+
+/**
+ * \returns executor, or one running tasks on
+ * default_thread_pool() if it is empty.
+ */
+ckv::Executor ckv::AsyncOptions::get_executor() const
+{
+	return executor ? executor : thread_pool_executor(default_thread_pool());
+}
+
+/**
+ * Same as ConfigFile::import_to_map() but run on the executor
+ * of options. The future holds the map or the exception
+ * import_to_map() threw.
+ *
+ * \throws OperationCancelled
+ *  From the future, if cancelled.
+ */
+std::future<std::unordered_map<std::string, std::string>> ckv::import_to_map_async(const std::string &file_path,
+	const AsyncOptions &options)
+{
+	ckv::ParseMode mode = options.parse_mode;
+
+	return run_async<std::unordered_map<std::string, std::string>>(options, [file_path, mode]() {
+		ckv::ConfigFile file(file_path);
+		file.set_parse_mode(mode);
+		return file.import_to_map();
+	});
+}
+
+/**
+ * Same as import_to_map_async() but for ConfigFile::import_to_flat_map().
+ */
+std::future<ckv::FlatMap> ckv::import_to_flat_map_async(const std::string &file_path, const AsyncOptions &options)
+{
+	ckv::ParseMode mode = options.parse_mode;
+
+	return run_async<ckv::FlatMap>(options, [file_path, mode]() {
+		ckv::ConfigFile file(file_path);
+		file.set_parse_mode(mode);
+		return file.import_to_flat_map();
+	});
+}
+
+/**
+ * Same as import_to_map_async() but for ConfigFile::snapshot().
+ */
+std::future<std::shared_ptr<const ckv::Snapshot>> ckv::snapshot_async(const std::string &file_path,
+	const AsyncOptions &options)
+{
+	ckv::ParseMode mode = options.parse_mode;
+
+	return run_async<std::shared_ptr<const ckv::Snapshot>>(options, [file_path, mode]() {
+		ckv::ConfigFile file(file_path);
+		file.set_parse_mode(mode);
+		return file.snapshot();
+	});
+}
+
+/**
+ * Same as import_to_map_async() but for ConfigFile::get_value_for_key().
+ */
+std::future<std::string> ckv::get_value_for_key_async(const std::string &file_path, const std::string &key,
+	const AsyncOptions &options)
+{
+	return run_async<std::string>(options, [file_path, key]() {
+		ckv::ConfigFile file(file_path);
+		return file.get_value_for_key(key);
+	});
+}
+
+/**
+ * Same as import_to_map_async() but for ConfigFile::get_values_for_keys().
+ */
+std::future<std::unordered_map<std::string, std::string>> ckv::get_values_for_keys_async(const std::string &file_path,
+	const std::vector<std::string> &keys, const AsyncOptions &options)
+{
+	return run_async<std::unordered_map<std::string, std::string>>(options, [file_path, keys]() {
+		ckv::ConfigFile file(file_path);
+		return file.get_values_for_keys(keys);
+	});
+}
+
+/**
+ * Same as import_to_map_async() but for load_directory(). The
+ * files are loaded on default_thread_pool() whatever the executor.
+ */
+std::future<ckv::LoadedDirectory> ckv::load_directory_async(const std::string &dir_path, bool recursive,
+	const AsyncOptions &options)
+{
+	return run_async<ckv::LoadedDirectory>(options, [dir_path, recursive]() {
+		return ckv::load_directory(dir_path, recursive);
+	});
+}
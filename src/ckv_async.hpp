@@ -0,0 +1,187 @@
+#ifndef __CKV_ASYNC_HPP__
+#define __CKV_ASYNC_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ckv.hpp>
+#include <ckv_directory.hpp>
+#include <ckv_flat_map.hpp>
+#include <ckv_snapshot.hpp>
+#include <ckv_thread_pool.hpp>
+#if defined(CKV_ENABLE_COROUTINES)
+#include <coroutine>
+#include <optional>
+#endif
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Runs a task somewhere, usually on another thread.
+ */
+using Executor = std::function<void(std::function<void()> task)>;
+
+Executor thread_pool_executor(ThreadPool &pool);
+
+/**
+ * Lets async operations be cancelled from any thread.
+ * Copies share their state, so cancelling one cancels
+ * the operations given any of them.
+ *
+ * An operation is cancelled if the token is cancelled by
+ * the time it starts or completes, its future then holds
+ * OperationCancelled. One that has started parsing runs
+ * to the end before its result is dropped.
+ */
+class CancellationToken {
+private:
+	std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+
+public:
+	/**
+	 * Cancels the operations given this token.
+	 */
+	void cancel() {
+		cancelled->store(true);
+	}
+
+	/**
+	 * \returns true once cancel() has been called.
+	 */
+	bool is_cancelled() const {
+		return cancelled->load();
+	}
+};
+
+/**
+ * How an async operation is run.
+ */
+struct AsyncOptions {
+	Executor executor;                                 /**< Runs the operation, default_thread_pool() if empty */
+	CancellationToken cancellation;                    /**< Cancels the operation */
+	ckv::ParseMode parse_mode = ckv::ParseMode::Serial; /**< How whole files are parsed */
+
+	Executor get_executor() const;
+};
+
+std::future<std::unordered_map<std::string, std::string>> import_to_map_async(const std::string &file_path,
+	const AsyncOptions &options = AsyncOptions());
+std::future<ckv::FlatMap> import_to_flat_map_async(const std::string &file_path,
+	const AsyncOptions &options = AsyncOptions());
+std::future<std::shared_ptr<const ckv::Snapshot>> snapshot_async(const std::string &file_path,
+	const AsyncOptions &options = AsyncOptions());
+std::future<std::string> get_value_for_key_async(const std::string &file_path, const std::string &key,
+	const AsyncOptions &options = AsyncOptions());
+std::future<std::unordered_map<std::string, std::string>> get_values_for_keys_async(const std::string &file_path,
+	const std::vector<std::string> &keys, const AsyncOptions &options = AsyncOptions());
+std::future<ckv::LoadedDirectory> load_directory_async(const std::string &dir_path, bool recursive = true,
+	const AsyncOptions &options = AsyncOptions());
+
+#if defined(CKV_ENABLE_COROUTINES)
+
+/**
+ * Result of the co_*() functions, to be co_awaited. Awaiting it
+ * runs work on the executor and resumes the coroutine there once
+ * it is done, with its result or exception.
+ *
+ * Only available with C++20 and CKV_ENABLE_COROUTINES defined.
+ */
+template <typename T>
+class Awaitable {
+private:
+	std::function<T()> work;
+	AsyncOptions options;
+	std::optional<T> result;
+	std::exception_ptr error;
+
+public:
+	Awaitable(std::function<T()> work, AsyncOptions options)
+		: work(std::move(work)), options(std::move(options)) {}
+
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> handle) {
+		options.get_executor()([this, handle]() {
+			try {
+				if (options.cancellation.is_cancelled()) {
+					throw ckv::OperationCancelled();
+				}
+
+				result.emplace(work());
+
+				if (options.cancellation.is_cancelled()) {
+					throw ckv::OperationCancelled();
+				}
+			} catch (...) {
+				error = std::current_exception();
+			}
+			handle.resume();
+		});
+	}
+
+	T await_resume() {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		return std::move(*result);
+	}
+};
+
+/**
+ * Same as import_to_map_async() but to be co_awaited.
+ */
+inline Awaitable<std::unordered_map<std::string, std::string>> co_import_to_map(std::string file_path,
+	AsyncOptions options = AsyncOptions())
+{
+	ckv::ParseMode mode = options.parse_mode;
+
+	return Awaitable<std::unordered_map<std::string, std::string>>([file_path, mode]() {
+		ckv::ConfigFile file(file_path);
+		file.set_parse_mode(mode);
+		return file.import_to_map();
+	}, std::move(options));
+}
+
+/**
+ * Same as snapshot_async() but to be co_awaited.
+ */
+inline Awaitable<std::shared_ptr<const ckv::Snapshot>> co_snapshot(std::string file_path,
+	AsyncOptions options = AsyncOptions())
+{
+	ckv::ParseMode mode = options.parse_mode;
+
+	return Awaitable<std::shared_ptr<const ckv::Snapshot>>([file_path, mode]() {
+		ckv::ConfigFile file(file_path);
+		file.set_parse_mode(mode);
+		return file.snapshot();
+	}, std::move(options));
+}
+
+/**
+ * Same as get_value_for_key_async() but to be co_awaited.
+ */
+inline Awaitable<std::string> co_get_value_for_key(std::string file_path, std::string key,
+	AsyncOptions options = AsyncOptions())
+{
+	return Awaitable<std::string>([file_path, key]() {
+		ckv::ConfigFile file(file_path);
+		return file.get_value_for_key(key);
+	}, std::move(options));
+}
+
+#endif
+
+}
+
+#endif /* __CKV_ASYNC_HPP__ */
@@ -0,0 +1,442 @@
+#ifndef __CKV_BIND_HPP__
+#define __CKV_BIND_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <ckv.hpp>
+#include <ckv_convert.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * \returns FNV-1a hash of key, usable at compile time.
+ */
+constexpr std::uint64_t hash_key(std::string_view key)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+
+	for (char ch : key) {
+		hash ^= static_cast<unsigned char>(ch);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+/**
+ * Default of a Field that has to be in the file.
+ */
+struct Required {};
+
+/**
+ * Key of a schema for bind(), and the member of the struct
+ * its value goes to. Made by field().
+ */
+template <typename Struct, typename Member, typename Default>
+struct Field {
+	std::string_view name;    /**< Key in the file */
+	Member Struct::*member;   /**< Member the converted value is stored in */
+	Default default_value;    /**< Stored in member if the key isn't in the file */
+	std::uint64_t hash;       /**< hash_key(name) */
+
+	static constexpr bool required = std::is_same_v<Default, Required>;
+};
+
+/**
+ * \returns Field for a key which has to be in the file.
+ */
+template <typename Struct, typename Member>
+constexpr Field<Struct, Member, Required> field(std::string_view name, Member Struct::*member)
+{
+	return Field<Struct, Member, Required>{name, member, Required(), hash_key(name)};
+}
+
+/**
+ * \returns Field for a key which gets default_value if it isn't in the file.
+ * default_value has to be assignable to the member, a string member
+ * takes a string literal.
+ */
+template <typename Struct, typename Member, typename Default>
+constexpr Field<Struct, Member, Default> field(std::string_view name, Member Struct::*member, Default default_value)
+{
+	return Field<Struct, Member, Default>{name, member, default_value, hash_key(name)};
+}
+
+/// \cond INTERNALS
+namespace bind_detail {
+
+template <typename T>
+struct is_duration : std::false_type {};
+
+template <typename Rep, typename Period>
+struct is_duration<std::chrono::duration<Rep, Period>> : std::true_type {};
+
+/*
+ * Conversions of values to the type of a member. Signed integers are
+ * read like ckv::parse_int(), unsigned ones like ckv::parse_size()
+ * so they take units.
+ */
+
+inline bool convert(std::string_view text, std::string &value)
+{
+	value.assign(text);
+	return true;
+}
+
+inline bool convert(std::string_view text, bool &value)
+{
+	return ckv::parse_bool(text, value);
+}
+
+inline bool convert(std::string_view text, std::vector<std::string> &value)
+{
+	return ckv::parse_list(text, value);
+}
+
+template <typename T>
+std::enable_if_t<std::is_integral_v<T> && std::is_signed_v<T>, bool> convert(std::string_view text, T &value)
+{
+	std::int64_t parsed;
+
+	if (!ckv::parse_int(text, parsed) || parsed < std::numeric_limits<T>::min()
+			|| parsed > std::numeric_limits<T>::max()) {
+		return false;
+	}
+
+	value = static_cast<T>(parsed);
+	return true;
+}
+
+template <typename T>
+std::enable_if_t<std::is_integral_v<T> && std::is_unsigned_v<T> && !std::is_same_v<T, bool>, bool>
+convert(std::string_view text, T &value)
+{
+	std::uint64_t parsed;
+
+	if (!ckv::parse_size(text, parsed) || parsed > std::numeric_limits<T>::max()) {
+		return false;
+	}
+
+	value = static_cast<T>(parsed);
+	return true;
+}
+
+template <typename T>
+std::enable_if_t<std::is_floating_point_v<T>, bool> convert(std::string_view text, T &value)
+{
+	double parsed;
+
+	if (!ckv::parse_double(text, parsed)) {
+		return false;
+	}
+
+	value = static_cast<T>(parsed);
+	return true;
+}
+
+template <typename T>
+std::enable_if_t<is_duration<T>::value, bool> convert(std::string_view text, T &value)
+{
+	std::chrono::nanoseconds parsed;
+
+	if (!ckv::parse_duration(text, parsed)) {
+		return false;
+	}
+
+	value = std::chrono::duration_cast<T>(parsed);
+	return true;
+}
+
+/*
+ * Name of the type of a member in ckv::InvalidValue.
+ */
+template <typename T>
+constexpr const char *type_name()
+{
+	if constexpr (std::is_same_v<T, bool>) {
+		return "bool";
+	} else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+		return "integer";
+	} else if constexpr (std::is_integral_v<T>) {
+		return "size";
+	} else if constexpr (std::is_floating_point_v<T>) {
+		return "floating point number";
+	} else if constexpr (is_duration<T>::value) {
+		return "duration";
+	} else if constexpr (std::is_same_v<T, std::vector<std::string>>) {
+		return "list";
+	} else {
+		return "string";
+	}
+}
+
+/*
+ * Helpers working out Binder at compile time, outside of it
+ * since it can't call its own functions before it is complete.
+ */
+
+template <typename Schema, std::size_t... I>
+constexpr auto field_names(std::index_sequence<I...>)
+{
+	return std::array<std::string_view, sizeof...(I)>{{std::get<I>(Schema::fields).name...}};
+}
+
+template <typename Schema, std::size_t... I>
+constexpr auto field_hashes(std::index_sequence<I...>)
+{
+	return std::array<std::uint64_t, sizeof...(I)>{{std::get<I>(Schema::fields).hash...}};
+}
+
+template <typename Schema, std::size_t... I>
+constexpr auto field_required(std::index_sequence<I...>)
+{
+	return std::array<bool, sizeof...(I)>{{std::decay_t<decltype(std::get<I>(Schema::fields))>::required...}};
+}
+
+template <typename Schema, std::size_t I>
+using member_type = std::decay_t<decltype(std::declval<typename Schema::type &>().*(std::get<I>(Schema::fields).member))>;
+
+template <typename Schema, std::size_t... I>
+constexpr auto field_type_names(std::index_sequence<I...>)
+{
+	return std::array<const char *, sizeof...(I)>{{type_name<member_type<Schema, I>>()...}};
+}
+
+template <typename Schema, std::size_t I>
+bool assign_field(typename Schema::type &result, std::string_view value)
+{
+	return convert(value, result.*(std::get<I>(Schema::fields).member));
+}
+
+template <typename Schema, std::size_t... I>
+constexpr auto field_assigners(std::index_sequence<I...>)
+{
+	using Assign = bool (*)(typename Schema::type &result, std::string_view value);
+	return std::array<Assign, sizeof...(I)>{{&assign_field<Schema, I>...}};
+}
+
+template <std::size_t N>
+constexpr bool has_unique_names(const std::array<std::string_view, N> &names)
+{
+	for (std::size_t i = 0; i < N; i++) {
+		for (std::size_t j = i + 1; j < N; j++) {
+			if (names[i] == names[j]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * Power of two at least twice count, so the table
+ * is at most half full and probes stay short.
+ */
+constexpr std::size_t table_size_for(std::size_t count)
+{
+	std::size_t size = 1;
+
+	while (size < 2 * count) {
+		size *= 2;
+	}
+	return size;
+}
+
+/*
+ * Open addressing table from hash to field, each slot
+ * holding 1 + index of the field or 0 if empty.
+ */
+template <std::size_t Size, std::size_t N>
+constexpr std::array<std::size_t, Size> make_table(const std::array<std::uint64_t, N> &hashes)
+{
+	std::array<std::size_t, Size> slots{};
+
+	for (std::size_t i = 0; i < N; i++) {
+		std::size_t slot = hashes[i] & (Size - 1);
+
+		while (slots[slot] != 0) {
+			slot = (slot + 1) & (Size - 1);
+		}
+		slots[slot] = i + 1;
+	}
+	return slots;
+}
+
+template <typename Struct, typename Member, typename Default>
+void apply_default(Struct &result, const Field<Struct, Member, Default> &field)
+{
+	if constexpr (!std::is_same_v<Default, Required>) {
+		result.*(field.member) = field.default_value;
+	}
+}
+
+template <typename Schema, std::size_t... I>
+void apply_defaults(typename Schema::type &result, std::index_sequence<I...>)
+{
+	(apply_default(result, std::get<I>(Schema::fields)), ...);
+}
+
+/*
+ * Everything bind() needs to know about Schema, worked
+ * out at compile time.
+ */
+template <typename Schema>
+struct Binder {
+	using Fields = std::decay_t<decltype(Schema::fields)>;
+	using Indices = std::make_index_sequence<std::tuple_size_v<Fields>>;
+
+	static constexpr std::size_t count = std::tuple_size_v<Fields>;
+	static constexpr std::size_t npos = count;
+	static constexpr std::size_t table_size = table_size_for(count);
+
+	static constexpr auto names = field_names<Schema>(Indices());
+	static constexpr auto hashes = field_hashes<Schema>(Indices());
+	static constexpr auto required = field_required<Schema>(Indices());
+	static constexpr auto type_names = field_type_names<Schema>(Indices());
+	static constexpr auto assigners = field_assigners<Schema>(Indices());
+	static constexpr auto table = make_table<table_size>(hashes);
+
+	static_assert(count > 0, "ckv::bind() schema has no fields");
+	static_assert(has_unique_names(names), "ckv::bind() schema has the same key name more than once");
+
+	/*
+	 * Index of the field for key, npos if there isn't one.
+	 * Names are only compared when the hashes match.
+	 */
+	static std::size_t find(std::string_view key) {
+		std::uint64_t hash = hash_key(key);
+		std::size_t slot = hash & (table_size - 1);
+
+		while (table[slot] != 0) {
+			std::size_t i = table[slot] - 1;
+
+			if (hashes[i] == hash && names[i] == key) {
+				return i;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+
+		return npos;
+	}
+};
+
+}
+/// \endcond
+
+/**
+ * Fills a struct from file in a single pass over it.
+ *
+ * Schema names the struct and describes its keys:
+ *
+ * \code
+ * struct ServerConfig {
+ *     std::string host;
+ *     int port;
+ *     std::chrono::milliseconds timeout;
+ *     std::uint64_t cache_size;
+ * };
+ *
+ * struct ServerSchema {
+ *     using type = ServerConfig;
+ *     static constexpr auto fields = std::make_tuple(
+ *         ckv::field("HOST", &ServerConfig::host),
+ *         ckv::field("PORT", &ServerConfig::port, 8080),
+ *         ckv::field("TIMEOUT", &ServerConfig::timeout, std::chrono::milliseconds(500)),
+ *         ckv::field("CACHE_SIZE", &ServerConfig::cache_size, std::uint64_t(64) << 20)
+ *     );
+ * };
+ *
+ * ServerConfig config = ckv::bind<ServerSchema>(file);
+ * \endcode
+ *
+ * Key names are hashed at compile time and each key of the file
+ * is matched to its field through a table built at compile time,
+ * so a key costs one hash and at most a few comparisons. A schema
+ * with a key name twice doesn't compile.
+ *
+ * Members can be std::string, bool, integers, floating point
+ * numbers, std::chrono durations and std::vector<std::string>,
+ * converted like the typed getters of ConfigFile. Unsigned
+ * integers are read as sizes, so they take units like 64MiB.
+ * Keys not in the schema are skipped and, as everywhere, only
+ * the first occurrence of a key counts. The pass stops once
+ * every field has been found.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws InvalidValue
+ * \throws KeyNotFound
+ *  If a field without a default isn't in the file.
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+template <typename Schema>
+typename Schema::type bind(ckv::ConfigFile &file)
+{
+	using Binder = bind_detail::Binder<Schema>;
+
+	typename Schema::type result{};
+	std::array<bool, Binder::count> found{};
+	std::size_t found_count = 0;
+	std::size_t invalid = Binder::npos;
+
+	bind_detail::apply_defaults<Schema>(result, typename Binder::Indices());
+
+	try {
+		file.visit([&](std::string_view key, std::string_view value) {
+			std::size_t i = Binder::find(key);
+
+			if (i == Binder::npos || found[i]) {
+				return true;
+			}
+
+			found[i] = true;
+			found_count++;
+
+			if (!Binder::assigners[i](result, value)) {
+				invalid = i;
+				return false;
+			}
+
+			return found_count < Binder::count;
+		});
+	} catch(...) {
+		throw;
+	}
+
+	if (invalid != Binder::npos) {
+		// only looked up to report the line
+		std::string buffer;
+		unsigned int line = file.try_get_value_for_key(Binder::names[invalid], buffer).line;
+
+		throw ckv::InvalidValue(std::string(Binder::names[invalid]), line, Binder::type_names[invalid]);
+	}
+
+	for (std::size_t i = 0; i < Binder::count; i++) {
+		if (Binder::required[i] && !found[i]) {
+			throw ckv::KeyNotFound(std::string(Binder::names[i]));
+		}
+	}
+
+	return result;
+}
+
+}
+
+#endif /* __CKV_BIND_HPP__ */
@@ -0,0 +1,315 @@
+#include <ckv_compiled.hpp>
+#include <cstring>
+
+/**
+ * Rounds offset up to a multiple of alignment.
+ */
+static std::uint64_t align_up(std::uint64_t offset, std::uint64_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Returns the path of the compiled snapshot for the ckv file file_path.
+ *
+ * "name.ckv" becomes "name.ckvb", any other name gets ".ckvb" appended.
+ *
+ * \param file_path
+ * Path to the ckv file.
+ */
+std::string ckv::compiled_path_for(const std::string &file_path)
+{
+	const std::string ext = ".ckv";
+
+	if (file_path.size() >= ext.size()
+			&& file_path.compare(file_path.size() - ext.size(), ext.size(), ext) == 0) {
+		return file_path + "b";
+	}
+
+	return file_path + ".ckvb";
+}
+
+/**
+ * 64 bit FNV-1a hash of bytes, used for keys and source contents
+ * in .ckvb files.
+ */
+std::uint64_t ckv::hash_bytes(std::string_view bytes)
+{
+	std::uint64_t hash = 14695981039346656037ULL;
+
+	for (unsigned char ch : bytes) {
+		hash ^= ch;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Adds a key and its decoded value.
+ *
+ * Keys must be unique, the caller keeps only the first
+ * occurrence of a key like ConfigFile::import_to_map() does.
+ *
+ * \param key Key to add.
+ * \param value Decoded value of key.
+ * \param line Line of key in the ckv file.
+ */
+void ckv::CompiledFileBuilder::add(std::string_view key, std::string_view value, unsigned int line)
+{
+	CompiledEntry entry;
+
+	entry.hash = ckv::hash_bytes(key);
+	entry.key_offset = strings.size();
+	entry.key_length = key.size();
+	entry.line = line;
+	strings.append(key);
+
+	entry.value_offset = strings.size();
+	entry.value_length = value.size();
+	strings.append(value);
+
+	entries.push_back(entry);
+}
+
+/**
+ * Lays out everything added so far as the contents of a .ckvb file.
+ *
+ * \param source
+ * Identity of the ckv file the entries come from.
+ *
+ * \param source_contents
+ * Contents of that file, hashed for checking freshness.
+ *
+ * \return
+ * Contents of the .ckvb file.
+ */
+std::string ckv::CompiledFileBuilder::finish(const FileIdentity &source, std::string_view source_contents) const
+{
+	CompiledHeader header;
+	std::uint64_t slot_count = 1;
+
+	// at most half full so probes stay short
+	while (slot_count < entries.size() * 2) {
+		slot_count *= 2;
+	}
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "CKVB", 4);
+	header.version = CompiledHeader::current_version;
+	header.byte_order = CompiledHeader::byte_order_mark;
+	header.source_size = source.size;
+	header.source_mtime_ns = source.mtime_ns;
+	header.source_hash = ckv::hash_bytes(source_contents);
+	header.entry_count = entries.size();
+	header.slot_count = slot_count;
+	header.entries_offset = align_up(sizeof(CompiledHeader), alignof(CompiledEntry));
+	header.slots_offset = header.entries_offset + entries.size() * sizeof(CompiledEntry);
+	header.strings_offset = header.slots_offset + slot_count * sizeof(std::uint32_t);
+	header.strings_size = strings.size();
+
+	std::vector<std::uint32_t> slots(slot_count, 0);
+
+	for (std::size_t i = 0; i < entries.size(); i++) {
+		std::uint64_t slot = entries[i].hash & (slot_count - 1);
+
+		while (slots[slot] != 0) {
+			slot = (slot + 1) & (slot_count - 1);
+		}
+		slots[slot] = i + 1;
+	}
+
+	std::string contents(header.strings_offset + strings.size(), '\0');
+
+	std::memcpy(&contents[0], &header, sizeof(header));
+	if (!entries.empty()) {
+		std::memcpy(&contents[header.entries_offset], entries.data(), entries.size() * sizeof(CompiledEntry));
+	}
+	std::memcpy(&contents[header.slots_offset], slots.data(), slot_count * sizeof(std::uint32_t));
+	std::memcpy(&contents[header.strings_offset], strings.data(), strings.size());
+
+	return contents;
+}
+
+/**
+ * Maps the .ckvb file ckvb_path and checks that it is one
+ * this version of the library can read.
+ *
+ * \param ckvb_path
+ * Path to the .ckvb file.
+ *
+ * \return
+ * true if it was opened, false if it doesn't exist or isn't valid.
+ */
+bool ckv::CompiledFile::open(const std::string &ckvb_path)
+{
+	close();
+
+	try {
+		mapping.open(ckvb_path);
+	} catch (...) {
+		return false;
+	}
+
+	std::string_view contents = mapping.view();
+	const CompiledHeader *hdr = reinterpret_cast<const CompiledHeader *>(contents.data());
+	std::uint64_t size = contents.size();
+
+	if (size < sizeof(CompiledHeader)
+			|| std::memcmp(hdr->magic, "CKVB", 4) != 0
+			|| hdr->version != CompiledHeader::current_version
+			|| hdr->byte_order != CompiledHeader::byte_order_mark
+			|| hdr->slot_count == 0
+			|| (hdr->slot_count & (hdr->slot_count - 1)) != 0
+			|| hdr->entry_count >= hdr->slot_count
+			|| hdr->entries_offset % alignof(CompiledEntry) != 0
+			|| hdr->slots_offset % alignof(std::uint32_t) != 0
+			|| hdr->entries_offset > size
+			|| hdr->entry_count > (size - hdr->entries_offset) / sizeof(CompiledEntry)
+			|| hdr->slots_offset > size
+			|| hdr->slot_count > (size - hdr->slots_offset) / sizeof(std::uint32_t)
+			|| hdr->strings_offset > size
+			|| hdr->strings_size > size - hdr->strings_offset) {
+		mapping.close();
+		return false;
+	}
+
+	// resolve the offsets once
+	header = hdr;
+	entries = reinterpret_cast<const CompiledEntry *>(contents.data() + hdr->entries_offset);
+	slots = reinterpret_cast<const std::uint32_t *>(contents.data() + hdr->slots_offset);
+	strings = contents.data() + hdr->strings_offset;
+
+	return true;
+}
+
+/**
+ * Unmaps the snapshot if one is open.
+ */
+void ckv::CompiledFile::close()
+{
+	header = nullptr;
+	entries = nullptr;
+	slots = nullptr;
+	strings = nullptr;
+	mapping.close();
+}
+
+/**
+ * Checks whether the open snapshot was compiled from the current
+ * contents of its ckv file.
+ *
+ * Matching size and mtime are taken as proof enough, otherwise
+ * the contents are hashed, so a file that was only touched or
+ * rewritten with the same contents doesn't need recompiling.
+ *
+ * \param source
+ * Current identity of the ckv file.
+ *
+ * \param source_contents
+ * Current contents of the ckv file.
+ */
+bool ckv::CompiledFile::is_fresh(const FileIdentity &source, std::string_view source_contents) const
+{
+	if (!is_open() || source.size < 0 || header->source_size != static_cast<std::uint64_t>(source.size)) {
+		return false;
+	}
+
+	if (header->source_mtime_ns == source.mtime_ns) {
+		return true;
+	}
+
+	return header->source_hash == ckv::hash_bytes(source_contents);
+}
+
+/**
+ * \returns Number of keys in the snapshot.
+ */
+std::size_t ckv::CompiledFile::size() const
+{
+	return is_open() ? header->entry_count : 0;
+}
+
+/**
+ * Looks key up in the hash table of the snapshot.
+ *
+ * \param key
+ * Key to look up.
+ *
+ * \param value
+ * Set to a view of the value in the snapshot if key is found.
+ *
+ * \param line
+ * If not nullptr, set to the line of key in the ckv file.
+ *
+ * \return
+ * true if key was found.
+ */
+bool ckv::CompiledFile::find(std::string_view key, std::string_view &value, unsigned int *line) const
+{
+	if (!is_open()) {
+		return false;
+	}
+
+	std::uint64_t hash = ckv::hash_bytes(key);
+	std::uint64_t mask = header->slot_count - 1;
+	std::uint64_t slot = hash & mask;
+
+	for (std::uint64_t probes = 0; probes < header->slot_count && slots[slot] != 0;
+			probes++, slot = (slot + 1) & mask) {
+		std::uint64_t i = slots[slot] - 1;
+
+		if (i >= header->entry_count) {
+			return false;
+		}
+
+		const CompiledEntry &entry = entries[i];
+
+		if (entry.hash != hash || entry.key_length != key.size()
+				|| entry.key_offset > header->strings_size
+				|| entry.key_length > header->strings_size - entry.key_offset
+				|| std::memcmp(strings + entry.key_offset, key.data(), key.size()) != 0) {
+			continue;
+		}
+
+		if (entry.value_offset > header->strings_size
+				|| entry.value_length > header->strings_size - entry.value_offset) {
+			return false;
+		}
+
+		value = std::string_view(strings + entry.value_offset, entry.value_length);
+		if (line != nullptr) {
+			*line = entry.line;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Calls visitor for each key and value in the snapshot, in the
+ * order the keys appear in the ckv file.
+ *
+ * \param visitor
+ * Called with each key and its value. Returning false
+ * from it stops the walk.
+ */
+void ckv::CompiledFile::visit(const std::function<bool(std::string_view key, std::string_view value)> &visitor) const
+{
+	for (std::size_t i = 0; i < size(); i++) {
+		const CompiledEntry &entry = entries[i];
+
+		if (entry.key_offset > header->strings_size
+				|| entry.key_length > header->strings_size - entry.key_offset
+				|| entry.value_offset > header->strings_size
+				|| entry.value_length > header->strings_size - entry.value_offset) {
+			break;
+		}
+
+		if (!visitor(std::string_view(strings + entry.key_offset, entry.key_length),
+				std::string_view(strings + entry.value_offset, entry.value_length))) {
+			break;
+		}
+	}
+}
@@ -0,0 +1,109 @@
+#ifndef __CKV_COMPILED_HPP__
+#define __CKV_COMPILED_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ckv_parser.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Header at the start of a .ckvb file.
+ *
+ * All offsets are from the start of the file. Integers are
+ * stored in the byte order of the machine that wrote the file,
+ * byte_order tells if it is the same as ours.
+ */
+struct CompiledHeader {
+	char magic[4];               /**< "CKVB" */
+	std::uint32_t version;       /**< Format version, CompiledHeader::current_version */
+	std::uint32_t byte_order;    /**< CompiledHeader::byte_order_mark as written by its maker */
+	std::uint32_t reserved;      /**< Zero */
+	std::uint64_t source_size;   /**< Size of the ckv file compiled */
+	std::int64_t source_mtime_ns; /**< Modification time of the ckv file compiled */
+	std::uint64_t source_hash;   /**< hash_bytes() of the contents of the ckv file compiled */
+	std::uint64_t entry_count;   /**< Number of CompiledEntry in the entry table */
+	std::uint64_t slot_count;    /**< Number of slots in the hash table, a power of 2 */
+	std::uint64_t entries_offset; /**< Offset of the entry table */
+	std::uint64_t slots_offset;  /**< Offset of the hash table */
+	std::uint64_t strings_offset; /**< Offset of the key and value bytes */
+	std::uint64_t strings_size;  /**< Size of the key and value bytes */
+
+	static constexpr std::uint32_t current_version = 1;
+	static constexpr std::uint32_t byte_order_mark = 0x01020304;
+};
+
+/**
+ * Entry for a key in a .ckvb file.
+ *
+ * Offsets are from the start of the key and value bytes.
+ */
+struct CompiledEntry {
+	std::uint64_t hash;         /**< hash_bytes() of the key */
+	std::uint64_t key_offset;   /**< Offset of the key */
+	std::uint64_t value_offset; /**< Offset of the decoded value */
+	std::uint64_t value_length; /**< Length of the decoded value */
+	std::uint32_t key_length;   /**< Length of the key */
+	std::uint32_t line;         /**< Line of the key in the ckv file */
+};
+
+std::string compiled_path_for(const std::string &file_path);
+std::uint64_t hash_bytes(std::string_view bytes);
+
+/**
+ * Collects keys and values and lays them out as a .ckvb file.
+ */
+class CompiledFileBuilder {
+private:
+	std::vector<CompiledEntry> entries; /**< Entries in the order they were added */
+	std::string strings;                /**< Key and value bytes */
+
+public:
+	void add(std::string_view key, std::string_view value, unsigned int line);
+	std::string finish(const FileIdentity &source, std::string_view source_contents) const;
+};
+
+/**
+ * A compiled snapshot (.ckvb) of a ckv file.
+ *
+ * It holds the decoded values of a ckv file along with a hash table
+ * of its keys, so opening one is a single mmap and looking a key up
+ * needs no text parsing. Snapshots are made by ConfigFile::compile()
+ * or the ckv_compile tool.
+ */
+class CompiledFile {
+private:
+	ckv::MappedFile mapping;                /**< Memory mapping of the .ckvb file */
+	const CompiledHeader *header = nullptr; /**< Header at the start of mapping */
+	const CompiledEntry *entries = nullptr; /**< Entries in the order the keys appear in the source */
+	const std::uint32_t *slots = nullptr;   /**< Hash table, entry index + 1 or 0 if the slot is free */
+	const char *strings = nullptr;          /**< Keys and values referenced by entries */
+
+public:
+	bool open(const std::string &ckvb_path);
+	void close();
+
+	/**
+	 * \returns true if a valid snapshot is open.
+	 */
+	bool is_open() const {
+		return header != nullptr;
+	}
+
+	bool is_fresh(const FileIdentity &source, std::string_view source_contents) const;
+	std::size_t size() const;
+	bool find(std::string_view key, std::string_view &value, unsigned int *line = nullptr) const;
+	void visit(const std::function<bool(std::string_view key, std::string_view value)> &visitor) const;
+};
+
+}
+
+#endif /* __CKV_COMPILED_HPP__ */
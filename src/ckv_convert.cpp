@@ -0,0 +1,298 @@
+#include <ckv_convert.hpp>
+#include <charconv>
+#include <cmath>
+#include <limits>
+
+/**
+ * \returns text without the spaces and tabs around it.
+ */
+static std::string_view trim(std::string_view text)
+{
+	std::size_t start = text.find_first_not_of(" \t");
+
+	if (start == std::string_view::npos) {
+		return std::string_view();
+	}
+
+	return text.substr(start, text.find_last_not_of(" \t") + 1 - start);
+}
+
+/**
+ * \returns true if a and b are the same but for the case of ASCII letters.
+ */
+static bool equal_ignoring_case(std::string_view a, std::string_view b)
+{
+	if (a.size() != b.size()) {
+		return false;
+	}
+
+	for (std::size_t i = 0; i < a.size(); i++) {
+		char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+		char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] - 'A' + 'a' : b[i];
+
+		if (x != y) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Parses a non-negative decimal number, integer or not, at the
+ * start of text and moves text past it.
+ *
+ * \return false if text doesn't start with one.
+ */
+static bool parse_number_prefix(std::string_view &text, double &number)
+{
+	if (text.empty() || text[0] < '0' || text[0] > '9') {
+		return false;
+	}
+
+	auto result = std::from_chars(text.data(), text.data() + text.size(), number, std::chars_format::fixed);
+
+	if (result.ec != std::errc()) {
+		return false;
+	}
+
+	text.remove_prefix(result.ptr - text.data());
+	return true;
+}
+
+/**
+ * Parses an integer, in decimal or in hexadecimal after 0x,
+ * with an optional sign.
+ */
+bool ckv::parse_int(std::string_view text, std::int64_t &value)
+{
+	std::int64_t parsed;
+	bool negative = false;
+	int base = 10;
+
+	text = trim(text);
+
+	if (!text.empty() && (text[0] == '+' || text[0] == '-')) {
+		negative = text[0] == '-';
+		text.remove_prefix(1);
+	}
+
+	if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+		base = 16;
+		text.remove_prefix(2);
+	}
+
+	if (text.empty() || text[0] == '-' || text[0] == '+') {
+		return false;
+	}
+
+	// parsed as unsigned so the lowest value fits too
+	std::uint64_t magnitude;
+	auto result = std::from_chars(text.data(), text.data() + text.size(), magnitude, base);
+
+	if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+		return false;
+	}
+
+	if (negative) {
+		if (magnitude > std::uint64_t(std::numeric_limits<std::int64_t>::max()) + 1) {
+			return false;
+		}
+		parsed = magnitude == 0 ? 0 : -static_cast<std::int64_t>(magnitude - 1) - 1;
+	} else {
+		if (magnitude > std::uint64_t(std::numeric_limits<std::int64_t>::max())) {
+			return false;
+		}
+		parsed = static_cast<std::int64_t>(magnitude);
+	}
+
+	value = parsed;
+	return true;
+}
+
+/**
+ * Parses a floating point number, like 1.5, -2e10, inf or nan.
+ */
+bool ckv::parse_double(std::string_view text, double &value)
+{
+	double parsed;
+
+	text = trim(text);
+
+	// from_chars() doesn't take a plus sign
+	if (!text.empty() && text[0] == '+') {
+		text.remove_prefix(1);
+
+		if (text.empty() || text[0] == '-') {
+			return false;
+		}
+	}
+
+	auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+
+	if (result.ec != std::errc() || result.ptr != text.data() + text.size() || text.empty()) {
+		return false;
+	}
+
+	value = parsed;
+	return true;
+}
+
+/**
+ * Parses true, yes, on and 1 as true and false, no, off
+ * and 0 as false, ignoring case.
+ */
+bool ckv::parse_bool(std::string_view text, bool &value)
+{
+	static const char *true_words[] = {"true", "yes", "on", "1"};
+	static const char *false_words[] = {"false", "no", "off", "0"};
+
+	text = trim(text);
+
+	for (const char *word : true_words) {
+		if (equal_ignoring_case(text, word)) {
+			value = true;
+			return true;
+		}
+	}
+
+	for (const char *word : false_words) {
+		if (equal_ignoring_case(text, word)) {
+			value = false;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Parses a duration made of one or more numbers each followed
+ * by a unit, as in 250ms, 1.5s or 1h30m. The units are ns, us,
+ * ms, s, m (or min), h and d. The result is rounded to the
+ * nearest nanosecond.
+ */
+bool ckv::parse_duration(std::string_view text, std::chrono::nanoseconds &value)
+{
+	struct Unit {
+		std::string_view name;
+		double ns;
+	};
+	// longer names first so that ms isn't read as m
+	static const Unit units[] = {
+		{"min", 60e9}, {"ns", 1}, {"us", 1e3}, {"ms", 1e6},
+		{"s", 1e9}, {"m", 60e9}, {"h", 3600e9}, {"d", 86400e9}
+	};
+	double total = 0;
+
+	text = trim(text);
+
+	if (text.empty()) {
+		return false;
+	}
+
+	while (!text.empty()) {
+		double number;
+		const Unit *unit = nullptr;
+
+		if (!parse_number_prefix(text, number)) {
+			return false;
+		}
+
+		for (auto &candidate : units) {
+			if (text.substr(0, candidate.name.size()) == candidate.name) {
+				unit = &candidate;
+				break;
+			}
+		}
+
+		if (unit == nullptr) {
+			return false;
+		}
+
+		text.remove_prefix(unit->name.size());
+		total += number * unit->ns;
+	}
+
+	if (!(total < 9.2e18)) {
+		return false;
+	}
+
+	value = std::chrono::nanoseconds(std::llround(total));
+	return true;
+}
+
+/**
+ * Parses a size in bytes: a number followed by an optional unit,
+ * as in 4096, 64MiB or 1.5 GB. KB, MB, GB, TB and PB are powers
+ * of 1000, KiB, MiB, GiB, TiB and PiB powers of 1024, and B or
+ * no unit are bytes. K, M, G, T and P are the same as the binary
+ * units. The result is rounded to the nearest byte.
+ */
+bool ckv::parse_size(std::string_view text, std::uint64_t &value)
+{
+	struct Unit {
+		std::string_view name;
+		double bytes;
+	};
+	static const Unit units[] = {
+		{"KiB", 1024.0}, {"MiB", 1024.0 * 1024}, {"GiB", 1024.0 * 1024 * 1024},
+		{"TiB", 1024.0 * 1024 * 1024 * 1024}, {"PiB", 1024.0 * 1024 * 1024 * 1024 * 1024},
+		{"KB", 1e3}, {"MB", 1e6}, {"GB", 1e9}, {"TB", 1e12}, {"PB", 1e15},
+		{"K", 1024.0}, {"M", 1024.0 * 1024}, {"G", 1024.0 * 1024 * 1024},
+		{"T", 1024.0 * 1024 * 1024 * 1024}, {"P", 1024.0 * 1024 * 1024 * 1024 * 1024},
+		{"B", 1}, {"", 1}
+	};
+	double number;
+
+	text = trim(text);
+
+	if (!parse_number_prefix(text, number)) {
+		return false;
+	}
+
+	text = trim(text);
+
+	for (auto &unit : units) {
+		if (text == unit.name) {
+			double bytes = std::round(number * unit.bytes);
+
+			if (!(bytes < 18446744073709551616.0)) {
+				return false;
+			}
+
+			value = static_cast<std::uint64_t>(bytes);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Splits text at each tab. An empty text is an empty list.
+ */
+bool ckv::parse_list(std::string_view text, std::vector<std::string> &value)
+{
+	std::vector<std::string> items;
+
+	while (!text.empty()) {
+		std::size_t tab = text.find('\t');
+
+		items.emplace_back(text.substr(0, tab));
+
+		if (tab == std::string_view::npos) {
+			break;
+		}
+
+		text.remove_prefix(tab + 1);
+
+		if (text.empty()) {
+			// an item after the last tab, even if empty
+			items.emplace_back();
+		}
+	}
+
+	value = std::move(items);
+	return true;
+}
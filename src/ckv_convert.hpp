@@ -0,0 +1,32 @@
+#ifndef __CKV_CONVERT_HPP__
+#define __CKV_CONVERT_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+/// \endcond
+
+namespace ckv {
+
+/*
+ * Conversions of values to other types. Spaces and tabs around
+ * the value are ignored, except by parse_list(). Each one returns
+ * false, leaving value untouched, if text isn't a valid value of
+ * the type. Only parse_list() allocates.
+ */
+
+bool parse_int(std::string_view text, std::int64_t &value);
+bool parse_double(std::string_view text, double &value);
+bool parse_bool(std::string_view text, bool &value);
+bool parse_duration(std::string_view text, std::chrono::nanoseconds &value);
+bool parse_size(std::string_view text, std::uint64_t &value);
+bool parse_list(std::string_view text, std::vector<std::string> &value);
+
+}
+
+#endif /* __CKV_CONVERT_HPP__ */
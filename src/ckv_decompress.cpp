@@ -0,0 +1,332 @@
+#include <ckv_config.hpp>
+#include <ckv_decompress.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#ifdef CKV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CKV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * Tells the compression of a file from its first bytes.
+ *
+ * \param data
+ * Contents of the file, or at least its first four bytes.
+ */
+ckv::Compression ckv::detect_compression(std::string_view data)
+{
+	if (data.size() >= 2 && data[0] == '\x1f' && data[1] == '\x8b') {
+		return Compression::Gzip;
+	}
+
+	if (data.size() >= 4 && std::memcmp(data.data(), "\x28\xb5\x2f\xfd", 4) == 0) {
+		return Compression::Zstd;
+	}
+
+	return Compression::None;
+}
+
+/**
+ * \returns true if the library was built with support for compression.
+ */
+bool ckv::is_compression_supported(Compression compression)
+{
+	switch (compression) {
+	case Compression::None:
+		return true;
+	case Compression::Gzip:
+#ifdef CKV_HAVE_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	case Compression::Zstd:
+#ifdef CKV_HAVE_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	return false;
+}
+
+/**
+ * State of the library doing the decompression.
+ */
+struct ckv::Decompressor::State {
+	Compression compression; /**< Compression of input */
+	std::string_view input;  /**< Compressed bytes not handed to the library yet */
+	bool failed = false;     /**< true if the input is corrupt or can't be decompressed */
+#ifdef CKV_HAVE_ZLIB
+	z_stream zlib = z_stream();
+	bool zlib_ready = false; /**< true once inflateInit2() succeeded */
+#endif
+#ifdef CKV_HAVE_ZSTD
+	ZSTD_DStream *zstd = nullptr;
+#endif
+};
+
+/**
+ * \param compressed
+ * Compressed data. It must outlive the decompressor.
+ *
+ * \param compression
+ * Its compression. Compression::None, or one the library
+ * wasn't built with, makes read() fail.
+ */
+ckv::Decompressor::Decompressor(std::string_view compressed, Compression compression)
+	: state(new State{compression, compressed})
+{
+	switch (compression) {
+	case Compression::Gzip:
+#ifdef CKV_HAVE_ZLIB
+		// 32 has zlib detect the gzip header
+		state->zlib_ready = inflateInit2(&state->zlib, 15 + 32) == Z_OK;
+		state->failed = !state->zlib_ready;
+#else
+		state->failed = true;
+#endif
+		break;
+	case Compression::Zstd:
+#ifdef CKV_HAVE_ZSTD
+		state->zstd = ZSTD_createDStream();
+		state->failed = state->zstd == nullptr || ZSTD_isError(ZSTD_initDStream(state->zstd));
+#else
+		state->failed = true;
+#endif
+		break;
+	case Compression::None:
+		state->failed = true;
+		break;
+	}
+}
+
+ckv::Decompressor::~Decompressor()
+{
+#ifdef CKV_HAVE_ZLIB
+	if (state->zlib_ready) {
+		inflateEnd(&state->zlib);
+	}
+#endif
+#ifdef CKV_HAVE_ZSTD
+	if (state->zstd != nullptr) {
+		ZSTD_freeDStream(state->zstd);
+	}
+#endif
+}
+
+/**
+ * Decompresses up to max_bytes more bytes, appending them to out.
+ * Fewer are appended only once the end of the input is reached.
+ *
+ * Several gzip members or zstd frames one after the other are
+ * decompressed as one, like gzip and zstd do themselves.
+ *
+ * \return
+ * false if the input is corrupt, cut short or of a compression
+ * the library wasn't built with.
+ */
+bool ckv::Decompressor::read(std::string &out, std::size_t max_bytes)
+{
+	std::size_t old_size = out.size();
+	std::size_t produced = 0;
+
+	if (state->failed) {
+		return false;
+	}
+
+	out.resize(old_size + max_bytes);
+
+#ifdef CKV_HAVE_ZLIB
+	if (state->compression == Compression::Gzip) {
+		z_stream &zlib = state->zlib;
+
+		while (produced < max_bytes && !finished) {
+			if (zlib.avail_in == 0) {
+				// avail_in is 32 bits, large files are fed in pieces
+				std::size_t feed = std::min<std::size_t>(state->input.size(), UINT_MAX);
+
+				zlib.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(state->input.data()));
+				zlib.avail_in = static_cast<uInt>(feed);
+				state->input.remove_prefix(feed);
+			}
+
+			std::size_t out_left = std::min<std::size_t>(max_bytes - produced, UINT_MAX);
+
+			zlib.next_out = reinterpret_cast<Bytef *>(&out[old_size + produced]);
+			zlib.avail_out = static_cast<uInt>(out_left);
+
+			int ret = inflate(&zlib, Z_NO_FLUSH);
+
+			produced += out_left - zlib.avail_out;
+
+			if (ret == Z_STREAM_END) {
+				if (zlib.avail_in == 0 && state->input.empty()) {
+					finished = true;
+				} else if (inflateReset(&zlib) != Z_OK) {
+					state->failed = true;
+				}
+			} else if (ret == Z_BUF_ERROR && zlib.avail_in == 0 && state->input.empty()) {
+				// the last member is cut short
+				state->failed = true;
+			} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				state->failed = true;
+			}
+
+			if (state->failed) {
+				break;
+			}
+		}
+	}
+#endif
+
+#ifdef CKV_HAVE_ZSTD
+	if (state->compression == Compression::Zstd) {
+		while (produced < max_bytes && !finished) {
+			ZSTD_inBuffer in = {state->input.data(), state->input.size(), 0};
+			ZSTD_outBuffer out_buffer = {&out[old_size + produced], max_bytes - produced, 0};
+			std::size_t ret = ZSTD_decompressStream(state->zstd, &out_buffer, &in);
+
+			if (ZSTD_isError(ret)) {
+				state->failed = true;
+				break;
+			}
+
+			produced += out_buffer.pos;
+			state->input.remove_prefix(in.pos);
+
+			if (state->input.empty() && out_buffer.pos < out_buffer.size) {
+				// nothing is held back, unless a frame is cut short
+				finished = true;
+				state->failed = ret != 0;
+			}
+		}
+	}
+#endif
+
+	out.resize(old_size + produced);
+	return !state->failed;
+}
+
+/**
+ * \returns Length of the longest prefix of data which ends just
+ * before a key block, 0 if it has none. Only data from offset
+ * onwards is searched.
+ */
+static std::size_t last_block_boundary(std::string_view data, std::size_t offset)
+{
+	std::size_t end = data.size();
+
+	// a boundary is a newline followed by something other than a tab or '+'
+	while (end > offset + 1) {
+		const void *newline = memrchr(data.data() + offset, '\n', end - 1 - offset);
+
+		if (newline == nullptr) {
+			break;
+		}
+
+		std::size_t pos = static_cast<const char *>(newline) - data.data();
+
+		if (data[pos + 1] != '\t' && data[pos + 1] != '+') {
+			return pos + 1;
+		}
+
+		end = pos + 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Decompresses the data and parses it, calling on_key for each key
+ * in the order they appear. Keys and values are views valid only for
+ * the duration of the call. The same errors are found, on the same
+ * lines, as when parsing the decompressed file with BlockParser.
+ *
+ * \param on_key
+ * Called with each key, its raw value block, which is to be passed
+ * to decode_value(), and the line of the key. Returning false from
+ * it stops the parse.
+ *
+ * \return
+ * ErrorCode::None, ErrorCode::DecompressionFailed, or the syntax
+ * error found.
+ */
+ckv::ErrorCode ckv::StreamParser::parse(const std::function<bool(std::string_view key, std::string_view raw_value,
+	unsigned int line)> &on_key)
+{
+	std::string buffer;
+	std::size_t start = 0;    // offset of the bytes left to parse in buffer
+	std::size_t searched = 0; // bytes after start known to have no boundary
+	unsigned int first_line = 1;
+
+	while (true) {
+		if (!decompressor.at_end()) {
+			buffer.erase(0, start);
+			start = 0;
+
+			if (!decompressor.read(buffer, chunk_size)) {
+				line_no = 0;
+				return ckv::ErrorCode::DecompressionFailed;
+			}
+
+			peak_buffer_size = std::max(peak_buffer_size, buffer.size());
+		}
+
+		std::string_view pending(buffer.data() + start, buffer.size() - start);
+		std::size_t cut = decompressor.at_end() ? pending.size() : last_block_boundary(pending, searched);
+
+		if (cut == 0) {
+			// the block goes on past the buffer, the last byte may start a boundary
+			searched = pending.empty() ? 0 : pending.size() - 1;
+
+			if (decompressor.at_end()) {
+				break;
+			}
+			continue;
+		}
+
+		ckv::BlockParser parser(pending.substr(0, cut));
+		std::string_view key;
+
+		while (true) {
+			ckv::ErrorCode error = parser.parse_key(key);
+
+			if (error != ckv::ErrorCode::None) {
+				line_no = first_line + parser.get_line() - 1;
+				error_token = std::string(parser.get_error_token());
+				bytes_parsed += parser.get_offset();
+				return error;
+			}
+
+			if (key.empty()) {
+				break;
+			}
+
+			// parse_key() has already moved past the key's line
+			unsigned int line = first_line + parser.get_line() - 2;
+			std::string_view raw_value = parser.in_block_parse();
+
+			if (!on_key(key, raw_value, line)) {
+				bytes_parsed += parser.get_offset();
+				return ckv::ErrorCode::None;
+			}
+		}
+
+		first_line += parser.get_line() - 1;
+		bytes_parsed += cut;
+		start += cut;
+		searched = cut < pending.size() ? pending.size() - cut - 1 : 0;
+
+		if (decompressor.at_end() && start == buffer.size()) {
+			break;
+		}
+	}
+
+	line_no = first_line;
+	return ckv::ErrorCode::None;
+}
@@ -0,0 +1,124 @@
+#ifndef __CKV_DECOMPRESS_HPP__
+#define __CKV_DECOMPRESS_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <ckv_parser.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Compression of a ckv file, told by its first bytes.
+ */
+enum class Compression {
+	None, /**< Plain ckv file */
+	Gzip, /**< gzip, one or more members */
+	Zstd  /**< Zstandard, one or more frames */
+};
+
+Compression detect_compression(std::string_view data);
+bool is_compression_supported(Compression compression);
+
+/**
+ * Decompresses a buffer a piece at a time.
+ *
+ * Only the decompressor's own window is kept between calls,
+ * so the memory used doesn't depend on the size of the data.
+ */
+class Decompressor {
+private:
+	struct State;
+
+	std::unique_ptr<State> state; /**< State of zlib or zstd */
+	bool finished = false;        /**< true once all the input is decompressed */
+
+public:
+	Decompressor(std::string_view compressed, Compression compression);
+	Decompressor(const Decompressor &) = delete;
+	Decompressor &operator=(const Decompressor &) = delete;
+	~Decompressor();
+
+	bool read(std::string &out, std::size_t max_bytes);
+
+	/**
+	 * \returns true once all of the input has been decompressed.
+	 */
+	bool at_end() const {
+		return finished;
+	}
+};
+
+/**
+ * Parses a compressed ckv file while decompressing it.
+ *
+ * Decompressed data is parsed by a BlockParser as soon as it holds
+ * whole key blocks, then thrown away. The buffer only ever holds
+ * a chunk and the block cut across its end, so it stays about as
+ * large as chunk_size plus the largest key block.
+ */
+class StreamParser {
+private:
+	ckv::Decompressor decompressor;
+	std::size_t chunk_size;           /**< Bytes decompressed at a time */
+	unsigned int line_no = 1;         /**< Line of the error, if any */
+	std::string error_token;          /**< Key or character the error is about */
+	std::size_t bytes_parsed = 0;     /**< Decompressed bytes parsed so far */
+	std::size_t peak_buffer_size = 0; /**< Largest size the buffer grew to */
+
+public:
+	/**
+	 * \param compressed
+	 * Contents of the compressed file. It must outlive the parser.
+	 *
+	 * \param compression
+	 * Compression of compressed, anything but Compression::None.
+	 *
+	 * \param chunk_size
+	 * Bytes to decompress at a time.
+	 */
+	StreamParser(std::string_view compressed, Compression compression, std::size_t chunk_size = 64 * 1024)
+		: decompressor(compressed, compression), chunk_size(chunk_size) {}
+
+	ckv::ErrorCode parse(const std::function<bool(std::string_view key, std::string_view raw_value,
+		unsigned int line)> &on_key);
+
+	/**
+	 * \returns Line of the error parse() returned, 0 if the data
+	 * couldn't be decompressed.
+	 */
+	unsigned int get_line() const {
+		return line_no;
+	}
+
+	/**
+	 * \returns Key or character the error parse() returned is about, if any.
+	 */
+	std::string_view get_error_token() const {
+		return error_token;
+	}
+
+	/**
+	 * \returns Number of decompressed bytes parsed.
+	 */
+	std::size_t get_bytes_parsed() const {
+		return bytes_parsed;
+	}
+
+	/**
+	 * \returns Largest number of decompressed bytes held at once.
+	 */
+	std::size_t get_peak_buffer_size() const {
+		return peak_buffer_size;
+	}
+};
+
+}
+
+#endif /* __CKV_DECOMPRESS_HPP__ */
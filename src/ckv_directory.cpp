@@ -0,0 +1,94 @@
+#include <ckv.hpp>
+#include <ckv_directory.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+/**
+ * Loads every .ckv file in a directory in parallel, along
+ * with the .ckv.gz and .ckv.zst ones.
+ *
+ * Each file is opened and parsed into a Snapshot by a task on pool.
+ * A file that fails to load is reported in LoadedDirectory::errors
+ * with the line of the error and doesn't stop the others from
+ * being loaded.
+ *
+ * \param dir_path
+ * Path to the directory.
+ *
+ * \param recursive
+ * If true, subdirectories are searched too.
+ *
+ * \param pool
+ * Pool to load the files on, the library's own by default.
+ *
+ * \throws FileOpenFailed
+ * If the directory itself can't be read.
+ *
+ * \return
+ * Snapshots of the files loaded and errors for the others.
+ */
+ckv::LoadedDirectory ckv::load_directory(const std::string &dir_path, bool recursive, ThreadPool &pool)
+{
+	std::vector<std::string> paths;
+	std::error_code error;
+	LoadedDirectory loaded;
+
+	auto add_path = [&paths](const std::filesystem::directory_entry &entry) {
+		std::error_code entry_error;
+		std::filesystem::path extension = entry.path().extension();
+
+		// compressed files are read as they are
+		if (extension == ".gz" || extension == ".zst") {
+			extension = entry.path().stem().extension();
+		}
+
+		if (entry.is_regular_file(entry_error) && extension == ".ckv") {
+			paths.push_back(entry.path().string());
+		}
+	};
+
+	if (recursive) {
+		std::filesystem::recursive_directory_iterator it(dir_path, error), end;
+
+		for (; !error && it != end; it.increment(error)) {
+			add_path(*it);
+		}
+	} else {
+		std::filesystem::directory_iterator it(dir_path, error), end;
+
+		for (; !error && it != end; it.increment(error)) {
+			add_path(*it);
+		}
+	}
+
+	if (error) {
+		throw ckv::FileOpenFailed(dir_path);
+	}
+
+	std::sort(paths.begin(), paths.end());
+
+	std::vector<std::shared_ptr<const ckv::Snapshot>> snapshots(paths.size());
+	std::vector<FileError> errors(paths.size());
+
+	// each task writes to its own slots only
+	pool.run(paths.size(), [&](std::size_t i) {
+		ckv::ConfigFile file(paths[i]);
+
+		try {
+			snapshots[i] = file.snapshot();
+		} catch (std::exception &e) {
+			errors[i] = FileError{paths[i], e.what(), file.get_err_line()};
+		}
+	});
+
+	for (std::size_t i = 0; i < paths.size(); i++) {
+		if (snapshots[i] != nullptr) {
+			loaded.files.emplace_hint(loaded.files.end(), paths[i], std::move(snapshots[i]));
+		} else {
+			loaded.errors.push_back(std::move(errors[i]));
+		}
+	}
+
+	return loaded;
+}
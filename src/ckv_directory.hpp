@@ -0,0 +1,54 @@
+#ifndef __CKV_DIRECTORY_HPP__
+#define __CKV_DIRECTORY_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ckv_snapshot.hpp>
+#include <ckv_thread_pool.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * A file load_directory() couldn't load.
+ */
+struct FileError {
+	std::string file_path;     /**< Path of the file */
+	std::string message;       /**< what() of the exception loading it threw */
+	unsigned int err_line = 0; /**< Line of the syntax error, 0 if it isn't one */
+};
+
+/**
+ * Everything load_directory() found in a directory.
+ */
+struct LoadedDirectory {
+	/**
+	 * Snapshot of each file that loaded, by path. Paths are the
+	 * directory path passed to load_directory() followed by the
+	 * path of the file under it.
+	 */
+	std::map<std::string, std::shared_ptr<const Snapshot>> files;
+	std::vector<FileError> errors; /**< Files that didn't load, sorted by path */
+
+	/**
+	 * \returns Snapshot of the file at file_path,
+	 * nullptr if it wasn't loaded.
+	 */
+	std::shared_ptr<const Snapshot> find_file(const std::string &file_path) const {
+		auto it = files.find(file_path);
+
+		return it == files.end() ? nullptr : it->second;
+	}
+};
+
+LoadedDirectory load_directory(const std::string &dir_path, bool recursive = true,
+	ThreadPool &pool = default_thread_pool());
+
+}
+
+#endif /* __CKV_DIRECTORY_HPP__ */
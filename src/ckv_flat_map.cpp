@@ -0,0 +1,217 @@
+#include <ckv.hpp>
+#include <ckv_flat_map.hpp>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+/**
+ * Hash of key used for the table.
+ */
+static std::uint64_t hash_key(std::string_view key)
+{
+	return std::hash<std::string_view>()(key);
+}
+
+/**
+ * Finds the slot for key, which is either the slot
+ * holding it or the free slot it would go to.
+ * The table must have at least one free slot.
+ */
+std::size_t ckv::FlatMap::find_slot(std::string_view key, std::uint64_t hash) const
+{
+	std::size_t mask = slots.size() - 1;
+	std::uint32_t hash_tag = hash >> 32;
+
+	for (std::size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+		const Slot &cur = slots[slot];
+
+		if (cur.entry == 0) {
+			return slot;
+		}
+
+		if (cur.hash_tag != hash_tag) {
+			continue;
+		}
+
+		const Entry &entry = entries[cur.entry - 1];
+
+		if (entry.key_length == key.size()
+				&& std::memcmp(bytes.data() + entry.key_offset, key.data(), key.size()) == 0) {
+			return slot;
+		}
+	}
+}
+
+/**
+ * Resizes the hash table to slot_count slots, a power of 2,
+ * and puts the entries back in it.
+ */
+void ckv::FlatMap::rehash(std::size_t slot_count)
+{
+	slots.assign(slot_count, Slot{0, 0});
+
+	for (std::size_t i = 0; i < entries.size(); i++) {
+		std::size_t slot = entries[i].hash & (slot_count - 1);
+
+		while (slots[slot].entry != 0) {
+			slot = (slot + 1) & (slot_count - 1);
+		}
+
+		slots[slot] = Slot{static_cast<std::uint32_t>(entries[i].hash >> 32), static_cast<std::uint32_t>(i + 1)};
+	}
+}
+
+/**
+ * Adds key with value unless key is already in the map.
+ *
+ * Like std::unordered_map::insert() the first value
+ * inserted for a key is the one kept.
+ *
+ * \throws std::length_error
+ * If key or value is 4 GiB or more, or the map already has
+ * as many entries as it can count.
+ *
+ * \param key Key to add.
+ * \param value Value of key.
+ *
+ * \return
+ * true if key was added, false if it was already there.
+ */
+bool ckv::FlatMap::insert(std::string_view key, std::string_view value)
+{
+	// lengths and entry numbers are kept in 32 bits
+	if (key.size() > UINT32_MAX || value.size() > UINT32_MAX || entries.size() >= UINT32_MAX) {
+		throw std::length_error("ckv::FlatMap: key, value or entry count too large");
+	}
+
+	// stay at most half full
+	if ((entries.size() + 1) * 2 > slots.size()) {
+		rehash(slots.empty() ? 16 : slots.size() * 2);
+	}
+
+	std::uint64_t hash = hash_key(key);
+	std::size_t slot = find_slot(key, hash);
+
+	if (slots[slot].entry != 0) {
+		return false;
+	}
+
+	Entry entry;
+	entry.hash = hash;
+	entry.key_offset = bytes.size();
+	entry.key_length = key.size();
+	bytes.append(key);
+	entry.value_offset = bytes.size();
+	entry.value_length = value.size();
+	bytes.append(value);
+
+	entries.push_back(entry);
+	slots[slot] = Slot{static_cast<std::uint32_t>(hash >> 32), static_cast<std::uint32_t>(entries.size())};
+
+	return true;
+}
+
+/**
+ * \param key Key to look up.
+ *
+ * \return
+ * Iterator to key and its value or end() if key isn't in the map.
+ */
+ckv::FlatMap::const_iterator ckv::FlatMap::find(std::string_view key) const
+{
+	if (entries.empty()) {
+		return end();
+	}
+
+	std::size_t slot = find_slot(key, hash_key(key));
+
+	if (slots[slot].entry == 0) {
+		return end();
+	}
+
+	return const_iterator(this, slots[slot].entry - 1);
+}
+
+/**
+ * \param key Key to look up.
+ *
+ * \throws KeyNotFound
+ *
+ * \return
+ * Value of key.
+ */
+std::string_view ckv::FlatMap::at(std::string_view key) const
+{
+	auto it = find(key);
+
+	if (it == end()) {
+		throw ckv::KeyNotFound(std::string(key));
+	}
+
+	return it->second;
+}
+
+/**
+ * Makes room for count entries having byte_count key
+ * and value bytes in total without reallocating.
+ */
+void ckv::FlatMap::reserve(std::size_t count, std::size_t byte_count)
+{
+	std::size_t slot_count = slots.empty() ? 16 : slots.size();
+
+	entries.reserve(count);
+
+	// reserve() may shrink a std::string before C++20
+	if (byte_count > bytes.capacity()) {
+		bytes.reserve(byte_count);
+	}
+
+	while (count * 2 > slot_count) {
+		slot_count *= 2;
+	}
+
+	if (slot_count != slots.size()) {
+		rehash(slot_count);
+	}
+}
+
+/**
+ * Frees memory reserved but not used by the entries.
+ */
+void ckv::FlatMap::shrink_to_fit()
+{
+	entries.shrink_to_fit();
+	bytes.shrink_to_fit();
+}
+
+/**
+ * Removes all the entries.
+ */
+void ckv::FlatMap::clear()
+{
+	entries.clear();
+	slots.clear();
+	bytes.clear();
+}
+
+/**
+ * \returns Bytes of memory allocated by the map.
+ */
+std::size_t ckv::FlatMap::memory_usage() const
+{
+	return entries.capacity() * sizeof(Entry) + slots.capacity() * sizeof(Slot) + bytes.capacity();
+}
+
+/**
+ * \returns Key and value of the entry inserted index'th.
+ */
+std::pair<std::string_view, std::string_view> ckv::FlatMap::entry_at(std::size_t index) const
+{
+	const Entry &entry = entries[index];
+
+	return {
+		std::string_view(bytes.data() + entry.key_offset, entry.key_length),
+		std::string_view(bytes.data() + entry.value_offset, entry.value_length)
+	};
+}
@@ -0,0 +1,152 @@
+#ifndef __CKV_FLAT_MAP_HPP__
+#define __CKV_FLAT_MAP_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Open addressing hash map from keys to values, both strings.
+ *
+ * Unlike std::unordered_map it makes no allocation per entry: all
+ * key and value bytes are packed in one buffer, entries live in one
+ * array in insertion order and the hash table is a flat array of
+ * slots holding part of each key's hash, so most failed probes
+ * never touch an entry.
+ *
+ * Keys and values are handed out as views which stay valid until
+ * the map is modified or destroyed.
+ */
+class FlatMap {
+private:
+	/**
+	 * A key and its value in bytes.
+	 */
+	struct Entry {
+		std::uint64_t hash;         /**< Hash of the key */
+		std::size_t key_offset;     /**< Offset of the key in bytes */
+		std::size_t value_offset;   /**< Offset of the value in bytes */
+		std::uint32_t key_length;   /**< Length of the key */
+		std::uint32_t value_length; /**< Length of the value */
+	};
+
+	/**
+	 * Slot of the hash table.
+	 */
+	struct Slot {
+		std::uint32_t hash_tag;  /**< High bits of the key's hash */
+		std::uint32_t entry;     /**< Index of the entry + 1, 0 if the slot is free */
+	};
+
+	std::vector<Entry> entries; /**< Entries in insertion order */
+	std::vector<Slot> slots;    /**< Hash table, its size is 0 or a power of 2 */
+	std::string bytes;          /**< Key and value bytes of all entries */
+
+	std::size_t find_slot(std::string_view key, std::uint64_t hash) const;
+	void rehash(std::size_t slot_count);
+
+public:
+	/**
+	 * Iterator over the entries of the map in insertion order.
+	 * Dereferencing it gives a pair of views of the key and value.
+	 */
+	class const_iterator {
+	private:
+		const FlatMap *map = nullptr;
+		std::size_t index = 0;
+		mutable std::pair<std::string_view, std::string_view> pair;
+
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = std::pair<std::string_view, std::string_view>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type *;
+		using reference = const value_type &;
+
+		const_iterator() = default;
+		const_iterator(const FlatMap *map, std::size_t index) : map(map), index(index) {}
+
+		reference operator*() const {
+			pair = map->entry_at(index);
+			return pair;
+		}
+
+		pointer operator->() const {
+			return &**this;
+		}
+
+		const_iterator &operator++() {
+			index++;
+			return *this;
+		}
+
+		const_iterator operator++(int) {
+			const_iterator old = *this;
+			index++;
+			return old;
+		}
+
+		bool operator==(const const_iterator &other) const {
+			return map == other.map && index == other.index;
+		}
+
+		bool operator!=(const const_iterator &other) const {
+			return !(*this == other);
+		}
+	};
+
+	using iterator = const_iterator;
+
+	bool insert(std::string_view key, std::string_view value);
+	const_iterator find(std::string_view key) const;
+	std::string_view at(std::string_view key) const;
+	void reserve(std::size_t count, std::size_t byte_count = 0);
+	void shrink_to_fit();
+	void clear();
+	std::size_t memory_usage() const;
+
+	std::pair<std::string_view, std::string_view> entry_at(std::size_t index) const;
+
+	/**
+	 * \returns 1 if key is in the map, 0 otherwise.
+	 */
+	std::size_t count(std::string_view key) const {
+		return find(key) == end() ? 0 : 1;
+	}
+
+	/**
+	 * \returns Number of entries in the map.
+	 */
+	std::size_t size() const {
+		return entries.size();
+	}
+
+	/**
+	 * \returns true if the map has no entries.
+	 */
+	bool empty() const {
+		return entries.empty();
+	}
+
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, entries.size());
+	}
+};
+
+}
+
+#endif /* __CKV_FLAT_MAP_HPP__ */
@@ -0,0 +1,99 @@
+#include <ckv_journal.hpp>
+#include <charconv>
+
+/**
+ * \returns Path of the journal of the ckv file at file_path.
+ */
+std::string ckv::journal_path_for(const std::string &file_path)
+{
+	return file_path + ".journal";
+}
+
+/**
+ * Appends the record setting key to value to out.
+ */
+void ckv::encode_journal_set(std::string &out, std::string_view key, std::string_view value)
+{
+	out += "S ";
+	out += std::to_string(key.size());
+	out += ' ';
+	out += std::to_string(value.size());
+	out += '\n';
+	out.append(key);
+	out.append(value);
+	out += '\n';
+}
+
+/**
+ * Appends the record removing key to out.
+ */
+void ckv::encode_journal_remove(std::string &out, std::string_view key)
+{
+	out += "R ";
+	out += std::to_string(key.size());
+	out += '\n';
+	out.append(key);
+	out += '\n';
+}
+
+/**
+ * Parses a decimal length at the start of data followed by end,
+ * moving data past both.
+ *
+ * \return false if data doesn't start with one.
+ */
+static bool parse_length(std::string_view &data, char end, std::size_t &length)
+{
+	auto result = std::from_chars(data.data(), data.data() + data.size(), length);
+
+	if (result.ec != std::errc() || result.ptr == data.data() + data.size() || *result.ptr != end) {
+		return false;
+	}
+
+	data.remove_prefix(result.ptr + 1 - data.data());
+	return true;
+}
+
+/**
+ * Calls on_record for each record of data, in order, until the
+ * end of data or the first record that is cut short or corrupt.
+ *
+ * \param on_record
+ * Called with the key of the record and whether it removes the key.
+ * value is the value it is set to, empty for a removal. Both are
+ * views into data.
+ *
+ * \return
+ * Number of bytes of data taken by the records passed to on_record.
+ */
+std::size_t ckv::parse_journal(std::string_view data,
+	const std::function<void(std::string_view key, std::string_view value, bool removed)> &on_record)
+{
+	std::size_t parsed = 0;
+
+	while (data.size() > 2 && data[1] == ' ' && (data[0] == 'S' || data[0] == 'R')) {
+		std::string_view rest = data.substr(2);
+		std::size_t key_length, value_length = 0;
+		bool removed = data[0] == 'R';
+
+		if (!parse_length(rest, removed ? '\n' : ' ', key_length)
+				|| (!removed && !parse_length(rest, '\n', value_length))) {
+			break;
+		}
+
+		// lengths are checked one at a time, corrupt ones could overflow a sum
+		if (key_length >= rest.size() || value_length >= rest.size() - key_length
+				|| rest[key_length + value_length] != '\n') {
+			break;
+		}
+
+		on_record(rest.substr(0, key_length), rest.substr(key_length, value_length), removed);
+
+		std::size_t length = data.size() - rest.size() + key_length + value_length + 1;
+
+		parsed += length;
+		data.remove_prefix(length);
+	}
+
+	return parsed;
+}
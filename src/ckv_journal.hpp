@@ -0,0 +1,36 @@
+#ifndef __CKV_JOURNAL_HPP__
+#define __CKV_JOURNAL_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+/// \endcond
+
+namespace ckv {
+
+/*
+ * Records of the journal kept next to a ckv file in WriteMode::Journal.
+ *
+ * A record sets a key to a value or removes it:
+ *
+ *     S <key length> <value length>\n<key><value>\n
+ *     R <key length>\n<key>\n
+ *
+ * Lengths are in decimal. Records only ever get appended, so
+ * the last one may be cut short by a crash. It is then ignored,
+ * until the next writer cuts it off before appending its own.
+ */
+
+std::string journal_path_for(const std::string &file_path);
+void encode_journal_set(std::string &out, std::string_view key, std::string_view value);
+void encode_journal_remove(std::string &out, std::string_view key);
+std::size_t parse_journal(std::string_view data,
+	const std::function<void(std::string_view key, std::string_view value, bool removed)> &on_record);
+
+}
+
+#endif /* __CKV_JOURNAL_HPP__ */
@@ -0,0 +1,174 @@
+#include <ckv_layered.hpp>
+
+/**
+ * \param file_paths
+ * Files of the layers, from the bottom one up.
+ * Each has to exist.
+ */
+ckv::LayeredConfig::LayeredConfig(const std::vector<std::string> &file_paths)
+{
+	for (auto &file_path : file_paths) {
+		add_layer(file_path);
+	}
+}
+
+/**
+ * Adds a layer on top of the others. Nothing is read until
+ * the first lookup.
+ *
+ * \param file_path
+ * File of the layer.
+ *
+ * \param optional
+ * If true, the layer is taken as empty for as long as its file
+ * doesn't exist, as for local overrides. Otherwise lookups
+ * reaching the layer fail with FileOpenFailed.
+ */
+void ckv::LayeredConfig::add_layer(const std::string &file_path, bool optional)
+{
+	layers.emplace_back(new Layer(file_path, optional));
+}
+
+/**
+ * Looks key up in each layer from the top one down and
+ * returns its value in the first layer that has it. Errors
+ * are returned instead of thrown, as by
+ * ConfigFile::try_get_value_for_key().
+ *
+ * Layers above the one the key is found in are only looked up
+ * in, their files are parsed no further than their key indexes
+ * need.
+ *
+ * \param key
+ *  Key whose value should be returned.
+ *
+ * \return
+ *  The value of key with the layer, file and line it comes from,
+ *  or the error with the layer it was found in. The error is
+ *  ErrorCode::KeyNotFound if no layer has the key.
+ */
+ckv::LayeredLookupResult ckv::LayeredConfig::try_get_value_for_key(std::string_view key)
+{
+	ckv::LayeredLookupResult result;
+
+	result.error = ckv::ErrorCode::KeyNotFound;
+
+	for (std::size_t i = layers.size(); i-- > 0;) {
+		Layer &layer = *layers[i];
+		ckv::LookupResult found = layer.file.try_get_value_for_key(key, layer.buffer);
+
+		if (found.error == ckv::ErrorCode::KeyNotFound
+				|| (found.error == ckv::ErrorCode::FileOpenFailed && layer.optional)) {
+			continue;
+		}
+
+		result.value = found.value;
+		result.error = found.error;
+		result.line = found.line;
+		result.layer = i;
+		result.file_path = layer.file_path;
+		break;
+	}
+
+	return result;
+}
+
+/**
+ * Same as try_get_value_for_key() but the value is copied
+ * and errors are thrown.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws KeyNotFound
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \param key
+ *  Key whose value should be returned.
+ *
+ * \return
+ *  Value of key in the topmost layer that has it.
+ */
+std::string ckv::LayeredConfig::get_value_for_key(const std::string &key)
+{
+	ckv::LayeredLookupResult result = try_get_value_for_key(key);
+
+	if (result.error == ckv::ErrorCode::KeyNotFound) {
+		ckv::throw_error(result.error, key);
+	}
+
+	if (result.error != ckv::ErrorCode::None) {
+		// the layer's own lookup builds the exception for its error
+		layers[result.layer]->file.get_value_for_key(key);
+	}
+
+	return std::string(result.value);
+}
+
+/**
+ * Tells which layer, file and line the value of key comes from.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws KeyNotFound
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+ckv::Provenance ckv::LayeredConfig::get_provenance(const std::string &key)
+{
+	ckv::LayeredLookupResult result = try_get_value_for_key(key);
+
+	if (result.error == ckv::ErrorCode::KeyNotFound) {
+		ckv::throw_error(result.error, key);
+	}
+
+	if (result.error != ckv::ErrorCode::None) {
+		layers[result.layer]->file.get_value_for_key(key);
+	}
+
+	return ckv::Provenance{std::string(result.file_path), result.line, result.layer};
+}
+
+/**
+ * Merges all the layers into one map, each key with its
+ * value in the topmost layer that has it.
+ *
+ * \throws DecompressionFailed
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+std::unordered_map<std::string, std::string> ckv::LayeredConfig::import_to_map()
+{
+	std::unordered_map<std::string, std::string> merged;
+
+	for (std::size_t i = layers.size(); i-- > 0;) {
+		Layer &layer = *layers[i];
+
+		try {
+			// from the top down, so the first value of a key is kept
+			layer.file.visit([&merged](std::string_view key, std::string_view value) {
+				merged.emplace(key, value);
+				return true;
+			});
+		} catch (ckv::FileOpenFailed &) {
+			if (!layer.optional) {
+				throw;
+			}
+		}
+	}
+
+	return merged;
+}
@@ -0,0 +1,107 @@
+#ifndef __CKV_LAYERED_HPP__
+#define __CKV_LAYERED_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <ckv.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Result of LayeredConfig::try_get_value_for_key().
+ */
+struct LayeredLookupResult {
+	/**
+	 * Value of the key in the topmost layer that has it. It is
+	 * a view into that layer's ConfigFile, valid for as long as
+	 * LookupResult::value would be.
+	 */
+	std::string_view value;
+	ckv::ErrorCode error = ckv::ErrorCode::None; /**< What went wrong, ErrorCode::None if the key was found */
+	unsigned int line = 0;       /**< Line of the key, or of the syntax error, in file_path */
+	std::size_t layer = 0;       /**< Index of the layer the key or the error is in, 0 being the bottom one */
+	std::string_view file_path;  /**< File of that layer, a view valid as long as the LayeredConfig */
+
+	/**
+	 * \returns true if the key was found.
+	 */
+	explicit operator bool() const {
+		return error == ckv::ErrorCode::None;
+	}
+};
+
+/**
+ * Where the value of a key came from.
+ */
+struct Provenance {
+	std::string file_path; /**< File of the layer the value was found in */
+	unsigned int line = 0; /**< Line of the key in that file */
+	std::size_t layer = 0; /**< Index of the layer, 0 being the bottom one */
+};
+
+/**
+ * Stack of ckv files, each overriding the keys of those under it,
+ * as in defaults.ckv, region.ckv, host.ckv and local-overrides.ckv.
+ *
+ * Each layer is a ConfigFile, so a lookup goes down the layers'
+ * key indexes from the top one and returns a view into the first
+ * layer that has the key, with nothing merged or copied. A layer
+ * whose file changes is indexed again on its next lookup while the
+ * others keep their indexes.
+ *
+ * Like ConfigFile, an object must not be used by several threads at once.
+ */
+class LayeredConfig {
+private:
+	/**
+	 * A file of the stack.
+	 */
+	struct Layer {
+		std::string file_path;   /**< Path of the file */
+		ckv::ConfigFile file;    /**< Parsed file */
+		bool optional;           /**< true if a missing file counts as an empty layer */
+		std::string buffer;      /**< Holds values of a compressed file */
+
+		Layer(const std::string &file_path, bool optional)
+			: file_path(file_path), file(file_path), optional(optional) {}
+	};
+
+	std::vector<std::unique_ptr<Layer>> layers; /**< Layers from the bottom one up */
+
+public:
+	LayeredConfig() = default;
+	LayeredConfig(const std::vector<std::string> &file_paths);
+
+	void add_layer(const std::string &file_path, bool optional = false);
+
+	/**
+	 * \returns Number of layers.
+	 */
+	std::size_t layer_count() const {
+		return layers.size();
+	}
+
+	/**
+	 * \returns ConfigFile of the layer at index, 0 being the bottom one.
+	 */
+	ckv::ConfigFile &get_layer(std::size_t index) {
+		return layers.at(index)->file;
+	}
+
+	ckv::LayeredLookupResult try_get_value_for_key(std::string_view key);
+	std::string get_value_for_key(const std::string &key);
+	ckv::Provenance get_provenance(const std::string &key);
+	std::unordered_map<std::string, std::string> import_to_map();
+};
+
+}
+
+#endif /* __CKV_LAYERED_HPP__ */
@@ -0,0 +1,84 @@
+#include <ckv_ordered_index.hpp>
+#include <algorithm>
+
+/**
+ * \param keys
+ * Keys to index, in any order. Duplicates are kept once.
+ */
+ckv::OrderedIndex::OrderedIndex(std::vector<std::string_view> keys) : keys(std::move(keys))
+{
+	std::sort(this->keys.begin(), this->keys.end());
+	this->keys.erase(std::unique(this->keys.begin(), this->keys.end()), this->keys.end());
+	this->keys.shrink_to_fit();
+}
+
+/**
+ * \returns Keys starting with prefix, all the keys if it is empty.
+ * O(log n) to find them.
+ */
+ckv::OrderedIndex::Range ckv::OrderedIndex::with_prefix(std::string_view prefix) const
+{
+	auto first = std::lower_bound(keys.begin(), keys.end(), prefix);
+
+	// keys cut to the length of prefix are sorted too
+	auto last = std::upper_bound(first, keys.end(), prefix, [](std::string_view prefix, std::string_view key) {
+		return prefix < key.substr(0, prefix.size());
+	});
+
+	return Range{first, last};
+}
+
+/**
+ * \returns Keys from first included to last excluded.
+ * O(log n) to find them.
+ */
+ckv::OrderedIndex::Range ckv::OrderedIndex::between(std::string_view first, std::string_view last) const
+{
+	auto from = std::lower_bound(keys.begin(), keys.end(), first);
+	auto to = last <= first ? from : std::lower_bound(from, keys.end(), last);
+
+	return Range{from, to};
+}
+
+/**
+ * Finds the longest key that text starts with, as in routing
+ * text to the most specific key configured for it.
+ *
+ * The key before text in order shares the longest possible prefix
+ * with it. If it isn't a prefix of text, no key longer than their
+ * common part can be, so the search starts over from that part.
+ * Each round is a binary search on a shorter text.
+ *
+ * \param key
+ * Set to the key found, a view of the indexed key.
+ *
+ * \return
+ * false if no key is a prefix of text.
+ */
+bool ckv::OrderedIndex::longest_prefix_of(std::string_view text, std::string_view &key) const
+{
+	auto end = keys.end();
+
+	while (true) {
+		end = std::upper_bound(keys.begin(), end, text);
+
+		if (end == keys.begin()) {
+			return false;
+		}
+
+		std::string_view before = *(end - 1);
+
+		if (before.size() <= text.size() && text.compare(0, before.size(), before) == 0) {
+			key = before;
+			return true;
+		}
+
+		std::size_t common = 0;
+
+		while (common < before.size() && common < text.size() && before[common] == text[common]) {
+			common++;
+		}
+
+		text = text.substr(0, common);
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef __CKV_ORDERED_INDEX_HPP__
+#define __CKV_ORDERED_INDEX_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Keys in lexicographic order, as a sorted array of views.
+ *
+ * Finding the keys under a prefix or in a range is a binary
+ * search for each end, the keys in between are then walked
+ * without looking at any other. The keys themselves aren't
+ * copied, whatever they view must outlive the index.
+ */
+class OrderedIndex {
+private:
+	std::vector<std::string_view> keys; /**< Sorted keys, each one once */
+
+public:
+	using const_iterator = std::vector<std::string_view>::const_iterator;
+
+	/**
+	 * A run of keys of the index, in lexicographic order.
+	 */
+	struct Range {
+		const_iterator first; /**< First key of the run */
+		const_iterator last;  /**< One past the last key of the run */
+
+		const_iterator begin() const {
+			return first;
+		}
+
+		const_iterator end() const {
+			return last;
+		}
+
+		/**
+		 * \returns Number of keys in the run.
+		 */
+		std::size_t size() const {
+			return last - first;
+		}
+
+		/**
+		 * \returns true if the run has no keys.
+		 */
+		bool empty() const {
+			return first == last;
+		}
+	};
+
+	OrderedIndex() = default;
+	explicit OrderedIndex(std::vector<std::string_view> keys);
+
+	Range with_prefix(std::string_view prefix) const;
+	Range between(std::string_view first, std::string_view last) const;
+	bool longest_prefix_of(std::string_view text, std::string_view &key) const;
+
+	/**
+	 * \returns Number of keys in the index.
+	 */
+	std::size_t size() const {
+		return keys.size();
+	}
+
+	const_iterator begin() const {
+		return keys.begin();
+	}
+
+	const_iterator end() const {
+		return keys.end();
+	}
+
+	/**
+	 * Empties the index.
+	 */
+	void clear() {
+		keys.clear();
+	}
+};
+
+}
+
+#endif /* __CKV_ORDERED_INDEX_HPP__ */
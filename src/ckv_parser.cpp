@@ -0,0 +1,470 @@
+#include <ckv.hpp>
+#include <ckv_parser.hpp>
+#include <ckv_scan.hpp>
+#include <cctype>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool tab_or_space(char ch)
+{
+	return (ch == '\t' || ch == ' ');
+}
+
+/**
+ * Returns true if the character used in the key is
+ * invalid.
+ *
+ * \param ch Character to check.
+ * \return true if character is valid and false if not.
+ */
+bool is_char_invalid(unsigned char ch)
+{
+	return (!std::isalnum(ch) && ch != '_' && ch != '-');
+}
+
+/**
+ * Throws the exception for error.
+ *
+ * \param error
+ * Error to throw, anything but ErrorCode::None.
+ *
+ * \param token
+ * What the error is about: the file path for FileOpenFailed and DecompressionFailed,
+ * the key for KeyNotFound and NoValueFoundForKey and the
+ * character for InvalidCharacter. Ignored for the others.
+ */
+void ckv::throw_error(ErrorCode error, std::string_view token)
+{
+	switch (error) {
+	case ErrorCode::FileOpenFailed:
+		throw ckv::FileOpenFailed(std::string(token));
+	case ErrorCode::DecompressionFailed:
+		throw ckv::DecompressionFailed(std::string(token));
+	case ErrorCode::KeyNotFound:
+		throw ckv::KeyNotFound(std::string(token));
+	case ErrorCode::EqualToWithoutAKey:
+		throw ckv::EqualToWithoutAKey();
+	case ErrorCode::InvalidCharacter:
+		throw ckv::InvalidCharacter(token.empty() ? '\0' : token[0]);
+	case ErrorCode::MissingEqualTo:
+		throw ckv::MissingEqualTo();
+	case ErrorCode::NoValueFoundForKey:
+		throw ckv::NoValueFoundForKey(std::string(token));
+	case ErrorCode::TrailingCharsAfterEqualTo:
+		throw ckv::TrailingCharsAfterEqualTo();
+	case ErrorCode::ValueWithoutAKey:
+		throw ckv::ValueWithoutAKey();
+	case ErrorCode::None:
+		break;
+	}
+
+	throw std::invalid_argument("ckv::throw_error() called without an error");
+}
+
+/**
+ * Fills identity from a struct stat.
+ */
+static void identity_from_stat(const struct stat &st, ckv::FileIdentity &identity)
+{
+	identity.device = st.st_dev;
+	identity.inode = st.st_ino;
+	identity.size = st.st_size;
+	identity.mtime_ns = static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+/**
+ * Reads the identity of file_path from the filesystem.
+ *
+ * \param file_path
+ * Path to the file.
+ *
+ * \param identity
+ * Filled with the identity of the file on success.
+ *
+ * \return
+ * true on success and false if the file can't be stat'ed.
+ */
+bool ckv::get_file_identity(const std::string &file_path, FileIdentity &identity)
+{
+	struct stat st;
+
+	if (stat(file_path.c_str(), &st) != 0) {
+		return false;
+	}
+
+	identity_from_stat(st, identity);
+	return true;
+}
+
+ckv::MappedFile::MappedFile(MappedFile &&other) noexcept
+	: map_data(other.map_data), map_size(other.map_size), mapped(other.mapped), identity(other.identity)
+{
+	other.map_data = nullptr;
+	other.map_size = 0;
+	other.mapped = false;
+}
+
+ckv::MappedFile &ckv::MappedFile::operator=(MappedFile &&other) noexcept
+{
+	if (this != &other) {
+		close();
+		map_data = other.map_data;
+		map_size = other.map_size;
+		mapped = other.mapped;
+		identity = other.identity;
+		other.map_data = nullptr;
+		other.map_size = 0;
+		other.mapped = false;
+	}
+	return *this;
+}
+
+ckv::MappedFile::~MappedFile()
+{
+	close();
+}
+
+/**
+ * Maps file_path in memory, replacing any previous mapping.
+ *
+ * An empty file is "mapped" to an empty view since mmap()
+ * refuses zero length mappings.
+ *
+ * \param file_path
+ * Path to the file.
+ *
+ * \return
+ * true on success and false if the file can't be opened or mapped.
+ */
+bool ckv::MappedFile::try_open(const std::string &file_path)
+{
+	struct stat st;
+	int fd;
+
+	close();
+
+	fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		::close(fd);
+		return false;
+	}
+
+	if (st.st_size > 0) {
+		void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (addr == MAP_FAILED) {
+			::close(fd);
+			return false;
+		}
+
+		// files are parsed front to back
+		madvise(addr, st.st_size, MADV_SEQUENTIAL);
+
+		map_data = static_cast<const char *>(addr);
+		map_size = st.st_size;
+	}
+
+	identity_from_stat(st, identity);
+
+	// the mapping keeps the file referenced, fd isn't needed anymore
+	::close(fd);
+	mapped = true;
+	return true;
+}
+
+/**
+ * Same as try_open() but throws on failure.
+ *
+ * \throws FileOpenFailed
+ */
+void ckv::MappedFile::open(const std::string &file_path)
+{
+	if (!try_open(file_path)) {
+		throw ckv::FileOpenFailed(file_path);
+	}
+}
+
+/**
+ * Unmaps the file if one is mapped.
+ */
+void ckv::MappedFile::close()
+{
+	if (map_data != nullptr) {
+		munmap(const_cast<char *>(map_data), map_size);
+	}
+
+	map_data = nullptr;
+	map_size = 0;
+	mapped = false;
+	identity = FileIdentity();
+}
+
+/**
+ * Parses untabbed lines.
+ *
+ * This parses the untabbed values and finds the key name.
+ * Further in_block_parse() should be called to go
+ * through the value of key.
+ * This function checks the correctness of the buffer
+ * only until the point it parses and reports errors
+ * accordingly, without throwing or allocating.
+ *
+ * \param key
+ *  Set to a view of the next key found.
+ *  If the key is empty, means there is
+ *  no data further in buffer and in_block_parse()
+ *  should NOT be called in such a case.
+ *
+ * \return
+ *  ErrorCode::None, or the error found. get_line() is then the
+ *  line of the error and get_error_token() the key or character
+ *  it is about.
+ */
+ckv::ErrorCode ckv::BlockParser::parse_key(std::string_view &key)
+{
+	bool next_is_value_start = false;
+	bool next_is_equal_to = false;
+	const char *key_start = nullptr;
+	std::size_t key_len = 0;
+
+	key = std::string_view();
+	error_token = std::string_view();
+
+	while (cur != end) {
+		unsigned char ch = *cur++;
+
+		if (ch == '\n') {
+
+			if (next_is_value_start) {
+				if (cur == end || *cur != '\t') {
+					error_token = std::string_view(key_start, key_len);
+					return ErrorCode::NoValueFoundForKey;
+				}
+				line_no++;
+				key = std::string_view(key_start, key_len);
+				return ErrorCode::None;
+			} else if (key_len != 0) {
+				return ErrorCode::MissingEqualTo;
+			}
+
+			line_no++;
+		} else if (ch == '=') {
+			next_is_equal_to = false;
+			next_is_value_start = true;
+
+			if (key_len == 0) {
+				return ErrorCode::EqualToWithoutAKey;
+			}
+		} else if (next_is_equal_to && !std::isspace(ch)) {
+			return ErrorCode::MissingEqualTo;
+		} else if (next_is_value_start && !tab_or_space(ch)) {
+			// this occurs after =
+			return ErrorCode::TrailingCharsAfterEqualTo;
+		} else if (key_len != 0 && std::isspace(ch) && !next_is_value_start) {
+			// This cond is if whitespace is used after the key,
+			// the key has to stay contiguous to be handed out as a view
+			next_is_equal_to = true;
+		} else if (std::isspace(ch)) {
+			continue;
+		} else if (is_char_invalid(ch)) {
+			// chars except 0-9, A-Z, a-z, _ and - are invalid.
+			error_token = std::string_view(cur - 1, 1);
+			return ErrorCode::InvalidCharacter;
+		} else {
+			// this is key's char, add it.
+			if (key_len == 0) {
+				key_start = cur - 1;
+			}
+			key_len++;
+		}
+	}
+
+	if (next_is_value_start) {
+		error_token = std::string_view(key_start, key_len);
+		return ErrorCode::NoValueFoundForKey;
+	} else if (next_is_equal_to || key_len != 0) {
+		return ErrorCode::MissingEqualTo;
+	}
+
+	return ErrorCode::None;
+}
+
+/**
+ * Same as parse_key() but throws the error found.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \return
+ *  It returns a view of the next key found, empty
+ *  if there is no data further in buffer.
+ */
+std::string_view ckv::BlockParser::out_block_parse()
+{
+	std::string_view key;
+	ckv::ErrorCode error = parse_key(key);
+
+	if (error != ErrorCode::None) {
+		ckv::throw_error(error, error_token);
+	}
+
+	return key;
+}
+
+/**
+ * Parses tabbed lines or lines followed by '+'.
+ *
+ * This goes over the tabbed values for a key without decoding them.
+ * Should strictly be called after out_block_parse() iff
+ * key returned from it isn't empty.
+ * It goes till the end of buffer or the line not starting with tab or '+'.
+ *
+ * \return
+ *  returns a view of the raw value block, starting with its
+ *  leading tab and without the terminating newline.
+ *  Pass it to decode_value() to get the value of key.
+ */
+std::string_view ckv::BlockParser::in_block_parse()
+{
+	const char *value_start = cur;
+
+	while (cur != end) {
+		// whole runs between newlines are skipped at once
+		cur = ckv::find_newline(cur, end);
+
+		if (cur == end) {
+			break;
+		}
+
+		cur++;
+		line_no++;
+
+		if (cur == end || (*cur != '\t' && *cur != '+')) {
+			return std::string_view(value_start, cur - 1 - value_start);
+		}
+	}
+
+	return std::string_view(value_start, cur - value_start);
+}
+
+/**
+ * Decodes a raw value block returned by BlockParser::in_block_parse().
+ *
+ * Leading tabs are stripped and lines starting with '+' are joined to
+ * the previous line. A single line value needs neither, so a view into
+ * raw_value itself is returned and buffer is left untouched.
+ *
+ * \param raw_value
+ * Raw value block.
+ *
+ * \param buffer
+ * Storage for the decoded value, used only if decoding is needed.
+ *
+ * \return
+ * View of the decoded value, either into raw_value or into buffer.
+ */
+std::string_view ckv::decode_value(std::string_view raw_value, std::string &buffer)
+{
+	if (raw_value.empty()) {
+		return raw_value;
+	}
+
+	// drop the tab that starts the value block
+	raw_value.remove_prefix(1);
+
+	const char *cur = raw_value.data();
+	const char *end = cur + raw_value.size();
+	const char *newline = ckv::find_newline(cur, end);
+
+	if (newline == end) {
+		return raw_value;
+	}
+
+	buffer.clear();
+	buffer.reserve(raw_value.size());
+
+	while (true) {
+		// copy the run up to the newline in one go
+		buffer.append(cur, newline);
+
+		if (newline == end) {
+			break;
+		}
+
+		// in_block_parse() guarantees a '\t' or '+' after it
+		if (newline[1] == '\t') {
+			buffer += '\n';
+		}
+
+		cur = newline + 2;
+		newline = ckv::find_newline(cur, end);
+	}
+
+	return buffer;
+}
+
+/**
+ * Cuts buffer into about chunk_count chunks of about the same size
+ * which can be parsed by separate BlockParsers.
+ *
+ * A chunk ends just after a newline followed by a character other
+ * than a tab or '+'. in_block_parse() stops at such a newline and
+ * out_block_parse() starts over after it, so parsing the chunks one
+ * after the other finds the same keys, values and errors as parsing
+ * buffer in one go. Only line numbers start over at each chunk.
+ *
+ * \param buffer
+ * Contents of a ckv file.
+ *
+ * \param chunk_count
+ * Number of chunks wanted. Fewer are returned if buffer
+ * doesn't have enough places to cut it at.
+ *
+ * \return
+ * Views into buffer, covering it from start to end.
+ */
+std::vector<std::string_view> ckv::split_at_keys(std::string_view buffer, std::size_t chunk_count)
+{
+	std::vector<std::string_view> chunks;
+	const char *begin = buffer.data();
+	const char *end = begin + buffer.size();
+	const char *chunk_start = begin;
+
+	for (std::size_t i = 1; i < chunk_count && chunk_start != end; i++) {
+		const char *cur = begin + buffer.size() / chunk_count * i;
+
+		if (cur < chunk_start) {
+			cur = chunk_start;
+		}
+
+		while (true) {
+			cur = ckv::find_newline(cur, end);
+
+			if (cur == end || (++cur != end && *cur != '\t' && *cur != '+')) {
+				break;
+			}
+		}
+
+		if (cur == end) {
+			break;
+		}
+
+		chunks.emplace_back(chunk_start, cur - chunk_start);
+		chunk_start = cur;
+	}
+
+	chunks.emplace_back(chunk_start, end - chunk_start);
+
+	return chunks;
+}
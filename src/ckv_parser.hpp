@@ -0,0 +1,170 @@
+#ifndef __CKV_PARSER_HPP__
+#define __CKV_PARSER_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * What went wrong in a call that reports errors instead of
+ * throwing them. Each error other than None has an exception
+ * of the same name which the throwing calls use.
+ */
+enum class ErrorCode {
+	None,                      /**< No error */
+	FileOpenFailed,            /**< The file couldn't be opened or mapped */
+	DecompressionFailed,       /**< The file is compressed and couldn't be decompressed */
+	KeyNotFound,               /**< The file doesn't have the key */
+	EqualToWithoutAKey,        /**< '=' without a key before it */
+	InvalidCharacter,          /**< Character not allowed in a key */
+	MissingEqualTo,            /**< Key not followed by '=' */
+	NoValueFoundForKey,        /**< Key without a value */
+	TrailingCharsAfterEqualTo, /**< Characters after '=' on the key's line */
+	ValueWithoutAKey           /**< Value without a key before it */
+};
+
+[[noreturn]] void throw_error(ErrorCode error, std::string_view token);
+
+/**
+ * Identifies a particular version of a file on disk.
+ *
+ * Two identities compare equal if the file wasn't replaced, resized or
+ * modified in between, as far as the filesystem timestamps can tell.
+ */
+struct FileIdentity {
+	unsigned long long device = 0; /**< Device the file lives on */
+	unsigned long long inode = 0;  /**< Inode number of the file */
+	long long size = -1;           /**< Size of the file in bytes, -1 if unknown */
+	long long mtime_ns = 0;        /**< Modification time in nanoseconds since epoch */
+
+	bool operator==(const FileIdentity &other) const {
+		return device == other.device && inode == other.inode
+			&& size == other.size && mtime_ns == other.mtime_ns;
+	}
+
+	bool operator!=(const FileIdentity &other) const {
+		return !(*this == other);
+	}
+};
+
+bool get_file_identity(const std::string &file_path, FileIdentity &identity);
+
+/**
+ * Read only memory mapping of a whole file.
+ *
+ * The mapping stays valid until close() is called or the object
+ * is destroyed, so views handed out from it must not outlive it.
+ */
+class MappedFile {
+private:
+	const char *map_data = nullptr; /**< Start of the mapping, nullptr for an empty file */
+	std::size_t map_size = 0;       /**< Size of the mapped file in bytes */
+	bool mapped = false;            /**< true if open() succeeded and close() wasn't called since */
+	FileIdentity identity;          /**< Identity of the file at the time it was mapped */
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+	~MappedFile();
+
+	bool try_open(const std::string &file_path);
+	void open(const std::string &file_path);
+	void close();
+
+	/**
+	 * \returns true if a file is currently mapped.
+	 */
+	bool is_open() const {
+		return mapped;
+	}
+
+	/**
+	 * \returns Identity of the mapped file as it was when open() mapped it.
+	 */
+	const FileIdentity &get_identity() const {
+		return identity;
+	}
+
+	/**
+	 * \returns Contents of the mapped file.
+	 */
+	std::string_view view() const {
+		return std::string_view(map_data, map_size);
+	}
+};
+
+/**
+ * Parser walking a ckv file held in a contiguous buffer.
+ *
+ * It works the same way the stream parser of ConfigFile used to,
+ * but keys and values are handed out as views into the buffer
+ * instead of being copied one character at a time.
+ */
+class BlockParser {
+private:
+	const char *begin;        /**< Start of the buffer being parsed */
+	const char *cur;          /**< Current read position */
+	const char *end;          /**< One past the last byte of the buffer */
+	unsigned int line_no = 1; /**< Line number of the current read position */
+	std::string_view error_token; /**< Key or character the last error is about */
+
+public:
+	/**
+	 * \param buffer
+	 * Contents of a ckv file. It must outlive the parser
+	 * and every view returned from it.
+	 */
+	BlockParser(std::string_view buffer = std::string_view())
+		: begin(buffer.data()), cur(buffer.data()), end(buffer.data() + buffer.size()) {}
+
+	ErrorCode parse_key(std::string_view &key);
+	std::string_view out_block_parse();
+	std::string_view in_block_parse();
+
+	/**
+	 * \returns Key or character the error last returned by
+	 * parse_key() is about, if any. It is a view into the buffer.
+	 */
+	std::string_view get_error_token() const {
+		return error_token;
+	}
+
+	/**
+	 * \returns true if there is nothing left to parse.
+	 */
+	bool at_end() const {
+		return cur == end;
+	}
+
+	/**
+	 * \returns Line number of the current read position. After an
+	 * error or exception it is the line where the error was found.
+	 */
+	unsigned int get_line() const {
+		return line_no;
+	}
+
+	/**
+	 * \returns Offset of the current read position from the start of the buffer.
+	 */
+	std::size_t get_offset() const {
+		return cur - begin;
+	}
+};
+
+std::string_view decode_value(std::string_view raw_value, std::string &buffer);
+std::vector<std::string_view> split_at_keys(std::string_view buffer, std::size_t chunk_count);
+
+}
+
+#endif /* __CKV_PARSER_HPP__ */
@@ -0,0 +1,172 @@
+#include <ckv_scan.hpp>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define __CKV_SCAN_X86
+#include <immintrin.h>
+#endif
+
+static const char *find_newline_scalar(const char *begin, const char *end)
+{
+	while (begin != end && *begin != '\n') {
+		begin++;
+	}
+	return begin;
+}
+
+#ifdef __CKV_SCAN_X86
+
+__attribute__((target("sse2")))
+static const char *find_newline_sse2(const char *begin, const char *end)
+{
+	const __m128i newline = _mm_set1_epi8('\n');
+
+	while (end - begin >= 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+
+		if (mask != 0) {
+			return begin + __builtin_ctz(mask);
+		}
+		begin += 16;
+	}
+
+	return find_newline_scalar(begin, end);
+}
+
+__attribute__((target("avx2")))
+static const char *find_newline_avx2(const char *begin, const char *end)
+{
+	const __m256i newline = _mm256_set1_epi8('\n');
+
+	while (end - begin >= 32) {
+		__m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+
+		if (mask != 0) {
+			return begin + __builtin_ctz(mask);
+		}
+		begin += 32;
+	}
+
+	return find_newline_sse2(begin, end);
+}
+
+#endif
+
+/**
+ * Returns true if the CPU running us supports mode.
+ */
+static bool scan_mode_supported(ckv::ScanMode mode)
+{
+#ifdef __CKV_SCAN_X86
+	__builtin_cpu_init();
+#endif
+
+	switch (mode) {
+	case ckv::ScanMode::Scalar:
+		return true;
+#ifdef __CKV_SCAN_X86
+	case ckv::ScanMode::SSE2:
+		return __builtin_cpu_supports("sse2");
+	case ckv::ScanMode::AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+/**
+ * Returns the fastest mode supported by the CPU.
+ */
+static ckv::ScanMode best_scan_mode()
+{
+	if (scan_mode_supported(ckv::ScanMode::AVX2)) {
+		return ckv::ScanMode::AVX2;
+	} else if (scan_mode_supported(ckv::ScanMode::SSE2)) {
+		return ckv::ScanMode::SSE2;
+	}
+	return ckv::ScanMode::Scalar;
+}
+
+static ckv::ScanMode scan_mode = ckv::ScanMode::Scalar;
+static const char *(*find_newline_impl)(const char *, const char *) = find_newline_scalar;
+
+/**
+ * Points find_newline_impl to the implementation of mode,
+ * which has to be supported.
+ */
+static bool use_scan_mode(ckv::ScanMode mode)
+{
+	switch (mode) {
+#ifdef __CKV_SCAN_X86
+	case ckv::ScanMode::AVX2:
+		find_newline_impl = find_newline_avx2;
+		break;
+	case ckv::ScanMode::SSE2:
+		find_newline_impl = find_newline_sse2;
+		break;
+#endif
+	default:
+		find_newline_impl = find_newline_scalar;
+		break;
+	}
+
+	scan_mode = mode;
+	return true;
+}
+
+/**
+ * Switches to best_scan_mode() the first time it is called.
+ */
+static void init_scan_mode()
+{
+	static bool initialized = use_scan_mode(best_scan_mode());
+	(void)initialized;
+}
+
+/**
+ * Finds the first newline in [begin, end).
+ *
+ * \param begin Start of the range to search.
+ * \param end End of the range to search.
+ *
+ * \return
+ * Pointer to the newline or end if there is none.
+ */
+const char *ckv::find_newline(const char *begin, const char *end)
+{
+	init_scan_mode();
+	return find_newline_impl(begin, end);
+}
+
+/**
+ * \returns Implementation currently used by find_newline().
+ */
+ckv::ScanMode ckv::get_scan_mode()
+{
+	init_scan_mode();
+	return scan_mode;
+}
+
+/**
+ * Makes find_newline() use mode.
+ *
+ * This is meant for benchmarks and tests comparing implementations
+ * and must not be called while other threads are parsing.
+ *
+ * \param mode Implementation to use.
+ *
+ * \return
+ * false, without changing anything, if the CPU doesn't support mode.
+ */
+bool ckv::set_scan_mode(ScanMode mode)
+{
+	init_scan_mode();
+
+	if (!scan_mode_supported(mode)) {
+		return false;
+	}
+
+	return use_scan_mode(mode);
+}
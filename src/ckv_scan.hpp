@@ -0,0 +1,32 @@
+#ifndef __CKV_SCAN_HPP__
+#define __CKV_SCAN_HPP__
+
+/** \file */
+
+namespace ckv {
+
+/**
+ * Implementations of find_newline().
+ *
+ * The fastest one supported by the CPU is picked on the first
+ * call of find_newline() or get_scan_mode(), through a function
+ * local static, so that first call is thread safe.
+ *
+ * set_scan_mode() replaces the implementation in a plain global,
+ * not an atomic, so it must not be called while other threads
+ * may be parsing.
+ */
+enum class ScanMode {
+	Scalar, /**< Plain byte by byte loop, always available */
+	SSE2,   /**< 16 bytes at a time */
+	AVX2    /**< 32 bytes at a time */
+};
+
+const char *find_newline(const char *begin, const char *end);
+
+ScanMode get_scan_mode();
+bool set_scan_mode(ScanMode mode);
+
+}
+
+#endif /* __CKV_SCAN_HPP__ */
@@ -0,0 +1,135 @@
+#include <ckv.hpp>
+#include <ckv_snapshot.hpp>
+
+/**
+ * Looks key up in the snapshot.
+ *
+ * \param key Key to look up.
+ * \param value Set to the value of key if it is found.
+ *
+ * \return
+ * true if key was found.
+ */
+bool ckv::Snapshot::find(std::string_view key, std::string_view &value) const
+{
+	auto it = values.find(key);
+
+	if (it == values.end()) {
+		return false;
+	}
+
+	value = it->second;
+	return true;
+}
+
+/**
+ * \param key Key to look up.
+ *
+ * \throws KeyNotFound
+ *
+ * \return
+ * Value of key, valid as long as the snapshot is.
+ */
+std::string_view ckv::Snapshot::get_value_for_key(std::string_view key) const
+{
+	return values.at(key);
+}
+
+/**
+ * Returns the latest snapshot, refreshing the cached one
+ * first if a new one was published since the last call.
+ *
+ * \return
+ * Latest snapshot, valid until the next call.
+ */
+const ckv::Snapshot &ckv::SnapshotReloader::Reader::get()
+{
+	std::uint64_t latest = reloader->get_version();
+
+	if (latest != cached_version || cached == nullptr) {
+		// may already be newer than latest, the next call catches up
+		cached = reloader->current();
+		cached_version = latest;
+	}
+
+	return *cached;
+}
+
+/**
+ * Takes the first snapshot of file_path.
+ *
+ * \param file_path
+ * Path to the ckv file.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+ckv::SnapshotReloader::SnapshotReloader(std::string file_path) : file(file_path)
+{
+	// reloads are rare enough to always follow WriteMode::Journal writes
+	file.set_read_journal(true);
+	publish(file.snapshot());
+}
+
+/**
+ * \returns The latest snapshot. Safe to call from any thread.
+ */
+std::shared_ptr<const ckv::Snapshot> ckv::SnapshotReloader::current() const
+{
+	return std::atomic_load_explicit(&snapshot, std::memory_order_acquire);
+}
+
+/**
+ * Takes a new snapshot of the file if it or its journal
+ * changed since the current one was taken, and publishes it.
+ *
+ * On error the current snapshot stays in place, so readers never
+ * see a file that failed to parse. Concurrent calls are serialized.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ *
+ * \return
+ * true if a new snapshot was published.
+ */
+bool ckv::SnapshotReloader::reload()
+{
+	std::lock_guard<std::mutex> lock(reload_mutex);
+	std::shared_ptr<const Snapshot> old_snapshot = current();
+	ckv::FileIdentity identity, journal_identity;
+
+	// left with size -1 if there is no journal, as in a snapshot taken without one
+	ckv::get_file_identity(ckv::journal_path_for(file.get_file_path()), journal_identity);
+
+	if (ckv::get_file_identity(file.get_file_path(), identity) && identity == old_snapshot->get_identity()
+			&& journal_identity == old_snapshot->get_journal_identity()) {
+		return false;
+	}
+
+	publish(file.snapshot());
+	return true;
+}
+
+/**
+ * Makes new_snapshot the current one. Safe to call from any thread.
+ *
+ * \param new_snapshot
+ * Snapshot to publish, must not be nullptr.
+ */
+void ckv::SnapshotReloader::publish(std::shared_ptr<const Snapshot> new_snapshot)
+{
+	std::atomic_store_explicit(&snapshot, std::move(new_snapshot), std::memory_order_release);
+
+	// readers see the version change only once the snapshot is there
+	version.fetch_add(1, std::memory_order_acq_rel);
+}
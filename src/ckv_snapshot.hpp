@@ -0,0 +1,165 @@
+#ifndef __CKV_SNAPSHOT_HPP__
+#define __CKV_SNAPSHOT_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <ckv.hpp>
+#include <ckv_flat_map.hpp>
+#include <ckv_parser.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Immutable copy of all the keys and values of a ckv file.
+ *
+ * A ConfigFile parses lazily and keeps state between calls, so it
+ * can't be shared between threads. A Snapshot is fully parsed when
+ * it is made by ConfigFile::snapshot() and never changes after, so
+ * any number of threads can read the same one without locking.
+ * It owns its keys and values, writes to the file don't affect it.
+ */
+class Snapshot {
+private:
+	ckv::FlatMap values;         /**< Keys and values in the order they appear in the file */
+	std::string file_path;       /**< File the snapshot was taken of */
+	ckv::FileIdentity identity;  /**< Identity of the file at the time */
+	ckv::FileIdentity journal_identity; /**< Identity of the journal read with it, size -1 if none was */
+
+	Snapshot(ckv::FlatMap values, std::string file_path, const ckv::FileIdentity &identity,
+			const ckv::FileIdentity &journal_identity)
+		: values(std::move(values)), file_path(std::move(file_path)), identity(identity),
+		journal_identity(journal_identity) {}
+
+	friend class ConfigFile;
+
+public:
+	bool find(std::string_view key, std::string_view &value) const;
+	std::string_view get_value_for_key(std::string_view key) const;
+
+	/**
+	 * \returns Number of keys in the snapshot.
+	 */
+	std::size_t size() const {
+		return values.size();
+	}
+
+	/**
+	 * \returns All keys and values, in the order they appear in the file.
+	 */
+	const ckv::FlatMap &get_values() const {
+		return values;
+	}
+
+	/**
+	 * \returns Path of the file the snapshot was taken of.
+	 */
+	const std::string &get_file_path() const {
+		return file_path;
+	}
+
+	/**
+	 * \returns Identity of the file at the time the snapshot was taken.
+	 */
+	const ckv::FileIdentity &get_identity() const {
+		return identity;
+	}
+
+	/**
+	 * \returns Identity of the file's journal at the time the snapshot
+	 * was taken, with size -1 if there was none or it wasn't read.
+	 */
+	const ckv::FileIdentity &get_journal_identity() const {
+		return journal_identity;
+	}
+
+	/**
+	 * \returns true if other was taken of the same file and journal
+	 * as they were when this one was taken.
+	 */
+	bool same_source(const Snapshot &other) const {
+		return identity == other.identity && journal_identity == other.journal_identity;
+	}
+};
+
+/**
+ * Keeps the latest Snapshot of a ckv file and replaces it when
+ * the file changes, read-copy-update style.
+ *
+ * reload() parses the new file without blocking readers and then
+ * publishes the new snapshot with a single atomic store. Readers
+ * holding the old one keep using it, it is freed when the last of
+ * them lets go.
+ *
+ * Each reader thread should have its own Reader. Reader::get()
+ * only compares a version number unless a reload happened since its
+ * last call, so lookups don't touch any shared reference count or
+ * lock and cost the same during a reload as outside one.
+ */
+class SnapshotReloader {
+private:
+	ckv::ConfigFile file;                     /**< Parser for reload(), used under reload_mutex only */
+	std::shared_ptr<const Snapshot> snapshot; /**< Latest snapshot, accessed through std::atomic_load/store only */
+	std::atomic<std::uint64_t> version{0};    /**< Bumped after each new snapshot is published */
+	std::mutex reload_mutex;                  /**< Serializes reloads */
+
+public:
+	/**
+	 * Cached view of the latest snapshot, for a single thread.
+	 */
+	class Reader {
+	private:
+		const SnapshotReloader *reloader;
+		std::shared_ptr<const Snapshot> cached;
+		std::uint64_t cached_version = 0;
+
+	public:
+		/**
+		 * \param reloader
+		 * Reloader to read from. It must outlive the reader.
+		 */
+		explicit Reader(const SnapshotReloader &reloader) : reloader(&reloader) {}
+
+		const Snapshot &get();
+	};
+
+	SnapshotReloader(std::string file_path);
+
+	std::shared_ptr<const Snapshot> current() const;
+	bool reload();
+	void publish(std::shared_ptr<const Snapshot> new_snapshot);
+
+	/**
+	 * \returns Number of snapshots published so far.
+	 */
+	std::uint64_t get_version() const {
+		return version.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * \returns Error line number of the most recent failed load,
+	 * see ConfigFile::get_err_line(). Only meaningful in the
+	 * thread that called reload().
+	 */
+	unsigned int get_err_line() {
+		return file.get_err_line();
+	}
+
+	/**
+	 * \returns Path of the file being reloaded.
+	 */
+	std::string get_file_path() {
+		return file.get_file_path();
+	}
+};
+
+}
+
+#endif /* __CKV_SNAPSHOT_HPP__ */
@@ -0,0 +1,264 @@
+#include <ckv_stats.hpp>
+#include <atomic>
+#include <sstream>
+
+namespace {
+
+/**
+ * Stats of all ConfigFile objects together.
+ */
+struct GlobalStats {
+	std::atomic<std::uint64_t> counters[static_cast<std::size_t>(ckv::Counter::Count)] = {};
+	std::atomic<std::uint64_t> buckets[static_cast<std::size_t>(ckv::Method::Count)][ckv::Histogram::bucket_count] = {};
+	std::atomic<std::uint64_t> counts[static_cast<std::size_t>(ckv::Method::Count)] = {};
+	std::atomic<std::uint64_t> sums_ns[static_cast<std::size_t>(ckv::Method::Count)] = {};
+};
+
+GlobalStats global_stats;
+
+/**
+ * Help text of each counter for the Prometheus format.
+ */
+const char *counter_help[] = {
+	"Bytes of ckv files parsed.",
+	"Keys looked up.",
+	"Keys parsed while looking keys up.",
+	"Passes parsing a whole ckv file.",
+	"Bytes written to ckv files.",
+	"Exceptions thrown by ckv::ConfigFile."
+};
+
+/**
+ * Adds a sample to the Prometheus output, with
+ * the file label if there is one.
+ */
+void add_sample(std::ostringstream &out, const std::string &name, const std::string &file_label,
+		const std::string &labels, const std::string &value)
+{
+	std::string all_labels = file_label;
+
+	if (!labels.empty()) {
+		all_labels += (all_labels.empty() ? "" : ",") + labels;
+	}
+
+	out << name;
+	if (!all_labels.empty()) {
+		out << "{" << all_labels << "}";
+	}
+	out << " " << value << "\n";
+}
+
+}
+
+/**
+ * \returns Name of counter in the Prometheus output.
+ */
+const char *ckv::counter_name(Counter counter)
+{
+	switch (counter) {
+	case Counter::BytesScanned:
+		return "ckv_bytes_scanned_total";
+	case Counter::Lookups:
+		return "ckv_lookups_total";
+	case Counter::KeysVisited:
+		return "ckv_keys_visited_total";
+	case Counter::FullRescans:
+		return "ckv_full_rescans_total";
+	case Counter::RewriteBytes:
+		return "ckv_rewrite_bytes_total";
+	case Counter::ExceptionsThrown:
+		return "ckv_exceptions_thrown_total";
+	case Counter::Count:
+		break;
+	}
+
+	return "";
+}
+
+/**
+ * \returns Name of method as in ConfigFile.
+ */
+const char *ckv::method_name(Method method)
+{
+	switch (method) {
+	case Method::GetValueForKey:
+		return "get_value_for_key";
+	case Method::TryGetValueForKey:
+		return "try_get_value_for_key";
+	case Method::GetValuesForKeys:
+		return "get_values_for_keys";
+	case Method::SetValueForKey:
+		return "set_value_for_key";
+	case Method::RemoveKey:
+		return "remove_key";
+	case Method::ImportToMap:
+		return "import_to_map";
+	case Method::ImportToFlatMap:
+		return "import_to_flat_map";
+	case Method::Visit:
+		return "visit";
+	case Method::Snapshot:
+		return "snapshot";
+	case Method::Compile:
+		return "compile";
+	case Method::Count:
+		break;
+	}
+
+	return "";
+}
+
+/**
+ * \returns Histogram bucket for a call taking ns nanoseconds.
+ */
+std::size_t ckv::histogram_bucket(std::uint64_t ns)
+{
+	std::size_t bucket = 0;
+
+	while (ns != 0 && bucket + 1 < Histogram::bucket_count) {
+		ns >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+/**
+ * Formats stats in the Prometheus text exposition format.
+ *
+ * Counters become counters and method durations histograms
+ * in seconds, with a method label.
+ *
+ * \param stats
+ * Stats to format.
+ *
+ * \param file_path
+ * If not empty, added to every sample as a file label.
+ */
+std::string ckv::to_prometheus(const Stats &stats, const std::string &file_path)
+{
+	std::ostringstream out;
+	std::string file_label;
+
+	if (!file_path.empty()) {
+		std::string escaped;
+
+		for (char ch : file_path) {
+			if (ch == '\\' || ch == '"') {
+				escaped += '\\';
+			}
+			escaped += ch == '\n' ? 'n' : ch;
+		}
+		file_label = "file=\"" + escaped + "\"";
+	}
+
+	for (std::size_t i = 0; i < stats.counters.size(); i++) {
+		const char *name = counter_name(static_cast<Counter>(i));
+
+		out << "# HELP " << name << " " << counter_help[i] << "\n"
+			<< "# TYPE " << name << " counter\n";
+		add_sample(out, name, file_label, "", std::to_string(stats.counters[i]));
+	}
+
+	out << "# HELP ckv_method_duration_seconds Time spent in ckv::ConfigFile methods.\n"
+		<< "# TYPE ckv_method_duration_seconds histogram\n";
+
+	for (std::size_t i = 0; i < stats.timings.size(); i++) {
+		const Histogram &histogram = stats.timings[i];
+		std::string method = std::string("method=\"") + method_name(static_cast<Method>(i)) + "\"";
+		std::uint64_t cumulative = 0;
+
+		for (std::size_t bucket = 0; bucket + 1 < Histogram::bucket_count; bucket++) {
+			std::ostringstream le;
+
+			cumulative += histogram.buckets[bucket];
+			le << static_cast<double>(std::uint64_t(1) << bucket) / 1e9;
+			add_sample(out, "ckv_method_duration_seconds_bucket", file_label,
+				method + ",le=\"" + le.str() + "\"", std::to_string(cumulative));
+		}
+
+		add_sample(out, "ckv_method_duration_seconds_bucket", file_label,
+			method + ",le=\"+Inf\"", std::to_string(histogram.count));
+
+		std::ostringstream sum;
+		sum << histogram.sum_ns / 1e9;
+		add_sample(out, "ckv_method_duration_seconds_sum", file_label, method, sum.str());
+		add_sample(out, "ckv_method_duration_seconds_count", file_label, method, std::to_string(histogram.count));
+	}
+
+	return out.str();
+}
+
+/**
+ * \returns Stats of all ConfigFile objects together, all
+ * zeros unless the library is built with CKV_ENABLE_STATS.
+ */
+ckv::Stats ckv::get_global_stats()
+{
+	Stats stats;
+
+	for (std::size_t i = 0; i < stats.counters.size(); i++) {
+		stats.counters[i] = global_stats.counters[i].load(std::memory_order_relaxed);
+	}
+
+	for (std::size_t i = 0; i < stats.timings.size(); i++) {
+		for (std::size_t bucket = 0; bucket < Histogram::bucket_count; bucket++) {
+			stats.timings[i].buckets[bucket] = global_stats.buckets[i][bucket].load(std::memory_order_relaxed);
+		}
+		stats.timings[i].count = global_stats.counts[i].load(std::memory_order_relaxed);
+		stats.timings[i].sum_ns = global_stats.sums_ns[i].load(std::memory_order_relaxed);
+	}
+
+	return stats;
+}
+
+/**
+ * Sets the global stats back to zero.
+ */
+void ckv::reset_global_stats()
+{
+	for (auto &counter : global_stats.counters) {
+		counter.store(0, std::memory_order_relaxed);
+	}
+
+	for (std::size_t i = 0; i < static_cast<std::size_t>(Method::Count); i++) {
+		for (auto &bucket : global_stats.buckets[i]) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		global_stats.counts[i].store(0, std::memory_order_relaxed);
+		global_stats.sums_ns[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+#ifdef CKV_ENABLE_STATS
+
+/**
+ * Adds n to counter.
+ */
+void ckv::StatsRecorder::add(Counter counter, std::uint64_t n)
+{
+	std::size_t i = static_cast<std::size_t>(counter);
+
+	stats.counters[i] += n;
+	global_stats.counters[i].fetch_add(n, std::memory_order_relaxed);
+}
+
+/**
+ * Records a call to method which took ns nanoseconds.
+ */
+void ckv::StatsRecorder::record(Method method, std::uint64_t ns)
+{
+	std::size_t i = static_cast<std::size_t>(method);
+	std::size_t bucket = histogram_bucket(ns);
+	Histogram &histogram = stats.timings[i];
+
+	histogram.buckets[bucket]++;
+	histogram.count++;
+	histogram.sum_ns += ns;
+
+	global_stats.buckets[i][bucket].fetch_add(1, std::memory_order_relaxed);
+	global_stats.counts[i].fetch_add(1, std::memory_order_relaxed);
+	global_stats.sums_ns[i].fetch_add(ns, std::memory_order_relaxed);
+}
+
+#endif
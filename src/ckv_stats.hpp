@@ -0,0 +1,177 @@
+#ifndef __CKV_STATS_HPP__
+#define __CKV_STATS_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <ckv_config.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Events counted by the stats.
+ */
+enum class Counter {
+	BytesScanned,     /**< Bytes of ckv files parsed */
+	Lookups,          /**< Keys looked up */
+	KeysVisited,      /**< Keys parsed while looking keys up, beyond those already indexed */
+	FullRescans,      /**< Parses starting from the beginning of a file */
+	RewriteBytes,     /**< Bytes written to files by set_value_for_key(), remove_key() and compile() */
+	ExceptionsThrown, /**< Exceptions thrown out of ConfigFile methods */
+	Count             /**< Number of counters, not a counter */
+};
+
+/**
+ * Public methods whose duration is measured by the stats.
+ */
+enum class Method {
+	GetValueForKey,
+	TryGetValueForKey,
+	GetValuesForKeys,
+	SetValueForKey,
+	RemoveKey,
+	ImportToMap,
+	ImportToFlatMap,
+	Visit,
+	Snapshot,
+	Compile,
+	Count /**< Number of methods, not a method */
+};
+
+/**
+ * Durations of the calls to a method.
+ *
+ * Bucket i counts calls that took less than 2^i nanoseconds
+ * and at least 2^(i - 1), the last one all longer calls.
+ */
+struct Histogram {
+	static constexpr std::size_t bucket_count = 40;
+
+	std::array<std::uint64_t, bucket_count> buckets{}; /**< Calls in each bucket */
+	std::uint64_t count = 0;                            /**< Calls in total */
+	std::uint64_t sum_ns = 0;                           /**< Time spent in all calls */
+};
+
+/**
+ * Values of all counters and histograms at some point.
+ */
+struct Stats {
+	std::array<std::uint64_t, static_cast<std::size_t>(Counter::Count)> counters{};
+	std::array<Histogram, static_cast<std::size_t>(Method::Count)> timings{};
+
+	/**
+	 * \returns Value of counter.
+	 */
+	std::uint64_t get(Counter counter) const {
+		return counters[static_cast<std::size_t>(counter)];
+	}
+
+	/**
+	 * \returns Durations of the calls to method.
+	 */
+	const Histogram &get(Method method) const {
+		return timings[static_cast<std::size_t>(method)];
+	}
+};
+
+const char *counter_name(Counter counter);
+const char *method_name(Method method);
+std::size_t histogram_bucket(std::uint64_t ns);
+std::string to_prometheus(const Stats &stats, const std::string &file_path = std::string());
+Stats get_global_stats();
+void reset_global_stats();
+
+#ifdef CKV_ENABLE_STATS
+
+/**
+ * Stats of a single ConfigFile. Everything recorded
+ * in it is added to the global stats too.
+ */
+class StatsRecorder {
+private:
+	Stats stats;            /**< Only touched by the thread using the ConfigFile */
+	unsigned int depth = 0; /**< Timed calls in progress */
+
+	friend class ScopedTimer;
+
+public:
+	void add(Counter counter, std::uint64_t n);
+	void record(Method method, std::uint64_t ns);
+
+	/**
+	 * \returns Stats recorded so far.
+	 */
+	const Stats &get() const {
+		return stats;
+	}
+};
+
+/**
+ * Records the time from its construction to its
+ * destruction as a call to method.
+ *
+ * Only the outermost timed call is recorded, so a method
+ * calling others counts as one call of itself. An exception
+ * leaving it counts as Counter::ExceptionsThrown.
+ */
+class ScopedTimer {
+private:
+	StatsRecorder &recorder;
+	Method method;
+	int exceptions;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	ScopedTimer(StatsRecorder &recorder, Method method)
+		: recorder(recorder), method(method), exceptions(std::uncaught_exceptions()),
+		start(std::chrono::steady_clock::now()) {
+		recorder.depth++;
+	}
+
+	~ScopedTimer() {
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+		if (--recorder.depth != 0) {
+			return;
+		}
+
+		recorder.record(method, elapsed.count());
+
+		if (std::uncaught_exceptions() > exceptions) {
+			recorder.add(Counter::ExceptionsThrown, 1);
+		}
+	}
+
+	ScopedTimer(const ScopedTimer &) = delete;
+	ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+#endif
+
+}
+
+/**
+ * \def CKV_STATS_ADD(recorder, counter, n)
+ * Adds n to counter in recorder. Unless CKV_ENABLE_STATS
+ * is defined it expands to nothing and n isn't evaluated.
+ *
+ * \def CKV_STATS_TIME(recorder, method)
+ * Times the rest of the enclosing scope as a call to method.
+ * Expands to nothing unless CKV_ENABLE_STATS is defined.
+ */
+#ifdef CKV_ENABLE_STATS
+#define CKV_STATS_ADD(recorder, counter, n) (recorder).add(ckv::Counter::counter, (n))
+#define CKV_STATS_TIME(recorder, method) ckv::ScopedTimer __ckv_stats_timer((recorder), ckv::Method::method)
+#else
+#define CKV_STATS_ADD(recorder, counter, n) ((void)sizeof(n))
+#define CKV_STATS_TIME(recorder, method) ((void)0)
+#endif
+
+#endif /* __CKV_STATS_HPP__ */
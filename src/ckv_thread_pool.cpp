@@ -0,0 +1,232 @@
+#include <ckv_thread_pool.hpp>
+#include <exception>
+
+/**
+ * Pool the current thread belongs to, if any, and its index in it.
+ */
+static thread_local const ckv::ThreadPool *current_pool = nullptr;
+static thread_local std::size_t current_index = 0;
+
+/**
+ * Starts thread_count threads, at least one.
+ *
+ * \param thread_count
+ * Number of threads, the number of cores by default.
+ */
+ckv::ThreadPool::ThreadPool(std::size_t thread_count)
+{
+	if (thread_count == 0) {
+		thread_count = 1;
+	}
+
+	for (std::size_t i = 0; i < thread_count; i++) {
+		queues.emplace_back(new Queue);
+	}
+
+	for (std::size_t i = 0; i < thread_count; i++) {
+		threads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+/**
+ * Runs the tasks still queued, then stops the threads.
+ */
+ckv::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+
+	sleep_cond.notify_all();
+
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+/**
+ * \returns Index of the queue of the current thread if it is one of
+ * the pool's, or of the next queue in round robin order otherwise.
+ */
+std::size_t ckv::ThreadPool::own_queue() const
+{
+	if (current_pool == this) {
+		return current_index;
+	}
+
+	return next_queue++ % queues.size();
+}
+
+/**
+ * Queues task to be run by one of the threads.
+ * Exceptions thrown by task are ignored.
+ *
+ * \param task
+ * Task to run.
+ */
+void ckv::ThreadPool::submit(std::function<void()> task)
+{
+	Queue &queue = *queues[own_queue()];
+
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	queued++;
+
+	// taking the lock orders this with a thread about to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+
+	sleep_cond.notify_one();
+}
+
+/**
+ * Runs one task, from the back of queue index or
+ * else stolen from the front of another queue.
+ *
+ * \param index
+ * Queue to look in first.
+ *
+ * \return
+ * true if a task was run.
+ */
+bool ckv::ThreadPool::run_one(std::size_t index)
+{
+	std::function<void()> task;
+
+	for (std::size_t i = 0; i < queues.size() && !task; i++) {
+		Queue &queue = *queues[(index + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.tasks.empty()) {
+			continue;
+		}
+
+		if (i == 0) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+	}
+
+	if (!task) {
+		return false;
+	}
+
+	queued--;
+
+	try {
+		task();
+	} catch (...) {
+	}
+
+	return true;
+}
+
+/**
+ * Body of the index'th thread.
+ */
+void ckv::ThreadPool::work(std::size_t index)
+{
+	current_pool = this;
+	current_index = index;
+
+	while (true) {
+		if (run_one(index)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+
+		sleep_cond.wait(lock, [this]() {
+			return stopping || queued > 0;
+		});
+
+		if (stopping && queued == 0) {
+			return;
+		}
+	}
+}
+
+/**
+ * Runs task(0) to task(count - 1) on the pool and returns
+ * once they have all finished. The calling thread runs
+ * tasks too while it waits.
+ *
+ * \param count
+ * Number of tasks.
+ *
+ * \param task
+ * Task to run with each index.
+ *
+ * \throws
+ * The first exception thrown by a task, once all have finished.
+ */
+void ckv::ThreadPool::run(std::size_t count, const std::function<void(std::size_t index)> &task)
+{
+	std::atomic<std::size_t> left{count};
+	std::exception_ptr error;
+	std::mutex done_mutex;
+	std::condition_variable done_cond;
+
+	for (std::size_t i = 0; i < count; i++) {
+		submit([&, i]() {
+			std::exception_ptr task_error;
+
+			try {
+				task(i);
+			} catch (...) {
+				task_error = std::current_exception();
+			}
+
+			// run() can't return while this is held
+			std::lock_guard<std::mutex> lock(done_mutex);
+
+			if (task_error && !error) {
+				error = task_error;
+			}
+
+			if (--left == 0) {
+				done_cond.notify_all();
+			}
+		});
+	}
+
+	std::size_t index = current_pool == this ? current_index : 0;
+
+	while (left > 0) {
+		if (run_one(index)) {
+			continue;
+		}
+
+		// what is left is running on other threads
+		std::unique_lock<std::mutex> lock(done_mutex);
+		done_cond.wait(lock, [&left]() {
+			return left == 0;
+		});
+	}
+
+	// wait for the last task to let go of done_mutex
+	std::lock_guard<std::mutex> lock(done_mutex);
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+/**
+ * \returns Pool owned by the library, with a thread per core,
+ * started the first time it is asked for.
+ */
+ckv::ThreadPool &ckv::default_thread_pool()
+{
+	static ckv::ThreadPool pool;
+
+	return pool;
+}
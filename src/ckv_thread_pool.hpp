@@ -0,0 +1,73 @@
+#ifndef __CKV_THREAD_POOL_HPP__
+#define __CKV_THREAD_POOL_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * Fixed set of threads running tasks, with work stealing.
+ *
+ * Each thread has its own queue. Tasks submitted from a pool thread
+ * go to the back of that thread's queue, which it works on from the
+ * back, so related tasks stay on the same core. Others are spread
+ * round robin. A thread whose queue is empty steals from the front
+ * of the others' queues, so a few long tasks don't leave the other
+ * threads idle.
+ */
+class ThreadPool {
+private:
+	/**
+	 * Queue of a pool thread.
+	 */
+	struct Queue {
+		std::mutex mutex;                        /**< Guards tasks */
+		std::deque<std::function<void()>> tasks; /**< Tasks not started yet */
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues; /**< One per thread */
+	std::vector<std::thread> threads;
+	std::atomic<std::size_t> queued{0};         /**< Tasks in all queues */
+	mutable std::atomic<std::size_t> next_queue{0}; /**< Queue for the next task from outside the pool */
+	std::mutex sleep_mutex;                     /**< Guards stopping, used with sleep_cond */
+	std::condition_variable sleep_cond;         /**< Signalled when a task is queued or on stop */
+	bool stopping = false;
+
+	void work(std::size_t index);
+	bool run_one(std::size_t index);
+	std::size_t own_queue() const;
+
+public:
+	ThreadPool(std::size_t thread_count = std::thread::hardware_concurrency());
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+	~ThreadPool();
+
+	void submit(std::function<void()> task);
+	void run(std::size_t count, const std::function<void(std::size_t index)> &task);
+
+	/**
+	 * \returns Number of threads in the pool.
+	 */
+	std::size_t size() const {
+		return threads.size();
+	}
+};
+
+ThreadPool &default_thread_pool();
+
+}
+
+#endif /* __CKV_THREAD_POOL_HPP__ */
@@ -0,0 +1,400 @@
+#include <ckv.hpp>
+#include <ckv_watcher.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <system_error>
+#include <unistd.h>
+
+/**
+ * Events that may mean a watched file changed: written in place,
+ * or replaced, created or removed by a rename or unlink.
+ */
+static const std::uint32_t watch_mask = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+	| IN_MOVED_FROM | IN_MOVED_TO;
+
+/**
+ * Splits file_path into the directory to watch, always
+ * ending in '/', and the name of the file in it.
+ *
+ * The directory is resolved by realpath() when it exists.
+ * inotify gives the same watch descriptor to a directory
+ * however it is spelled, so it must have a single name.
+ */
+static void split_path(const std::string &file_path, std::string &dir, std::string &name)
+{
+	std::size_t slash = file_path.rfind('/');
+
+	if (slash == std::string::npos) {
+		dir = "./";
+		name = file_path;
+	} else {
+		dir = file_path.substr(0, slash + 1);
+		name = file_path.substr(slash + 1);
+	}
+
+	if (char *resolved = realpath(dir.c_str(), nullptr)) {
+		dir = resolved;
+		free(resolved);
+
+		if (dir.back() != '/') {
+			dir += '/';
+		}
+	}
+}
+
+/**
+ * Starts watching, no file is watched until add() is called.
+ *
+ * \param debounce
+ * How long a file has to stay quiet after an event before it is
+ * reparsed. A burst of events closer together than that, such as
+ * the writes of a single save, costs a single reparse.
+ *
+ * \throws std::system_error if inotify isn't available.
+ */
+ckv::Watcher::Watcher(std::chrono::milliseconds debounce) : debounce(debounce)
+{
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (inotify_fd < 0) {
+		throw std::system_error(errno, std::generic_category(), "inotify_init1");
+	}
+
+	stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (stop_fd < 0) {
+		int error = errno;
+		::close(inotify_fd);
+		throw std::system_error(error, std::generic_category(), "eventfd");
+	}
+
+	event_thread = std::thread(&Watcher::wait_for_events, this);
+	notify_thread = std::thread(&Watcher::notify_changes, this);
+}
+
+ckv::Watcher::~Watcher()
+{
+	stop();
+	::close(stop_fd);
+	::close(inotify_fd);
+}
+
+/**
+ * Starts watching file_path. Its keys as they are now are
+ * what the first change is compared against.
+ *
+ * \param file_path
+ * Path to the ckv file.
+ *
+ * \throws EqualToWithoutAKey
+ * \throws FileOpenFailed
+ * \throws InvalidCharacter
+ * \throws MissingEqualTo
+ * \throws NoValueFoundForKey
+ * \throws TrailingCharsAfterEqualTo
+ * \throws ValueWithoutAKey
+ */
+void ckv::Watcher::add(const std::string &file_path)
+{
+	std::string dir, name;
+	ckv::ConfigFile file(file_path);
+
+	file.set_read_journal(true);
+
+	std::shared_ptr<const ckv::Snapshot> snapshot = file.snapshot();
+
+	split_path(file_path, dir, name);
+
+	int wd = inotify_add_watch(inotify_fd, dir.c_str(), watch_mask);
+
+	if (wd < 0) {
+		throw ckv::FileOpenFailed(dir);
+	}
+
+	std::lock_guard<std::mutex> lock(state_mutex);
+
+	dir_for_watch[wd] = dir;
+	files[dir + name] = WatchedFile{file_path, snapshot};
+}
+
+/**
+ * Adds subscriber to be called with every change from now on.
+ *
+ * \return
+ * Id to pass to unsubscribe().
+ */
+std::size_t ckv::Watcher::subscribe(Subscriber subscriber)
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+	std::size_t id = next_subscriber_id++;
+
+	subscribers.emplace(id, std::move(subscriber));
+	return id;
+}
+
+/**
+ * Removes the subscriber with id. A call to it already under way
+ * isn't waited for.
+ */
+void ckv::Watcher::unsubscribe(std::size_t id)
+{
+	std::lock_guard<std::mutex> lock(state_mutex);
+
+	subscribers.erase(id);
+}
+
+/**
+ * \returns The last snapshot of file_path that parsed, nullptr
+ * if it isn't watched. Safe to call from any thread.
+ */
+std::shared_ptr<const ckv::Snapshot> ckv::Watcher::current(const std::string &file_path) const
+{
+	std::string dir, name;
+
+	split_path(file_path, dir, name);
+
+	std::lock_guard<std::mutex> lock(state_mutex);
+	auto it = files.find(dir + name);
+
+	return it == files.end() ? nullptr : it->second.snapshot;
+}
+
+/**
+ * Stops both threads. No subscriber is called after it returns.
+ * It must not be called from a subscriber.
+ */
+void ckv::Watcher::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		stopping = true;
+	}
+
+	std::uint64_t one = 1;
+	ssize_t ignored = write(stop_fd, &one, sizeof(one));
+	(void)ignored;
+	dirty_cond.notify_all();
+
+	if (event_thread.joinable()) {
+		event_thread.join();
+	}
+
+	if (notify_thread.joinable()) {
+		notify_thread.join();
+	}
+}
+
+/**
+ * Body of event_thread.
+ *
+ * Reads events as they come and keeps the time of the last one for
+ * each watched file. A file goes to dirty_files once its last event
+ * is debounce old. Nothing here waits on anything but inotify.
+ */
+void ckv::Watcher::wait_for_events()
+{
+	alignas(struct inotify_event) char buffer[4096];
+	std::unordered_map<std::string, std::chrono::steady_clock::time_point> last_event;
+	const std::string journal_suffix = ckv::journal_path_for("");
+
+	while (true) {
+		auto now = std::chrono::steady_clock::now();
+		int timeout = -1;
+
+		for (auto &pending : last_event) {
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(pending.second + debounce - now);
+			int left_ms = std::max<long long>(left.count() + 1, 0);
+
+			if (timeout < 0 || left_ms < timeout) {
+				timeout = left_ms;
+			}
+		}
+
+		struct pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+
+		if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+			return;
+		}
+
+		if (fds[1].revents != 0) {
+			return;
+		}
+
+		ssize_t length;
+
+		while ((fds[0].revents & POLLIN) && (length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+			std::lock_guard<std::mutex> lock(state_mutex);
+
+			now = std::chrono::steady_clock::now();
+
+			for (char *cur = buffer; cur < buffer + length; ) {
+				const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(cur);
+
+				cur += sizeof(struct inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW) {
+					// events were lost, any file may have changed
+					for (auto &file : files) {
+						last_event[file.first] = now;
+					}
+					continue;
+				}
+
+				auto dir = dir_for_watch.find(event->wd);
+
+				if (event->len == 0 || dir == dir_for_watch.end()) {
+					continue;
+				}
+
+				std::string key = dir->second + event->name;
+
+				// a change of the journal is one of its file
+				if (files.count(key) == 0 && key.size() > journal_suffix.size()
+						&& key.compare(key.size() - journal_suffix.size(), std::string::npos, journal_suffix) == 0) {
+					key.resize(key.size() - journal_suffix.size());
+				}
+
+				if (files.count(key) != 0) {
+					last_event[key] = now;
+				}
+			}
+		}
+
+		now = std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> lock(state_mutex);
+
+		for (auto it = last_event.begin(); it != last_event.end(); ) {
+			if (now - it->second < debounce) {
+				it++;
+				continue;
+			}
+
+			if (std::find(dirty_files.begin(), dirty_files.end(), it->first) == dirty_files.end()) {
+				dirty_files.push_back(it->first);
+			}
+			dirty_cond.notify_one();
+			it = last_event.erase(it);
+		}
+	}
+}
+
+/**
+ * Body of notify_thread. Reparses files as they show up
+ * in dirty_files until stop() is called.
+ */
+void ckv::Watcher::notify_changes()
+{
+	while (true) {
+		std::string key;
+
+		{
+			std::unique_lock<std::mutex> lock(state_mutex);
+
+			dirty_cond.wait(lock, [this]() {
+				return stopping || !dirty_files.empty();
+			});
+
+			if (stopping) {
+				return;
+			}
+
+			key = dirty_files.front();
+			dirty_files.pop_front();
+		}
+
+		reparse(key);
+	}
+}
+
+/**
+ * Takes a new snapshot of the watched file key, compares it with
+ * the previous one and calls the subscribers if any key changed or
+ * the file doesn't parse anymore.
+ */
+void ckv::Watcher::reparse(const std::string &key)
+{
+	std::shared_ptr<const ckv::Snapshot> old_snapshot;
+	std::vector<Subscriber> to_call;
+	Change change;
+
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		auto it = files.find(key);
+
+		if (it == files.end()) {
+			return;
+		}
+
+		change.file_path = it->second.file_path;
+		old_snapshot = it->second.snapshot;
+	}
+
+	ckv::ConfigFile file(change.file_path);
+
+	file.set_read_journal(true);
+
+	try {
+		change.snapshot = file.snapshot();
+	} catch (std::exception &e) {
+		// a file in the middle of being replaced is caught by the next event
+		change.error = e.what();
+		change.err_line = file.get_err_line();
+		change.snapshot = old_snapshot;
+	}
+
+	if (change.error.empty()) {
+		if (change.snapshot->same_source(*old_snapshot)) {
+			return;
+		}
+
+		const ckv::FlatMap &old_values = old_snapshot->get_values();
+		const ckv::FlatMap &new_values = change.snapshot->get_values();
+
+		for (auto pair : new_values) {
+			auto old = old_values.find(pair.first);
+
+			if (old == old_values.end()) {
+				change.added.emplace_back(pair.first);
+			} else if (old->second != pair.second) {
+				change.modified.emplace_back(pair.first);
+			}
+		}
+
+		for (auto pair : old_values) {
+			if (new_values.count(pair.first) == 0) {
+				change.removed.emplace_back(pair.first);
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+
+		if (stopping) {
+			return;
+		}
+
+		files[key].snapshot = change.snapshot;
+
+		if (change.error.empty() && change.added.empty() && change.removed.empty() && change.modified.empty()) {
+			return;
+		}
+
+		for (auto &subscriber : subscribers) {
+			to_call.push_back(subscriber.second);
+		}
+	}
+
+	for (auto &subscriber : to_call) {
+		try {
+			subscriber(change);
+		} catch (...) {
+			// one subscriber failing doesn't keep the others from hearing about it
+		}
+	}
+}
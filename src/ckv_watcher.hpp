@@ -0,0 +1,104 @@
+#ifndef __CKV_WATCHER_HPP__
+#define __CKV_WATCHER_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <ckv_snapshot.hpp>
+/// \endcond
+
+namespace ckv {
+
+/**
+ * What changed in a watched file, as passed to Watcher subscribers.
+ */
+struct Change {
+	std::string file_path;                 /**< File that changed, as passed to Watcher::add() */
+	std::vector<std::string> added;        /**< Keys that weren't in the file before */
+	std::vector<std::string> removed;      /**< Keys that aren't in the file anymore */
+	std::vector<std::string> modified;     /**< Keys whose value changed */
+	std::shared_ptr<const Snapshot> snapshot; /**< File as it is now, or as it last parsed if error is set */
+	std::string error;                     /**< Why the file couldn't be parsed, empty if it could */
+	unsigned int err_line = 0;             /**< Line of the syntax error, 0 if none */
+};
+
+/**
+ * Watches ckv files with inotify and tells subscribers which
+ * keys changed whenever one of them does.
+ *
+ * Directories are watched rather than the files themselves, so a
+ * file replaced by renaming another over it, the way editors and
+ * WriteMode::Atomic save, keeps being watched. Its journal is
+ * watched along with it and read into its snapshots.
+ *
+ * Events are collected by one thread which never does anything but
+ * wait on inotify, so it never falls behind. Once a file has seen no
+ * event for the debounce interval, a second thread parses it once
+ * into a new Snapshot, compares it to the previous one and calls the
+ * subscribers from there.
+ */
+class Watcher {
+public:
+	/**
+	 * Called with each change. Runs on the Watcher's own thread,
+	 * one change at a time.
+	 */
+	using Subscriber = std::function<void(const Change &change)>;
+
+private:
+	/**
+	 * A file being watched.
+	 */
+	struct WatchedFile {
+		std::string file_path;                    /**< Path as passed to add() */
+		std::shared_ptr<const Snapshot> snapshot; /**< Last snapshot that parsed */
+	};
+
+	std::chrono::milliseconds debounce; /**< Quiet time after the last event before reparsing */
+	int inotify_fd = -1;                /**< inotify instance, non blocking */
+	int stop_fd = -1;                   /**< eventfd waking the event thread up to stop */
+
+	mutable std::mutex state_mutex;     /**< Guards everything below */
+	std::unordered_map<int, std::string> dir_for_watch;   /**< Watched directory of each watch descriptor */
+	std::unordered_map<std::string, WatchedFile> files;   /**< Watched files by directory + name */
+	std::map<std::size_t, Subscriber> subscribers;        /**< Subscribers by id, in the order they subscribed */
+	std::size_t next_subscriber_id = 1;
+	std::deque<std::string> dirty_files;                  /**< Files to reparse, by directory + name */
+	std::condition_variable dirty_cond; /**< Signalled when dirty_files grows or on stop */
+	bool stopping = false;
+
+	std::thread event_thread;  /**< Waits on inotify */
+	std::thread notify_thread; /**< Reparses and calls subscribers */
+
+	void wait_for_events();
+	void notify_changes();
+	void reparse(const std::string &key);
+
+public:
+	Watcher(std::chrono::milliseconds debounce = std::chrono::milliseconds(50));
+	Watcher(const Watcher &) = delete;
+	Watcher &operator=(const Watcher &) = delete;
+	~Watcher();
+
+	void add(const std::string &file_path);
+	std::size_t subscribe(Subscriber subscriber);
+	void unsubscribe(std::size_t id);
+	std::shared_ptr<const Snapshot> current(const std::string &file_path) const;
+	void stop();
+};
+
+}
+
+#endif /* __CKV_WATCHER_HPP__ */
@@ -0,0 +1,270 @@
+#include <ckv.hpp>
+#include <ckv_scan.hpp>
+#include <ckv_writer.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Tab starting each continuation line of a value, for writev().
+ */
+static char continuation_tab[] = "\t";
+
+/**
+ * Newline ending each block, for writev().
+ */
+static char block_end[] = "\n";
+
+/**
+ * Average line length of a value from which handing lines to
+ * writev() beats copying them, tabs and all, into the buffer.
+ */
+static const std::size_t writev_min_line_length = 1024;
+
+/**
+ * \returns true if value is worth writing with writev().
+ */
+static bool has_long_lines(std::string_view value)
+{
+	const char *cur = value.data();
+	const char *end = value.data() + value.size();
+	std::size_t max_lines = value.size() / writev_min_line_length;
+	std::size_t lines = 1;
+
+	while (lines <= max_lines) {
+		cur = ckv::find_newline(cur, end);
+
+		if (cur == end) {
+			return true;
+		}
+
+		cur++;
+		lines++;
+	}
+
+	return false;
+}
+
+/**
+ * Writes all of iov to fd, retrying short writes.
+ *
+ * \return true on success.
+ */
+static bool writev_all(int fd, std::vector<iovec> &iov)
+{
+	std::size_t first = 0;
+
+	while (first < iov.size()) {
+		int count = static_cast<int>(std::min<std::size_t>(iov.size() - first, IOV_MAX));
+		ssize_t written = writev(fd, &iov[first], count);
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+
+		while (first < iov.size() && static_cast<std::size_t>(written) >= iov[first].iov_len) {
+			written -= iov[first].iov_len;
+			first++;
+		}
+
+		if (written > 0) {
+			iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + written;
+			iov[first].iov_len -= written;
+		}
+	}
+
+	iov.clear();
+	return true;
+}
+
+/**
+ * Appends the block of key and value to out. Every
+ * newline in value is followed by a tab, and the
+ * block ends with a newline.
+ */
+void ckv::encode_block(std::string &out, std::string_view key, std::string_view value)
+{
+	const char *cur = value.data();
+	const char *end = value.data() + value.size();
+
+	out.append(key);
+	out.append(" =\n\t");
+
+	while (true) {
+		const char *newline = ckv::find_newline(cur, end);
+
+		if (newline == end) {
+			break;
+		}
+
+		out.append(cur, newline + 1 - cur);
+		out.push_back('\t');
+		cur = newline + 1;
+	}
+
+	out.append(cur, end - cur);
+	out.push_back('\n');
+}
+
+/**
+ * \param out
+ *  Stream to write to, which has to outlive the Writer.
+ *
+ * \param buffer_size
+ *  Bytes buffered before writing to out.
+ */
+ckv::Writer::Writer(std::ostream &out, std::size_t buffer_size)
+	: out(&out), buffer_size(buffer_size)
+{
+	buffer.reserve(buffer_size);
+}
+
+/**
+ * \param fd
+ *  File descriptor to write to. It is neither closed
+ *  nor synced by the Writer.
+ *
+ * \param buffer_size
+ *  Bytes buffered before writing to fd.
+ */
+ckv::Writer::Writer(int fd, std::size_t buffer_size)
+	: fd(fd), buffer_size(buffer_size)
+{
+	buffer.reserve(buffer_size);
+}
+
+ckv::Writer::~Writer()
+{
+	try {
+		flush();
+	} catch (...) {
+		// only flush() reports errors
+	}
+}
+
+/**
+ * Writes data to the stream or file descriptor.
+ *
+ * \throws FileWriteFailed
+ * \throws InvalidOutputStream
+ */
+void ckv::Writer::write_out(std::string_view data)
+{
+	if (out != nullptr) {
+		out->write(data.data(), data.size());
+
+		if (!*out) {
+			throw ckv::InvalidOutputStream();
+		}
+		return;
+	}
+
+	while (!data.empty()) {
+		ssize_t written = ::write(fd, data.data(), data.size());
+
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw ckv::FileWriteFailed("descriptor " + std::to_string(fd));
+		}
+
+		data.remove_prefix(written);
+	}
+}
+
+/**
+ * Writes buffer, holding the start of a block, followed by
+ * value and the end of the block with a single writev()
+ * per IOV_MAX lines of value, so value isn't copied.
+ *
+ * \throws FileWriteFailed
+ */
+void ckv::Writer::write_large_value(std::string_view value)
+{
+	std::vector<iovec> iov;
+	const char *cur = value.data();
+	const char *end = value.data() + value.size();
+
+	iov.reserve(IOV_MAX);
+	iov.push_back(iovec{buffer.data(), buffer.size()});
+
+	while (true) {
+		const char *newline = ckv::find_newline(cur, end);
+		const char *piece_end = newline == end ? end : newline + 1;
+
+		iov.push_back(iovec{const_cast<char *>(cur), static_cast<std::size_t>(piece_end - cur)});
+		cur = piece_end;
+
+		if (newline == end) {
+			break;
+		}
+
+		iov.push_back(iovec{continuation_tab, 1});
+
+		if (iov.size() + 2 > IOV_MAX && !writev_all(fd, iov)) {
+			throw ckv::FileWriteFailed("descriptor " + std::to_string(fd));
+		}
+	}
+
+	iov.push_back(iovec{block_end, 1});
+
+	if (!writev_all(fd, iov)) {
+		throw ckv::FileWriteFailed("descriptor " + std::to_string(fd));
+	}
+
+	buffer.clear();
+}
+
+/**
+ * Writes the block of key and value, after a blank line
+ * unless it is the first one.
+ *
+ * \throws FileWriteFailed
+ * \throws InvalidOutputStream
+ */
+void ckv::Writer::write(std::string_view key, std::string_view value)
+{
+	if (!first_block) {
+		buffer.push_back('\n');
+	}
+	first_block = false;
+
+	if (fd >= 0 && value.size() >= buffer_size / 2 && has_long_lines(value)) {
+		buffer.append(key);
+		buffer.append(" =\n\t");
+		write_large_value(value);
+		return;
+	}
+
+	ckv::encode_block(buffer, key, value);
+
+	if (buffer.size() >= buffer_size) {
+		flush();
+	}
+}
+
+/**
+ * Writes out everything buffered, and flushes the stream
+ * if writing to one.
+ *
+ * \throws FileWriteFailed
+ * \throws InvalidOutputStream
+ */
+void ckv::Writer::flush()
+{
+	if (!buffer.empty()) {
+		write_out(buffer);
+		buffer.clear();
+	}
+
+	if (out != nullptr && !out->flush()) {
+		throw ckv::InvalidOutputStream();
+	}
+}
@@ -0,0 +1,73 @@
+#ifndef __CKV_WRITER_HPP__
+#define __CKV_WRITER_HPP__
+
+/** \file */
+
+/// \cond HEADERS
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+/// \endcond
+
+namespace ckv {
+
+void encode_block(std::string &out, std::string_view key, std::string_view value);
+
+/**
+ * Writes keys and values as a ckv file, to an ostream or
+ * straight to a file descriptor.
+ *
+ * Blocks are encoded into a buffer which is written out
+ * only when full, so writing many small values costs a
+ * few large writes. When writing to a file descriptor,
+ * values larger than half the buffer and made of long
+ * lines aren't copied but handed to writev() a line at
+ * a time.
+ *
+ * Blocks are separated by a blank line. Whatever is still
+ * buffered is written out by the destructor, but errors
+ * are only reported by flush().
+ */
+class Writer {
+private:
+	std::ostream *out = nullptr; /**< Stream written to, if any */
+	int fd = -1;                 /**< File descriptor written to otherwise */
+	std::string buffer;          /**< Blocks not written out yet */
+	std::size_t buffer_size;     /**< Size of buffer that triggers a write */
+	bool first_block = true;     /**< false once a block was written */
+
+	void write_out(std::string_view data);
+	void write_large_value(std::string_view value);
+
+public:
+	static constexpr std::size_t default_buffer_size = 1 << 16;
+
+	explicit Writer(std::ostream &out, std::size_t buffer_size = default_buffer_size);
+	explicit Writer(int fd, std::size_t buffer_size = default_buffer_size);
+	~Writer();
+
+	Writer(const Writer &) = delete;
+	Writer &operator=(const Writer &) = delete;
+
+	void write(std::string_view key, std::string_view value);
+	void flush();
+
+	/**
+	 * Writes every key and value of map, which can be
+	 * anything iterating over pairs of strings.
+	 *
+	 * \throws FileWriteFailed
+	 * \throws InvalidOutputStream
+	 */
+	template <typename Map>
+	void write_all(const Map &map) {
+		for (auto &pair : map) {
+			write(pair.first, pair.second);
+		}
+	}
+};
+
+}
+
+#endif /* __CKV_WRITER_HPP__ */
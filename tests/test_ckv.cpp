@@ -1,12 +1,37 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <ctime>
+#include <fcntl.h>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include "print_type_name.hpp"
 #include <ckv.hpp>
+#include <ckv_async.hpp>
+#include <ckv_bind.hpp>
+#include <ckv_convert.hpp>
+#include <ckv_decompress.hpp>
+#include <ckv_directory.hpp>
+#include <ckv_layered.hpp>
+#include <ckv_scan.hpp>
+#include <ckv_snapshot.hpp>
+#include <ckv_stats.hpp>
+#include <ckv_watcher.hpp>
+#include <ckv_writer.hpp>
 #include <sstream>
+#include <thread>
+#include <unistd.h>
 #include <unordered_map>
+#include <vector>
+#ifdef CKV_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 
 #define RESET       "\033[0m"
@@ -113,14 +138,46 @@ namespace sample_ckv_files {
 	void run_tests();
 	void run_tests_for_exception_checks();
 	void run_tests_for_import_to_map();
+	void run_tests_for_visit();
+	void run_tests_for_import_to_flat_map();
 	void run_tests_for_get_value_for_key();
+	void run_tests_for_get_values_for_keys();
+	void run_tests_for_try_get_value_for_key();
 	void run_tests_for_set_value_for_key();
 	void run_tests_for_remove_key();
+	void run_tests_for_in_place_writes();
+	void run_tests_for_atomic_writes();
+	void run_tests_for_compile();
+	void run_tests_for_block_parser();
+	void run_tests_for_key_index();
+	void run_tests_for_snapshot();
+	void run_tests_for_watcher();
+	void run_tests_for_load_directory();
+	void run_tests_for_parallel_parse();
+	void run_tests_for_stats();
+	void run_tests_for_writer();
+	void run_tests_for_typed_getters();
+	void run_tests_for_bind();
+	void run_tests_for_lazy_decoding();
+	void run_tests_for_async();
+	void run_tests_for_compressed_files();
+	void run_tests_for_layered_config();
+	void run_tests_for_ordered_queries();
+	void run_tests_for_journal();
+}
+
+/*
+ * Tests for code that doesn't need a ckv file
+ */
+namespace internals {
+	void run_tests();
+	void run_tests_for_find_newline();
 }
 
 int main()
 {
 	sample_ckv_files::run_tests();
+	internals::run_tests();
 	return (EXIT_SUCCESS);
 }
 
@@ -229,9 +286,32 @@ void hash_map_test(std::string file_name, std::unordered_map<std::string, std::s
 void sample_ckv_files::run_tests()
 {
 	sample_ckv_files::run_tests_for_import_to_map();
+	sample_ckv_files::run_tests_for_visit();
+	sample_ckv_files::run_tests_for_import_to_flat_map();
 	sample_ckv_files::run_tests_for_get_value_for_key();
+	sample_ckv_files::run_tests_for_get_values_for_keys();
+	sample_ckv_files::run_tests_for_try_get_value_for_key();
 	sample_ckv_files::run_tests_for_set_value_for_key();
 	sample_ckv_files::run_tests_for_remove_key();
+	sample_ckv_files::run_tests_for_in_place_writes();
+	sample_ckv_files::run_tests_for_atomic_writes();
+	sample_ckv_files::run_tests_for_compile();
+	sample_ckv_files::run_tests_for_block_parser();
+	sample_ckv_files::run_tests_for_key_index();
+	sample_ckv_files::run_tests_for_snapshot();
+	sample_ckv_files::run_tests_for_watcher();
+	sample_ckv_files::run_tests_for_load_directory();
+	sample_ckv_files::run_tests_for_parallel_parse();
+	sample_ckv_files::run_tests_for_stats();
+	sample_ckv_files::run_tests_for_writer();
+	sample_ckv_files::run_tests_for_typed_getters();
+	sample_ckv_files::run_tests_for_bind();
+	sample_ckv_files::run_tests_for_lazy_decoding();
+	sample_ckv_files::run_tests_for_async();
+	sample_ckv_files::run_tests_for_compressed_files();
+	sample_ckv_files::run_tests_for_layered_config();
+	sample_ckv_files::run_tests_for_ordered_queries();
+	sample_ckv_files::run_tests_for_journal();
 }
 
 void sample_ckv_files::run_tests_for_import_to_map()
@@ -265,6 +345,134 @@ void sample_ckv_files::run_tests_for_import_to_map()
 	}
 }
 
+void sample_ckv_files::run_tests_for_visit()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::visit():\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/general.ckv";
+
+	print_testing_file(file_name);
+
+	std::vector<std::pair<std::string, std::string>> expected_pairs = {
+		{"HOW_TO_OPEN_EDITOR", "vim [FILE_TO_OPEN]"},
+		{"BOILERPLATE", "general.cpp"},
+		{"COMPILE", "g++ [INSTANCE] -o [OUTPUT_PATH]"},
+		{"EXECUTE", "[OUTPUT_PATH]"}
+	};
+
+	std::vector<std::pair<std::string, std::string>> visited_pairs;
+	bool test_result = true;
+
+	ckv::ConfigFile file(file_name);
+
+	try {
+		file.visit([&visited_pairs](std::string_view key, std::string_view value) {
+			visited_pairs.emplace_back(key, value);
+			return true;
+		});
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::ConfigFile::visit(): %s", e.what());
+	}
+
+	if (visited_pairs != expected_pairs) {
+		std::cout << "Pairs visited don't match the file, in order\n";
+		test_result = false;
+	}
+
+	visited_pairs.clear();
+
+	// stops as soon as the visitor returns false
+	try {
+		file.visit([&visited_pairs](std::string_view key, std::string_view value) {
+			visited_pairs.emplace_back(key, value);
+			return key != "BOILERPLATE";
+		});
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::ConfigFile::visit(): %s", e.what());
+	}
+
+	if (visited_pairs.size() != 2) {
+		std::cout << "Expected visit to stop after 2 keys but it visited " << visited_pairs.size() << "\n";
+		test_result = false;
+	}
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_import_to_flat_map()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::import_to_flat_map():\n" << BOLD_OFF;
+
+	for (auto file_name : {"sample_ckv_files/general.ckv", "sample_ckv_files/wierdly_formatted.ckv"}) {
+		print_testing_file(file_name);
+
+		bool test_result = true;
+		ckv::ConfigFile file(file_name);
+
+		try {
+			auto expected_map = file.import_to_map();
+			ckv::FlatMap flat_map = file.import_to_flat_map();
+
+			if (flat_map.size() != expected_map.size()) {
+				std::cout << "Expected " << expected_map.size() << " keys but found " << flat_map.size() << "\n";
+				test_result = false;
+			}
+
+			for (auto &pair : expected_map) {
+				auto it = flat_map.find(pair.first);
+
+				if (it == flat_map.end() || it->second != pair.second) {
+					std::cout << "Wrong or no value found for key \"" << pair.first << "\"\n";
+					test_result = false;
+				}
+			}
+
+			for (auto &pair : flat_map) {
+				if (expected_map.count(std::string(pair.first)) == 0) {
+					std::cout << "Unexpected key \"" << pair.first << "\"\n";
+					test_result = false;
+				}
+			}
+
+			if (flat_map.count("NOT_A_KEY") != 0) {
+				std::cout << "Found key \"NOT_A_KEY\" which isn't in the file\n";
+				test_result = false;
+			}
+		} catch(std::exception &e) {
+			EXCEPTION("Exception occured with ckv::ConfigFile::import_to_flat_map(): %s", e.what());
+			test_result = false;
+		}
+
+		print_test_results(test_result, file_name);
+	}
+
+	std::string test_name = "ckv::FlatMap";
+
+	std::cout << "\n" << BOLD_ON << BLUE << "---> Testing " << test_name << RESET << BOLD_OFF << "\n";
+
+	// enough keys to make it grow a few times
+	bool test_result = true;
+	ckv::FlatMap flat_map;
+
+	for (int i = 0; i < 1000; i++) {
+		flat_map.insert("KEY_" + std::to_string(i), std::to_string(i));
+	}
+
+	if (flat_map.insert("KEY_7", "other")) {
+		std::cout << "Inserting an existing key replaced it\n";
+		test_result = false;
+	}
+
+	for (int i = 0; i < 1000; i++) {
+		if (flat_map.at("KEY_" + std::to_string(i)) != std::to_string(i)) {
+			std::cout << "Wrong value for key \"KEY_" << i << "\"\n";
+			test_result = false;
+		}
+	}
+
+	print_test_results(test_result, test_name);
+}
+
 void sample_ckv_files::run_tests_for_get_value_for_key()
 {
 	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::get_value_for_key():\n" << BOLD_OFF;
@@ -296,6 +504,142 @@ void sample_ckv_files::run_tests_for_get_value_for_key()
 	}
 }
 
+void sample_ckv_files::run_tests_for_get_values_for_keys()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::get_values_for_keys():\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/wierdly_formatted.ckv";
+
+	print_testing_file(file_name);
+
+	std::unordered_map<std::string, std::string> expected_values = {
+		{"HOW_ARE_YOU", "\nFINE\n"},
+		{"LIKE_VIM", "YES}"},
+		{"LIKE_LINUX", "\n\n\n\nhello far awayno spaces"}
+	};
+
+	std::unordered_map<std::string, std::string> values;
+	bool test_result = true;
+
+	ckv::ConfigFile file(file_name);
+
+	try {
+		values = file.get_values_for_keys({"LIKE_LINUX", "HOW_ARE_YOU", "LIKE_VIM"});
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::ConfigFile::get_values_for_keys(): %s", e.what());
+	}
+
+	if (values != expected_values) {
+		std::cout << "Values returned by ckv::ConfigFile::get_values_for_keys() don't match\n";
+		test_result = false;
+	}
+
+	try {
+		file.get_values_for_keys({"LIKE_VIM", "NOT_A_KEY"});
+		std::cout << "Expected exception ckv::KeyNotFound but none occured\n";
+		test_result = false;
+	} catch(ckv::KeyNotFound &e) {
+	} catch(std::exception &e) {
+		std::cout << "Expected exception ckv::KeyNotFound but some other exception occured with message: "
+			<< e.what() << "\n";
+		test_result = false;
+	}
+
+	// reaching the end of the file must not be taken for the empty key
+	try {
+		ckv::ConfigFile(file_name).get_values_for_keys({""});
+		std::cout << "Expected exception ckv::KeyNotFound for an empty key but none occured\n";
+		test_result = false;
+	} catch(ckv::KeyNotFound &e) {
+	} catch(std::exception &e) {
+		std::cout << "Expected exception ckv::KeyNotFound for an empty key but some other exception occured with message: "
+			<< e.what() << "\n";
+		test_result = false;
+	}
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_try_get_value_for_key()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::try_get_value_for_key():\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_try_get_value_for_key.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+	std::string buffer;
+
+	auto expect_result = [&test_result, &buffer](ckv::ConfigFile &file, std::string key,
+			ckv::ErrorCode expected_error, unsigned int expected_line, std::string expected_value) {
+		ckv::LookupResult result;
+
+		try {
+			result = file.try_get_value_for_key(key, buffer);
+		} catch(std::exception &e) {
+			std::cout << "ckv::ConfigFile::try_get_value_for_key() threw for key \"" << key << "\": "
+				<< e.what() << "\n";
+			test_result = false;
+			return;
+		}
+
+		if (result.error != expected_error || result.line != expected_line
+				|| bool(result) != (expected_error == ckv::ErrorCode::None)
+				|| (result && result.value != expected_value)) {
+			std::cout << "Unexpected result for key \"" << key << "\": error " << int(result.error)
+				<< ", line " << result.line << ", value \"" << result.value << "\"\n";
+			test_result = false;
+		}
+	};
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "FIRST =\n\tone\n\nSECOND =\n\ttwo\n\tlines\n\nTHIRD\n";
+	}
+
+	ckv::ConfigFile file(file_name);
+
+	expect_result(file, "FIRST", ckv::ErrorCode::None, 1, "one");
+	expect_result(file, "SECOND", ckv::ErrorCode::None, 4, "two\nlines");
+
+	// the syntax error is past every key that exists
+	expect_result(file, "NOT_A_KEY", ckv::ErrorCode::MissingEqualTo, 8, "");
+
+	if (file.get_err_line() != 8) {
+		std::cout << "Expected error line 8 but found " << file.get_err_line() << "\n";
+		test_result = false;
+	}
+
+	// the throwing version reports the same error
+	try {
+		file.get_value_for_key("NOT_A_KEY");
+		std::cout << "Expected exception ckv::MissingEqualTo but none occured\n";
+		test_result = false;
+	} catch(ckv::MissingEqualTo &e) {
+	} catch(std::exception &e) {
+		std::cout << "Expected exception ckv::MissingEqualTo but some other exception occured with message: "
+			<< e.what() << "\n";
+		test_result = false;
+	}
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "FIRST =\n\tone\n";
+	}
+
+	expect_result(file, "NOT_A_KEY", ckv::ErrorCode::KeyNotFound, 0, "");
+	expect_result(file, "FIRST", ckv::ErrorCode::None, 1, "one");
+
+	std::remove(file_name.c_str());
+
+	ckv::ConfigFile missing_file("sample_ckv_files/does_not_exist.ckv");
+
+	expect_result(missing_file, "FIRST", ckv::ErrorCode::FileOpenFailed, 0, "");
+
+	print_test_results(test_result, file_name);
+}
+
 void sample_ckv_files::run_tests_for_set_value_for_key()
 {
 	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::set_value_for_key():\n" << BOLD_OFF;
@@ -391,3 +735,2039 @@ void sample_ckv_files::run_tests_for_remove_key()
 
 	print_test_results(test_result, file_name);
 }
+
+void sample_ckv_files::run_tests_for_in_place_writes()
+{
+	std::cout << BOLD_ON << "\n>>> Testing in place writes of ckv::ConfigFile:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_in_place_writes.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "FIRST =\n\tone\n\n    SECOND =\n\ttwo\n+ joined\n\nTHIRD =\n\tthree\n";
+	}
+
+	auto expect_contents = [&file_name, &test_result](std::string expected_contents) {
+		std::ifstream in(file_name);
+		std::stringstream contents;
+		contents << in.rdbuf();
+
+		if (contents.str() != expected_contents) {
+			std::cout << "Expected file contents:\n" << expected_contents
+				<< "but found:\n" << contents.str();
+			test_result = false;
+		}
+	};
+
+	ckv::ConfigFile file(file_name);
+	file.set_write_mode(ckv::WriteMode::InPlace);
+
+	try {
+		file.set_value_for_key("SECOND", "2\nlines");
+		expect_contents("FIRST =\n\tone\n\nSECOND =\n\t2\n\tlines\n\nTHIRD =\n\tthree\n");
+
+		file.set_value_for_key("FIRST", "1st");
+		expect_contents("FIRST =\n\t1st\n\nSECOND =\n\t2\n\tlines\n\nTHIRD =\n\tthree\n");
+
+		file.set_value_for_key("FOURTH", "four");
+		expect_contents("FIRST =\n\t1st\n\nSECOND =\n\t2\n\tlines\n\nTHIRD =\n\tthree\n\nFOURTH =\n\tfour\n");
+
+		file.remove_key("SECOND");
+		expect_contents("FIRST =\n\t1st\n\nTHIRD =\n\tthree\n\nFOURTH =\n\tfour\n");
+
+		file.remove_key("FOURTH");
+		expect_contents("FIRST =\n\t1st\n\nTHIRD =\n\tthree\n\n");
+
+		if (file.get_value_for_key("THIRD") != "three") {
+			std::cout << "Value of untouched key \"THIRD\" changed\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with in place writes: %s", e.what());
+		test_result = false;
+	}
+
+	// by default, a file shrinking isn't truncated under readers
+	// mapping it, which would kill them with SIGBUS
+	std::atomic<bool> writing{true};
+	std::thread reader([&file_name, &writing, &test_result]() {
+		while (writing) {
+			try {
+				ckv::ConfigFile(file_name).import_to_map();
+			} catch(std::exception &e) {
+				EXCEPTION("Exception occured reading during writes: %s", e.what());
+				test_result = false;
+				return;
+			}
+		}
+	});
+
+	try {
+		ckv::ConfigFile writer(file_name);
+		std::string big(1 << 20, 'x');
+
+		for (int i = 0; i < 10; i++) {
+			writer.set_value_for_key("ZBIG", big);
+			writer.remove_key("ZBIG");
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with writes during reads: %s", e.what());
+		test_result = false;
+	}
+
+	writing = false;
+	reader.join();
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_atomic_writes()
+{
+	std::cout << BOLD_ON << "\n>>> Testing atomic writes of ckv::ConfigFile:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_atomic_writes.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "FIRST =\n\tone\n\nSECOND =\n\ttwo\n";
+	}
+
+	ckv::ConfigFile file(file_name);
+	file.set_write_mode(ckv::WriteMode::Atomic);
+
+	std::ifstream old_file(file_name);
+
+	try {
+		file.set_value_for_key("FIRST", "changed");
+		file.remove_key("SECOND");
+		file.set_value_for_key("THIRD", "three");
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with atomic writes: %s", e.what());
+		test_result = false;
+	}
+
+	// a reader that opened the file before keeps seeing the old one whole
+	std::stringstream old_contents;
+	old_contents << old_file.rdbuf();
+
+	if (old_contents.str() != "FIRST =\n\tone\n\nSECOND =\n\ttwo\n") {
+		std::cout << "File open before the writes changed under the reader\n";
+		test_result = false;
+	}
+
+	std::ifstream new_file(file_name);
+	std::stringstream new_contents;
+	new_contents << new_file.rdbuf();
+
+	if (new_contents.str() != "FIRST =\n\tchanged\n\nTHIRD =\n\tthree\n") {
+		std::cout << "Expected file contents after the writes don't match, found:\n" << new_contents.str();
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_compile()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::compile():\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_compile.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	{
+		std::ifstream in("sample_ckv_files/wierdly_formatted.ckv");
+		std::ofstream out(file_name, std::ios::trunc);
+		out << in.rdbuf();
+	}
+
+	std::unordered_map<std::string, std::string> expected_hash_map = {
+		{"HOW_ARE_YOU", "\nFINE\n"},
+		{"HOW_WAS_YOUR_DAY", " GOOD"},
+		{"LIKE_VIM", "YES}"},
+		{"LIKE_LINUX", "\n\n\n\nhello far awayno spaces"}
+	};
+
+	try {
+		ckv::ConfigFile(file_name).compile();
+
+		ckv::ConfigFile file(file_name);
+
+		if (file.import_to_map() != expected_hash_map || !file.uses_compiled()) {
+			std::cout << "Expected ckv::ConfigFile::import_to_map() to read the same map from the snapshot\n";
+			test_result = false;
+		}
+
+		if (file.get_value_for_key("LIKE_LINUX") != expected_hash_map["LIKE_LINUX"]) {
+			std::cout << "Wrong value for key \"LIKE_LINUX\" from the snapshot\n";
+			test_result = false;
+		}
+
+		// writing makes the snapshot stale, back to the text
+		file.set_value_for_key("LIKE_VIM", "NO");
+
+		if (file.get_value_for_key("LIKE_VIM") != "NO" || file.uses_compiled()) {
+			std::cout << "Stale snapshot used after the file changed\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with compiled snapshots: %s", e.what());
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+	std::remove(ckv::compiled_path_for(file_name).c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_block_parser()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::BlockParser:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/wierdly_formatted.ckv";
+
+	print_testing_file(file_name);
+
+	std::unordered_map<std::string, std::string> expected_values = {
+		{"HOW_ARE_YOU", "\nFINE\n"},
+		{"HOW_WAS_YOUR_DAY", " GOOD"},
+		{"LIKE_VIM", "YES}"},
+		{"LIKE_LINUX", "\n\n\n\nhello far awayno spaces"}
+	};
+
+	bool test_result = true;
+	size_t keys_found = 0;
+
+	try {
+		ckv::MappedFile mapping;
+		mapping.open(file_name);
+
+		std::string_view contents = mapping.view();
+		ckv::BlockParser parser(contents);
+		std::string buffer;
+
+		auto in_mapping = [&contents](std::string_view view) {
+			return view.data() >= contents.data()
+				&& view.data() + view.size() <= contents.data() + contents.size();
+		};
+
+		while (!parser.at_end()) {
+			std::string_view key = parser.out_block_parse();
+
+			if (key.empty()) {
+				break;
+			}
+
+			std::string_view raw_value = parser.in_block_parse();
+			std::string_view value = ckv::decode_value(raw_value, buffer);
+			keys_found++;
+
+			if (!in_mapping(key)) {
+				std::cout << "Key \"" << key << "\" was copied out of the mapping\n";
+				test_result = false;
+			}
+
+			if (raw_value.find('\n') == std::string_view::npos && !in_mapping(value)) {
+				std::cout << "Single line value for key \"" << key << "\" was copied out of the mapping\n";
+				test_result = false;
+			}
+
+			if (expected_values[std::string(key)] != value) {
+				std::cout << "Expected value \"" << expected_values[std::string(key)] << "\" for key \""
+					<< key << "\" but found value \"" << value << "\"\n";
+				test_result = false;
+			}
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::BlockParser: %s", e.what());
+		test_result = false;
+	}
+
+	if (keys_found != expected_values.size()) {
+		std::cout << "Expected " << expected_values.size() << " keys but found " << keys_found << "\n";
+		test_result = false;
+	}
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_key_index()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile key index:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_key_index.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	auto write_file = [&file_name](std::string contents) {
+		std::ofstream out(file_name, std::ios::trunc);
+		out << contents;
+	};
+
+	auto expect_value = [&test_result](ckv::ConfigFile &file, std::string key, std::string expected_value) {
+		std::string value;
+
+		try {
+			value = file.get_value_for_key(key);
+		} catch(std::exception &e) {
+			EXCEPTION("Exception occured with ckv::ConfigFile::get_value_for_key(): %s", e.what());
+		}
+
+		if (value != expected_value) {
+			std::cout << "Expected value \"" << expected_value << "\" for key \"" << key
+				<< "\" but found value \"" << value << "\"\n";
+			test_result = false;
+		}
+	};
+
+	write_file("FIRST =\n\tone\n\nSECOND =\n\ttwo\n");
+
+	ckv::ConfigFile file(file_name);
+
+	// looked up twice, the second time from the index
+	expect_value(file, "SECOND", "two");
+	expect_value(file, "FIRST", "one");
+	expect_value(file, "SECOND", "two");
+
+	// file changes size, index has to be dropped
+	write_file("FIRST =\n\tchanged\n\nSECOND =\n\ttwo\n\nTHIRD =\n\tthree\n");
+
+	expect_value(file, "FIRST", "changed");
+	expect_value(file, "THIRD", "three");
+
+	// an empty key is never in a file, reaching the end must not match it
+	std::string buffer;
+
+	if (ckv::ConfigFile(file_name).try_get_value_for_key("", buffer).error != ckv::ErrorCode::KeyNotFound) {
+		std::cout << "Expected ckv::ErrorCode::KeyNotFound for an empty key\n";
+		test_result = false;
+	}
+
+	try {
+		ckv::ConfigFile(file_name).get_value_for_key("");
+		std::cout << "Expected exception ckv::KeyNotFound for an empty key but none occured\n";
+		test_result = false;
+	} catch(ckv::KeyNotFound &e) {
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::ConfigFile::get_value_for_key(\"\"): %s", e.what());
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_snapshot()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::Snapshot and ckv::SnapshotReloader:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_snapshot.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	auto write_file = [&file_name](std::string contents) {
+		std::ofstream out(file_name, std::ios::trunc);
+		out << contents;
+	};
+
+	auto expect_value = [&test_result](const ckv::Snapshot &snapshot, std::string key, std::string expected_value) {
+		std::string_view value;
+
+		if (!snapshot.find(key, value) || value != expected_value) {
+			std::cout << "Expected value \"" << expected_value << "\" for key \"" << key
+				<< "\" but found value \"" << value << "\"\n";
+			test_result = false;
+		}
+	};
+
+	write_file("FIRST =\n\tone\n\nSECOND =\n\ttwo\n");
+
+	try {
+		ckv::SnapshotReloader reloader(file_name);
+		ckv::SnapshotReloader::Reader reader(reloader);
+		std::shared_ptr<const ckv::Snapshot> old_snapshot = reloader.current();
+
+		expect_value(reader.get(), "FIRST", "one");
+
+		if (reloader.reload()) {
+			std::cout << "ckv::SnapshotReloader::reload() published a snapshot of an unchanged file\n";
+			test_result = false;
+		}
+
+		write_file("FIRST =\n\tchanged\n\nSECOND =\n\ttwo\n");
+
+		// readers keep reading while the reload happens
+		std::atomic<bool> stop{false};
+		std::atomic<bool> torn_read{false};
+		std::vector<std::thread> readers;
+
+		for (int i = 0; i < 4; i++) {
+			readers.emplace_back([&reloader, &stop, &torn_read]() {
+				ckv::SnapshotReloader::Reader thread_reader(reloader);
+
+				while (!stop) {
+					std::string_view value = thread_reader.get().get_value_for_key("FIRST");
+
+					if (value != "one" && value != "changed") {
+						torn_read = true;
+					}
+				}
+			});
+		}
+
+		if (!reloader.reload()) {
+			std::cout << "ckv::SnapshotReloader::reload() didn't publish a snapshot of a changed file\n";
+			test_result = false;
+		}
+
+		stop = true;
+		for (auto &thread : readers) {
+			thread.join();
+		}
+
+		if (torn_read) {
+			std::cout << "A reader saw a value from neither snapshot\n";
+			test_result = false;
+		}
+
+		expect_value(reader.get(), "FIRST", "changed");
+		expect_value(*old_snapshot, "FIRST", "one");
+
+		// a file that fails to parse leaves the last snapshot in place
+		write_file("FIRST =\n\tbroken\n\nSECOND\n");
+
+		try {
+			reloader.reload();
+			std::cout << "Expected exception ckv::MissingEqualTo but none occured\n";
+			test_result = false;
+		} catch(ckv::MissingEqualTo &e) {
+		}
+
+		expect_value(reader.get(), "FIRST", "changed");
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::SnapshotReloader: %s", e.what());
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_watcher()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::Watcher:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_watcher.ckv";
+	std::string other_file_name = "./sample_ckv_files/for_testing_watcher_other.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+	std::mutex changes_mutex;
+	std::condition_variable changes_cond;
+	std::vector<ckv::Change> changes;
+
+	auto wait_for_change = [&]() {
+		std::unique_lock<std::mutex> lock(changes_mutex);
+		ckv::Change change;
+
+		if (!changes_cond.wait_for(lock, std::chrono::seconds(5), [&changes]() { return !changes.empty(); })) {
+			std::cout << "No change reported by ckv::Watcher\n";
+			test_result = false;
+			return change;
+		}
+
+		change = changes.front();
+		changes.erase(changes.begin());
+		return change;
+	};
+
+	auto expect_keys = [&test_result](std::string what, std::vector<std::string> keys, std::vector<std::string> expected_keys) {
+		std::sort(keys.begin(), keys.end());
+
+		if (keys != expected_keys) {
+			std::cout << "Unexpected " << what << " keys:";
+			for (auto &key : keys) {
+				std::cout << " " << key;
+			}
+			std::cout << "\n";
+			test_result = false;
+		}
+	};
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "FIRST =\n\tone\n\nSECOND =\n\ttwo\n";
+	}
+
+	{
+		std::ofstream out(other_file_name, std::ios::trunc);
+		out << "OTHER =\n\tvalue\n";
+	}
+
+	try {
+		ckv::Watcher watcher(std::chrono::milliseconds(200));
+		ckv::ConfigFile file(file_name);
+
+		watcher.add(file_name);
+		// same directory spelled differently, file_name must still be seen
+		watcher.add(other_file_name);
+		watcher.subscribe([&](const ckv::Change &change) {
+			std::lock_guard<std::mutex> lock(changes_mutex);
+			changes.push_back(change);
+			changes_cond.notify_one();
+		});
+
+		// saved the way editors do, by renaming a new file over it
+		file.set_write_mode(ckv::WriteMode::Atomic);
+		file.set_value_for_key("FIRST", "changed");
+		file.set_value_for_key("THIRD", "three");
+
+		ckv::Change change = wait_for_change();
+
+		// both saves came in the same burst
+		expect_keys("added", change.added, {"THIRD"});
+		expect_keys("modified", change.modified, {"FIRST"});
+		expect_keys("removed", change.removed, {});
+
+		if (change.snapshot == nullptr || change.snapshot->get_value_for_key("FIRST") != "changed"
+				|| watcher.current(file_name) != change.snapshot) {
+			std::cout << "Snapshot passed with the change doesn't have the new value\n";
+			test_result = false;
+		}
+
+		// written in place this time
+		file.set_write_mode(ckv::WriteMode::InPlace);
+		file.remove_key("SECOND");
+
+		change = wait_for_change();
+
+		expect_keys("added", change.added, {});
+		expect_keys("modified", change.modified, {});
+		expect_keys("removed", change.removed, {"SECOND"});
+
+		// writes to the journal are changes of the file too
+		file.set_write_mode(ckv::WriteMode::Journal);
+		file.set_value_for_key("JOURNALED", "yes");
+
+		change = wait_for_change();
+
+		expect_keys("added", change.added, {"JOURNALED"});
+		file.compact();
+
+		{
+			std::ofstream out(file_name, std::ios::app);
+			out << "\nBROKEN\n";
+		}
+
+		change = wait_for_change();
+
+		if (change.error.empty() || change.err_line == 0) {
+			std::cout << "Expected a parse error to be reported\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::Watcher: %s", e.what());
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+	std::remove(other_file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_load_directory()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::load_directory():\n" << BOLD_OFF;
+
+	std::string dir_name = "sample_ckv_files/for_testing_load_directory";
+
+	print_testing_file(dir_name);
+
+	bool test_result = true;
+
+	auto write_file = [&dir_name](std::string name, std::string contents) {
+		std::ofstream out(dir_name + "/" + name, std::ios::trunc);
+		out << contents;
+	};
+
+	std::filesystem::remove_all(dir_name);
+	std::filesystem::create_directories(dir_name + "/nested");
+
+	for (int i = 0; i < 50; i++) {
+		write_file("file_" + std::to_string(i) + ".ckv", "INDEX =\n\t" + std::to_string(i) + "\n");
+	}
+
+	write_file("nested/deeper.ckv", "NESTED =\n\tyes\n");
+	write_file("broken.ckv", "FIRST =\n\tone\n\nSECOND\n");
+	write_file("not_a_ckv_file.txt", "SECOND\n");
+
+	try {
+		ckv::ThreadPool pool(4);
+		ckv::LoadedDirectory loaded = ckv::load_directory(dir_name, true, pool);
+
+		if (loaded.files.size() != 51) {
+			std::cout << "Expected 51 files loaded but found " << loaded.files.size() << "\n";
+			test_result = false;
+		}
+
+		for (int i = 0; i < 50; i++) {
+			auto snapshot = loaded.find_file(dir_name + "/file_" + std::to_string(i) + ".ckv");
+
+			if (snapshot == nullptr || snapshot->get_value_for_key("INDEX") != std::to_string(i)) {
+				std::cout << "file_" << i << ".ckv wasn't loaded right\n";
+				test_result = false;
+			}
+		}
+
+		if (loaded.find_file(dir_name + "/nested/deeper.ckv") == nullptr) {
+			std::cout << "File in a subdirectory wasn't loaded\n";
+			test_result = false;
+		}
+
+		if (loaded.errors.size() != 1 || loaded.errors[0].file_path != dir_name + "/broken.ckv"
+				|| loaded.errors[0].err_line != 4) {
+			std::cout << "Expected a single error at line 4 of broken.ckv\n";
+			test_result = false;
+		}
+
+		loaded = ckv::load_directory(dir_name, false, pool);
+
+		if (loaded.files.size() != 50) {
+			std::cout << "Expected 50 files loaded without recursion but found " << loaded.files.size() << "\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::load_directory(): %s", e.what());
+		test_result = false;
+	}
+
+	try {
+		ckv::load_directory(dir_name + "/does_not_exist");
+		std::cout << "Expected exception ckv::FileOpenFailed but none occured\n";
+		test_result = false;
+	} catch(ckv::FileOpenFailed &e) {
+	}
+
+	std::filesystem::remove_all(dir_name);
+
+	print_test_results(test_result, dir_name);
+}
+
+void sample_ckv_files::run_tests_for_parallel_parse()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ParseMode::Parallel:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_parallel_parse.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+	std::string contents;
+
+	// large enough to be cut in chunks, with values
+	// spanning lines and keys occurring twice
+	for (int i = 0; i < 60000; i++) {
+		contents += "KEY_" + std::to_string(i % 45000) + " =\n\tvalue " + std::to_string(i) + "\n";
+		if (i % 3 == 0) {
+			contents += "\tsecond line\n+ joined " + random_string(40) + "\n";
+		}
+		contents += "\n";
+	}
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << contents;
+	}
+
+	try {
+		ckv::ConfigFile serial_file(file_name), parallel_file(file_name);
+
+		parallel_file.set_parse_mode(ckv::ParseMode::Parallel);
+
+		if (parallel_file.import_to_map() != serial_file.import_to_map()) {
+			std::cout << "ckv::ConfigFile::import_to_map() results differ\n";
+			test_result = false;
+		}
+
+		ckv::FlatMap serial_map = serial_file.import_to_flat_map();
+		ckv::FlatMap parallel_map = parallel_file.import_to_flat_map();
+
+		if (serial_map.size() != 45000 || !std::equal(serial_map.begin(), serial_map.end(),
+				parallel_map.begin(), parallel_map.end())) {
+			std::cout << "ckv::ConfigFile::import_to_flat_map() results differ\n";
+			test_result = false;
+		}
+
+		// the index built in parallel has the same lines
+		std::string serial_buffer, parallel_buffer;
+
+		for (int i = 0; i < 45000; i += 997) {
+			std::string key = "KEY_" + std::to_string(i);
+
+			if (serial_file.try_get_value_for_key(key, serial_buffer).line
+					!= parallel_file.try_get_value_for_key(key, parallel_buffer).line) {
+				std::cout << "Line of key " << key << " differs\n";
+				test_result = false;
+			}
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::ParseMode::Parallel: %s", e.what());
+		test_result = false;
+	}
+
+	// an error near the end is reported at the same line
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << contents << "BROKEN\n\nKEY_LAST =\n\tlast\n";
+	}
+
+	ckv::ConfigFile serial_file(file_name), parallel_file(file_name);
+
+	parallel_file.set_parse_mode(ckv::ParseMode::Parallel);
+
+	for (ckv::ConfigFile *file : {&serial_file, &parallel_file}) {
+		try {
+			file->import_to_flat_map();
+			std::cout << "Expected exception ckv::MissingEqualTo but none occured\n";
+			test_result = false;
+		} catch(ckv::MissingEqualTo &e) {
+		}
+	}
+
+	if (serial_file.get_err_line() == 0 || serial_file.get_err_line() != parallel_file.get_err_line()) {
+		std::cout << "Error lines differ: " << serial_file.get_err_line() << " and "
+			<< parallel_file.get_err_line() << "\n";
+		test_result = false;
+	}
+
+	// an error found by a lookup stops a later parallel import too
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "FIRST =\n\tfirst\n\nBROKEN\n\n" << contents;
+	}
+
+	ckv::ConfigFile broken_file(file_name);
+	std::string buffer;
+
+	if (broken_file.try_get_value_for_key("MISSING", buffer).error != ckv::ErrorCode::MissingEqualTo) {
+		std::cout << "Expected ckv::ErrorCode::MissingEqualTo looking up a missing key\n";
+		test_result = false;
+	}
+
+	broken_file.set_parse_mode(ckv::ParseMode::Parallel);
+
+	try {
+		broken_file.import_to_map();
+		std::cout << "Expected exception ckv::MissingEqualTo but none occured\n";
+		test_result = false;
+	} catch(ckv::MissingEqualTo &e) {
+		if (broken_file.get_err_line() != 4) {
+			std::cout << "Expected the error at line 4, found line " << broken_file.get_err_line() << "\n";
+			test_result = false;
+		}
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_stats()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile::get_stats():\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_stats.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+	std::string contents = "FIRST =\n\tone\n\nSECOND =\n\ttwo\n\tlines\n\nTHIRD =\n\tthree\n";
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << contents;
+	}
+
+	ckv::reset_global_stats();
+
+	ckv::ConfigFile file(file_name);
+
+	try {
+		file.get_value_for_key("SECOND");
+		file.get_value_for_key("SECOND");
+		file.set_value_for_key("THIRD", "3");
+		file.import_to_flat_map();
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured while collecting stats: %s", e.what());
+		test_result = false;
+	}
+
+	try {
+		file.get_value_for_key("MISSING");
+	} catch(ckv::KeyNotFound &e) {
+	}
+
+	ckv::Stats stats = file.get_stats();
+	std::string text = ckv::to_prometheus(stats, file_name);
+
+#ifdef CKV_ENABLE_STATS
+	ckv::Stats global = ckv::get_global_stats();
+
+	// SECOND is looked up twice but parsed once, until the
+	// rewrite of THIRD throws the index away
+	if (stats.get(ckv::Counter::Lookups) != 4 || stats.get(ckv::Counter::ExceptionsThrown) != 1
+			|| stats.get(ckv::Counter::RewriteBytes) == 0 || stats.get(ckv::Counter::FullRescans) < 3
+			|| stats.get(ckv::Counter::BytesScanned) < contents.size()) {
+		std::cout << "Unexpected counters:\n" << text;
+		test_result = false;
+	}
+
+	// the nested try_get_value_for_key() calls aren't counted
+	if (stats.get(ckv::Method::GetValueForKey).count != 3 || stats.get(ckv::Method::TryGetValueForKey).count != 0
+			|| stats.get(ckv::Method::ImportToFlatMap).count != 1 || stats.get(ckv::Method::Visit).count != 0) {
+		std::cout << "Unexpected method timings:\n" << text;
+		test_result = false;
+	}
+
+	if (global.counters != stats.counters) {
+		std::cout << "Global counters differ from those of the only ckv::ConfigFile\n";
+		test_result = false;
+	}
+#else
+	if (stats.counters != ckv::Stats().counters || stats.get(ckv::Method::GetValueForKey).count != 0) {
+		std::cout << "Stats collected although CKV_ENABLE_STATS isn't defined\n";
+		test_result = false;
+	}
+#endif
+
+	if (text.find("# TYPE ckv_lookups_total counter\nckv_lookups_total{file=\"" + file_name + "\"} "
+				+ std::to_string(stats.get(ckv::Counter::Lookups)) + "\n") == std::string::npos
+			|| text.find("ckv_method_duration_seconds_count{file=\"" + file_name
+				+ "\",method=\"get_value_for_key\"}") == std::string::npos
+			|| text.find("method=\"remove_key\",le=\"+Inf\"}") == std::string::npos) {
+		std::cout << "Unexpected Prometheus text:\n" << text;
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_writer()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::Writer:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_writer.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+	std::map<std::string, std::string> values = {
+		{"EMPTY", ""},
+		{"SINGLE", "one line"},
+		{"MULTI", "first\nsecond\n\nfourth"},
+		{"TRAILING", "ends with a newline\n"},
+	};
+	std::string large;
+
+	// many lines, so writev() is called more than once
+	for (int i = 0; i < 3000; i++) {
+		large += random_string(i % 50) + "\n";
+	}
+	values.emplace("LARGE", large);
+
+	auto expect_values = [&file_name, &values, &test_result](const std::string &how) {
+		try {
+			ckv::ConfigFile file(file_name);
+			auto imported = file.import_to_map();
+
+			if (imported != std::unordered_map<std::string, std::string>(values.begin(), values.end())) {
+				std::cout << "Values written " << how << " don't read back the same\n";
+				test_result = false;
+			}
+		} catch(std::exception &e) {
+			EXCEPTION("Exception occured reading values written %s: %s", how.c_str(), e.what());
+			test_result = false;
+		}
+	};
+
+	{
+		std::ostringstream out;
+
+		// a small buffer so blocks are written out along the way
+		{
+			ckv::Writer writer(out, 256);
+			writer.write_all(values);
+		}
+
+		std::ofstream file(file_name, std::ios::trunc);
+		file << out.str();
+	}
+	expect_values("to a stream");
+
+	{
+		int fd = open(file_name.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+		ckv::Writer writer(fd, 256);
+
+		writer.write_all(values);
+		writer.flush();
+		close(fd);
+	}
+	expect_values("to a file descriptor");
+
+	std::ostringstream bad_out;
+	bad_out.setstate(std::ios::badbit);
+
+	try {
+		ckv::Writer writer(bad_out);
+
+		writer.write("KEY", "value");
+		writer.flush();
+		std::cout << "Expected exception ckv::InvalidOutputStream but none occured\n";
+		test_result = false;
+	} catch(ckv::InvalidOutputStream &e) {
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_typed_getters()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::ConfigFile typed getters:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_typed_getters.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "INT =\n\t-42\n\n"
+			"HEX =\n\t0x1F\n\n"
+			"DOUBLE =\n\t 2.5e3 \n\n"
+			"BOOL =\n\tYes\n\n"
+			"DURATION =\n\t1h30m\n\n"
+			"SIZE =\n\t64MiB\n\n"
+			"LIST =\n\tone\ttwo\t\tfour\n\n"
+			"NOT_A_NUMBER =\n\t12abc\n";
+	}
+
+	auto expect = [&test_result](bool ok, const std::string &what) {
+		if (!ok) {
+			std::cout << "Unexpected result for " << what << "\n";
+			test_result = false;
+		}
+	};
+
+	ckv::ConfigFile file(file_name);
+
+	try {
+		expect(file.get_int("INT") == -42, "INT");
+		expect(file.get_int("HEX") == 31, "HEX");
+		expect(file.get_double("DOUBLE") == 2500, "DOUBLE");
+		expect(file.get_bool("BOOL"), "BOOL");
+		expect(file.get_duration("DURATION") == std::chrono::minutes(90), "DURATION");
+		expect(file.get_size("SIZE") == 64 << 20, "SIZE");
+		expect(file.get_list("LIST") == std::vector<std::string>{"one", "two", "", "four"}, "LIST");
+
+		// served from the cache, the same list as before
+		expect(&file.get_list("LIST") == &file.get_list("LIST"), "LIST read again");
+		expect(file.get_int("INT") == -42, "INT read again");
+		// a different type for the same key replaces the cached one
+		expect(file.get_double("INT") == -42.0, "INT as a double");
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with typed getters: %s", e.what());
+		test_result = false;
+	}
+
+	try {
+		file.get_int("NOT_A_NUMBER");
+		std::cout << "Expected exception ckv::InvalidValue but none occured\n";
+		test_result = false;
+	} catch(ckv::InvalidValue &e) {
+		std::string message = e.what();
+
+		if (message.find("NOT_A_NUMBER") == std::string::npos || message.find("line 22") == std::string::npos
+				|| file.get_err_line() != 22) {
+			std::cout << "Unexpected ckv::InvalidValue: " << message << "\n";
+			test_result = false;
+		}
+	}
+
+	try {
+		file.get_bool("MISSING");
+		std::cout << "Expected exception ckv::KeyNotFound but none occured\n";
+		test_result = false;
+	} catch(ckv::KeyNotFound &e) {
+	}
+
+	// the same from the compiled snapshot
+	try {
+		file.compile();
+		ckv::ConfigFile compiled_file(file_name);
+
+		expect(compiled_file.get_size("SIZE") == 64 << 20 && compiled_file.uses_compiled(), "SIZE compiled");
+		expect(compiled_file.get_list("LIST").size() == 4, "LIST compiled");
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with typed getters on a compiled file: %s", e.what());
+		test_result = false;
+	}
+
+	std::int64_t int_value = 0;
+	double double_value = 0;
+	bool bool_value = false;
+	std::chrono::nanoseconds duration_value;
+	std::uint64_t size_value = 0;
+
+	expect(ckv::parse_int("-9223372036854775808", int_value) && int_value == INT64_MIN, "lowest integer");
+	expect(!ckv::parse_int("9223372036854775808", int_value), "integer overflow");
+	expect(!ckv::parse_int("--1", int_value) && !ckv::parse_int("", int_value), "invalid integers");
+	expect(ckv::parse_double("+.5", double_value) && double_value == 0.5, "double with a sign");
+	expect(!ckv::parse_double("1.5x", double_value), "invalid double");
+	expect(ckv::parse_bool("OFF", bool_value) && !bool_value && !ckv::parse_bool("maybe", bool_value), "bools");
+	expect(ckv::parse_duration("250ms", duration_value) && duration_value == std::chrono::milliseconds(250), "ms");
+	expect(ckv::parse_duration("1.5s", duration_value) && duration_value == std::chrono::milliseconds(1500), "s");
+	expect(!ckv::parse_duration("10", duration_value) && !ckv::parse_duration("5 parsecs", duration_value),
+		"invalid durations");
+	expect(ckv::parse_size("1.5 GB", size_value) && size_value == 1500000000, "GB");
+	expect(ckv::parse_size("4096", size_value) && size_value == 4096, "bytes");
+	expect(!ckv::parse_size("-1K", size_value) && !ckv::parse_size("1 XB", size_value), "invalid sizes");
+
+	std::remove(file_name.c_str());
+	std::remove(ckv::compiled_path_for(file_name).c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+/*
+ * Struct filled by ckv::bind() in run_tests_for_bind()
+ */
+struct BoundConfig {
+	std::string host;
+	int port = 0;
+	bool verbose = false;
+	double ratio = 0;
+	std::chrono::milliseconds timeout{0};
+	std::uint64_t cache_size = 0;
+	std::vector<std::string> tags;
+	std::string unset = "untouched";
+};
+
+struct BoundSchema {
+	using type = BoundConfig;
+	static constexpr auto fields = std::make_tuple(
+		ckv::field("HOST", &BoundConfig::host),
+		ckv::field("PORT", &BoundConfig::port, 8080),
+		ckv::field("VERBOSE", &BoundConfig::verbose, false),
+		ckv::field("RATIO", &BoundConfig::ratio, 0.5),
+		ckv::field("TIMEOUT", &BoundConfig::timeout, std::chrono::milliseconds(100)),
+		ckv::field("CACHE_SIZE", &BoundConfig::cache_size),
+		ckv::field("TAGS", &BoundConfig::tags),
+		ckv::field("MISSING_WITH_DEFAULT", &BoundConfig::unset, "default")
+	);
+};
+
+struct BoundPortSchema {
+	using type = BoundConfig;
+	static constexpr auto fields = std::make_tuple(
+		ckv::field("PORT", &BoundConfig::port),
+		ckv::field("NOT_THERE", &BoundConfig::host)
+	);
+};
+
+static_assert(ckv::hash_key("PORT") != ckv::hash_key("HOST"), "ckv::hash_key() works at compile time");
+
+void sample_ckv_files::run_tests_for_bind()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::bind():\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_bind.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "HOST =\n\texample.org\n\n"
+			"UNRELATED =\n\tskipped\n\n"
+			"TIMEOUT =\n\t2s\n\n"
+			"CACHE_SIZE =\n\t64MiB\n\n"
+			"TAGS =\n\ta\tb\n\n"
+			"VERBOSE =\n\ton\n\n"
+			"HOST =\n\tsecond.example.org\n";
+	}
+
+	ckv::ConfigFile file(file_name);
+
+	try {
+		BoundConfig config = ckv::bind<BoundSchema>(file);
+
+		if (config.host != "example.org" || config.port != 8080 || !config.verbose || config.ratio != 0.5
+				|| config.timeout != std::chrono::seconds(2) || config.cache_size != 64 << 20
+				|| config.tags != std::vector<std::string>{"a", "b"} || config.unset != "default") {
+			std::cout << "ckv::bind() filled the struct wrongly\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::bind(): %s", e.what());
+		test_result = false;
+	}
+
+	// HOST is there, NOT_THERE has no default
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "PORT =\n\t80\n";
+	}
+
+	try {
+		ckv::bind<BoundPortSchema>(file);
+		std::cout << "Expected exception ckv::KeyNotFound but none occured\n";
+		test_result = false;
+	} catch(ckv::KeyNotFound &e) {
+	}
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "NOT_THERE =\n\tthere\n\nPORT =\n\t99999999999\n";
+	}
+
+	try {
+		ckv::bind<BoundPortSchema>(file);
+		std::cout << "Expected exception ckv::InvalidValue but none occured\n";
+		test_result = false;
+	} catch(ckv::InvalidValue &e) {
+		std::string message = e.what();
+
+		if (message.find("PORT") == std::string::npos || message.find("line 4") == std::string::npos) {
+			std::cout << "Unexpected ckv::InvalidValue: " << message << "\n";
+			test_result = false;
+		}
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_lazy_decoding()
+{
+	std::cout << BOLD_ON << "\n>>> Testing decoding of values on first access:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_lazy_decoding.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+	std::map<std::string, std::string> expected;
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+
+		for (int i = 0; i < 200; i++) {
+			std::string key = "KEY_" + std::to_string(i);
+
+			// short multi-line values, which a moved std::string would lose
+			out << key << " =\n\tv" << i << "\n\tx\n+y\n\n";
+			expected[key] = "v" + std::to_string(i) + "\nxy";
+		}
+		out << "SINGLE =\n\tone line\n";
+		expected["SINGLE"] = "one line";
+	}
+
+	ckv::ConfigFile file(file_name);
+	std::string buffer;
+	ckv::LookupResult first = file.try_get_value_for_key("KEY_0", buffer);
+
+	for (auto &pair : expected) {
+		ckv::LookupResult result = file.try_get_value_for_key(pair.first, buffer);
+
+		if (!result || result.value != pair.second) {
+			std::cout << "Wrong value for " << pair.first << ": " << result.value << "\n";
+			test_result = false;
+		}
+	}
+
+	// decoded once and kept, earlier views stay valid
+	ckv::LookupResult again = file.try_get_value_for_key("KEY_0", buffer);
+
+	if (first.value != expected["KEY_0"] || again.value.data() != first.value.data()) {
+		std::cout << "Value of KEY_0 wasn't kept after its first lookup\n";
+		test_result = false;
+	}
+
+	try {
+		auto imported = file.import_to_map();
+
+		if (imported != std::unordered_map<std::string, std::string>(expected.begin(), expected.end())) {
+			std::cout << "ckv::ConfigFile::import_to_map() differs after lookups\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::ConfigFile::import_to_map(): %s", e.what());
+		test_result = false;
+	}
+
+	// a syntax error further down keeps what was decoded before it
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << "FIRST =\n\ta value long enough\n\tto be on the heap\n\nBROKEN\n";
+	}
+
+	ckv::ConfigFile broken(file_name);
+	ckv::LookupResult before = broken.try_get_value_for_key("FIRST", buffer);
+	ckv::LookupResult missing = broken.try_get_value_for_key("MISSING", buffer);
+	ckv::LookupResult missing_again = broken.try_get_value_for_key("MISSING", buffer);
+
+	// takes over any memory freed on the way, so a value decoded again lands elsewhere
+	std::vector<std::string> fillers;
+	for (std::size_t size = 16; size <= 512; size += 8) {
+		fillers.emplace_back(size, 'z');
+	}
+
+	ckv::LookupResult after = broken.try_get_value_for_key("FIRST", buffer);
+
+	if (before.value != "a value long enough\nto be on the heap" || after.value.data() != before.value.data()
+			|| missing.error != ckv::ErrorCode::MissingEqualTo || missing.line != 5
+			|| missing_again.error != missing.error || missing_again.line != missing.line) {
+		std::cout << "Values decoded before a syntax error weren't kept\n";
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_async()
+{
+	std::cout << BOLD_ON << "\n>>> Testing async loading and lookups:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/general.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	// results are the same as those of the synchronous calls
+	try {
+		ckv::ConfigFile file(file_name);
+		auto expected = file.import_to_map();
+		std::string key = expected.begin()->first;
+
+		ckv::AsyncOptions parallel;
+		parallel.parse_mode = ckv::ParseMode::Parallel;
+
+		auto map_future = ckv::import_to_map_async(file_name);
+		auto parallel_future = ckv::import_to_map_async(file_name, parallel);
+		auto flat_future = ckv::import_to_flat_map_async(file_name);
+		auto snapshot_future = ckv::snapshot_async(file_name);
+		auto value_future = ckv::get_value_for_key_async(file_name, key);
+		auto values_future = ckv::get_values_for_keys_async(file_name, {key});
+
+		if (map_future.get() != expected || parallel_future.get() != expected) {
+			std::cout << "ckv::import_to_map_async() differs from ckv::ConfigFile::import_to_map()\n";
+			test_result = false;
+		}
+
+		ckv::FlatMap flat = flat_future.get();
+		auto snapshot = snapshot_future.get();
+
+		for (auto &pair : expected) {
+			std::string_view found;
+
+			if (flat.count(pair.first) != 1 || flat.at(pair.first) != pair.second) {
+				std::cout << "ckv::import_to_flat_map_async() is wrong for " << pair.first << "\n";
+				test_result = false;
+			}
+
+			if (!snapshot->find(pair.first, found) || found != pair.second) {
+				std::cout << "ckv::snapshot_async() is wrong for " << pair.first << "\n";
+				test_result = false;
+			}
+		}
+
+		if (value_future.get() != expected[key] || values_future.get()[key] != expected[key]) {
+			std::cout << "ckv::get_value_for_key_async() is wrong for " << key << "\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with async calls: %s", e.what());
+		test_result = false;
+	}
+
+	// exceptions reach the future with their type
+	auto expect_exception_from = [&test_result](auto future, auto expected_exception, const char *what) {
+		try {
+			future.get();
+			std::cout << "No exception from " << what << "\n";
+			test_result = false;
+		} catch(decltype(expected_exception) &) {
+		} catch(std::exception &e) {
+			EXCEPTION("Wrong exception from %s: %s", what, e.what());
+			test_result = false;
+		}
+	};
+
+	expect_exception_from(ckv::import_to_map_async("sample_ckv_files/no_such_file.ckv"),
+		ckv::FileOpenFailed(""), "a missing file");
+	expect_exception_from(ckv::get_value_for_key_async(file_name, "NO_SUCH_KEY_ANYWHERE"),
+		ckv::KeyNotFound(""), "a missing key");
+
+	// a user executor, which runs nothing until asked to
+	std::vector<std::function<void()>> queued;
+	ckv::AsyncOptions deferred;
+	deferred.executor = [&queued](std::function<void()> task) {
+		queued.push_back(std::move(task));
+	};
+
+	auto kept_future = ckv::import_to_map_async(file_name, deferred);
+	ckv::AsyncOptions cancelled = deferred;
+	cancelled.cancellation = ckv::CancellationToken();
+	auto cancelled_future = ckv::import_to_map_async(file_name, cancelled);
+
+	cancelled.cancellation.cancel();
+
+	if (queued.size() != 2) {
+		std::cout << "The given executor wasn't used\n";
+		test_result = false;
+	}
+
+	for (auto &task : queued) {
+		task();
+	}
+
+	try {
+		if (kept_future.get().empty()) {
+			std::cout << "ckv::import_to_map_async() on a user executor returned nothing\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with a user executor: %s", e.what());
+		test_result = false;
+	}
+
+	expect_exception_from(std::move(cancelled_future), ckv::OperationCancelled(), "a cancelled call");
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_compressed_files()
+{
+	std::cout << BOLD_ON << "\n>>> Testing compressed files:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_compressed_files.ckv.gz";
+	std::string zstd_name = "sample_ckv_files/for_testing_compressed_files.ckv.zst";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	// compressed files the library can't read are reported the same way with or without zstd
+	{
+		std::ofstream out(zstd_name, std::ios::trunc | std::ios::binary);
+
+		out << "\x28\xb5\x2f\xfd" << "not really zstd";
+	}
+
+	try {
+		ckv::ConfigFile file(zstd_name);
+
+		file.import_to_map();
+		std::cout << "No exception for a corrupt zstd file\n";
+		test_result = false;
+	} catch(ckv::DecompressionFailed &) {
+	} catch(std::exception &e) {
+		EXCEPTION("Wrong exception for a corrupt zstd file: %s", e.what());
+		test_result = false;
+	}
+
+	std::remove(zstd_name.c_str());
+
+#ifdef CKV_HAVE_ZLIB
+	std::string plain;
+	std::unordered_map<std::string, std::string> expected;
+
+	for (int i = 0; i < 3000; i++) {
+		std::string key = "KEY_" + std::to_string(i);
+		std::string value = i % 3 == 0 ? "first\n" + random_string(i % 90) : std::to_string(i);
+
+		plain += key + " =\n\t" + (i % 3 == 0 ? "first\n\t" + value.substr(6) : value) + "\n\n";
+		expected.emplace(key, value);
+	}
+
+	// a value much larger than the chunks the file is decompressed in
+	std::string large_value = random_string(300 * 1024);
+
+	plain += "LARGE =\n\t" + large_value + "\n";
+	expected.emplace("LARGE", large_value);
+	plain += "KEY_1 =\n\tduplicate\n";
+
+	// two gzip members, decompressed as one file
+	for (int member = 0; member < 2; member++) {
+		gzFile gz = gzopen(file_name.c_str(), member == 0 ? "wb" : "ab");
+		std::size_t half = plain.size() / 2;
+		std::string_view part = member == 0 ? std::string_view(plain).substr(0, half)
+			: std::string_view(plain).substr(half);
+
+		gzwrite(gz, part.data(), part.size());
+		gzclose(gz);
+	}
+
+	try {
+		ckv::ConfigFile file(file_name);
+
+		if (file.import_to_map() != expected) {
+			std::cout << "ckv::ConfigFile::import_to_map() is wrong for a gzip file\n";
+			test_result = false;
+		}
+
+		if (file.get_value_for_key("LARGE") != large_value || file.get_value_for_key("KEY_3") != expected["KEY_3"]
+				|| file.get_int("KEY_2999") != 2999 || file.get_values_for_keys({"KEY_1", "KEY_0"})["KEY_1"] != "1") {
+			std::cout << "Lookups are wrong for a gzip file\n";
+			test_result = false;
+		}
+
+		std::string buffer;
+		ckv::LookupResult result = file.try_get_value_for_key("NO_SUCH_KEY", buffer);
+
+		if (result.error != ckv::ErrorCode::KeyNotFound) {
+			std::cout << "ckv::ConfigFile::try_get_value_for_key() found a missing key in a gzip file\n";
+			test_result = false;
+		}
+
+		result = file.try_get_value_for_key("KEY_6", buffer);
+
+		if (!result || result.value != expected["KEY_6"] || result.line != 21) {
+			std::cout << "ckv::ConfigFile::try_get_value_for_key() is wrong for KEY_6 in a gzip file\n";
+			test_result = false;
+		}
+
+		auto snapshot = file.snapshot();
+		std::string_view found;
+
+		if (snapshot->size() != expected.size() || !snapshot->find("KEY_1", found) || found != "1") {
+			std::cout << "ckv::ConfigFile::snapshot() is wrong for a gzip file\n";
+			test_result = false;
+		}
+
+		file.compile();
+
+		if (!file.uses_compiled() || file.get_value_for_key("LARGE") != large_value) {
+			std::cout << "ckv::ConfigFile::compile() is wrong for a gzip file\n";
+			test_result = false;
+		}
+		std::remove(ckv::compiled_path_for(file_name).c_str());
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with a gzip file: %s", e.what());
+		test_result = false;
+	}
+
+	// only a chunk and the block cut across it are held in memory
+	{
+		ckv::MappedFile mapped;
+		mapped.open(file_name);
+		ckv::StreamParser parser(mapped.view(), ckv::detect_compression(mapped.view()), 4096);
+		std::size_t keys = 0;
+
+		parser.parse([&keys](std::string_view, std::string_view, unsigned int) {
+			keys++;
+			return true;
+		});
+
+		if (keys != expected.size() + 1 || parser.get_bytes_parsed() != plain.size()
+				|| parser.get_peak_buffer_size() > 2 * 4096 + large_value.size()) {
+			std::cout << "ckv::StreamParser held " << parser.get_peak_buffer_size() << " bytes for "
+				<< keys << " keys\n";
+			test_result = false;
+		}
+	}
+
+	try {
+		ckv::ConfigFile file(file_name);
+
+		file.set_value_for_key("KEY_1", "new");
+		std::cout << "ckv::ConfigFile::set_value_for_key() wrote to a gzip file\n";
+		test_result = false;
+	} catch(ckv::FileWriteFailed &) {
+	} catch(std::exception &e) {
+		EXCEPTION("Wrong exception writing to a gzip file: %s", e.what());
+		test_result = false;
+	}
+
+	// syntax errors are on the same line as in the plain file
+	{
+		gzFile gz = gzopen(file_name.c_str(), "wb");
+		std::string broken = plain.substr(0, plain.find("\nKEY_", plain.size() / 3) + 1);
+		unsigned int expected_line = std::count(broken.begin(), broken.end(), '\n') + 1;
+
+		broken += "BAD KEY =\n\tvalue\n";
+
+		gzwrite(gz, broken.data(), broken.size());
+		gzclose(gz);
+
+		ckv::ConfigFile file(file_name);
+		std::string buffer;
+		ckv::LookupResult result = file.try_get_value_for_key("NO_SUCH_KEY", buffer);
+
+		if (result.error != ckv::ErrorCode::MissingEqualTo || result.line != expected_line) {
+			std::cout << "Wrong error for a gzip file: line " << result.line << " instead of "
+				<< expected_line << "\n";
+			test_result = false;
+		}
+	}
+
+	// a file cut short
+	{
+		std::string compressed;
+		std::ifstream in(file_name, std::ios::binary);
+
+		compressed.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		in.close();
+
+		std::ofstream out(file_name, std::ios::trunc | std::ios::binary);
+
+		out << compressed.substr(0, compressed.size() / 2);
+	}
+
+	try {
+		ckv::ConfigFile file(file_name);
+
+		file.import_to_map();
+		std::cout << "No exception for a truncated gzip file\n";
+		test_result = false;
+	} catch(ckv::DecompressionFailed &) {
+	} catch(std::exception &e) {
+		EXCEPTION("Wrong exception for a truncated gzip file: %s", e.what());
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+#endif
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_layered_config()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::LayeredConfig:\n" << BOLD_OFF;
+
+	std::string defaults_name = "sample_ckv_files/for_testing_layered_defaults.ckv";
+	std::string host_name = "sample_ckv_files/for_testing_layered_host.ckv";
+	std::string local_name = "sample_ckv_files/for_testing_layered_local.ckv";
+
+	print_testing_file(defaults_name);
+
+	bool test_result = true;
+
+	{
+		std::ofstream defaults(defaults_name, std::ios::trunc);
+		std::ofstream host(host_name, std::ios::trunc);
+
+		defaults << "PORT =\n\t80\n\nHOST =\n\tdefault\n\nTIMEOUT =\n\t30s\n";
+		host << "HOST =\n\tweb-1\n\nPORT =\n\t8080\n";
+	}
+	std::remove(local_name.c_str());
+
+	ckv::LayeredConfig config({defaults_name, host_name});
+	config.add_layer(local_name, true);
+
+	try {
+		ckv::LayeredLookupResult timeout = config.try_get_value_for_key("TIMEOUT");
+		ckv::Provenance port = config.get_provenance("PORT");
+
+		if (config.get_value_for_key("HOST") != "web-1" || !timeout || timeout.value != "30s"
+				|| timeout.layer != 0 || timeout.file_path != defaults_name || timeout.line != 7) {
+			std::cout << "ckv::LayeredConfig resolved keys to the wrong layer\n";
+			test_result = false;
+		}
+
+		if (port.file_path != host_name || port.line != 4 || port.layer != 1) {
+			std::cout << "Wrong provenance for PORT: " << port.file_path << ":" << port.line << "\n";
+			test_result = false;
+		}
+
+		std::unordered_map<std::string, std::string> expected = {
+			{"PORT", "8080"}, {"HOST", "web-1"}, {"TIMEOUT", "30s"}
+		};
+
+		if (config.import_to_map() != expected) {
+			std::cout << "ckv::LayeredConfig::import_to_map() is wrong\n";
+			test_result = false;
+		}
+
+		if (config.try_get_value_for_key("NO_SUCH_KEY").error != ckv::ErrorCode::KeyNotFound) {
+			std::cout << "ckv::LayeredConfig found a missing key\n";
+			test_result = false;
+		}
+
+		// an edit to the top layer leaves the defaults mapped and indexed as they were
+		{
+			std::ofstream local(local_name, std::ios::trunc);
+
+			local << "TIMEOUT =\n\t5s\n";
+		}
+
+		ckv::LayeredLookupResult overridden = config.try_get_value_for_key("TIMEOUT");
+		ckv::LayeredLookupResult still = config.try_get_value_for_key("HOST");
+		std::string buffer;
+		ckv::LookupResult before = config.get_layer(0).try_get_value_for_key("TIMEOUT", buffer);
+
+		if (!overridden || overridden.value != "5s" || overridden.layer != 2 || still.value != "web-1"
+				|| before.value.data() != timeout.value.data()) {
+			std::cout << "ckv::LayeredConfig didn't pick up the new top layer on its own\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ckv::LayeredConfig: %s", e.what());
+		test_result = false;
+	}
+
+	// errors come from the layer they are in
+	{
+		std::ofstream host(host_name, std::ios::trunc);
+
+		host << "HOST =\n\tweb-1\n\nBAD KEY =\n\tx\n";
+	}
+
+	ckv::LayeredLookupResult broken = config.try_get_value_for_key("PORT");
+
+	if (broken.error != ckv::ErrorCode::MissingEqualTo || broken.layer != 1 || broken.line != 4) {
+		std::cout << "ckv::LayeredConfig didn't report the error of the host layer\n";
+		test_result = false;
+	}
+
+	try {
+		config.get_value_for_key("PORT");
+		std::cout << "No exception for a broken layer\n";
+		test_result = false;
+	} catch(ckv::MissingEqualTo &) {
+	} catch(std::exception &e) {
+		EXCEPTION("Wrong exception for a broken layer: %s", e.what());
+		test_result = false;
+	}
+
+	// a missing layer that isn't optional
+	ckv::LayeredConfig missing({defaults_name, "sample_ckv_files/no_such_layer.ckv"});
+
+	if (missing.try_get_value_for_key("PORT").error != ckv::ErrorCode::FileOpenFailed) {
+		std::cout << "ckv::LayeredConfig skipped a missing layer that isn't optional\n";
+		test_result = false;
+	}
+
+	std::remove(defaults_name.c_str());
+	std::remove(host_name.c_str());
+	std::remove(local_name.c_str());
+
+	print_test_results(test_result, defaults_name);
+}
+
+void sample_ckv_files::run_tests_for_ordered_queries()
+{
+	std::cout << BOLD_ON << "\n>>> Testing prefix and range queries:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_ordered_queries.ckv";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+	std::map<std::string, std::string> expected;
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		const char *keys[] = {
+			"DB_REPLICA_1_HOST", "DB_PRIMARY_HOST", "CACHE_SIZE", "DB_PRIMARY_PORT",
+			"DB_REPLICA", "DB_REPLICA_10_HOST", "DB", "DBX", "LOG_LEVEL", "DB_PRIMARY"
+		};
+
+		for (const char *key : keys) {
+			out << key << " =\n\t" << key << "_value\n\tsecond line\n\n";
+			expected[key] = std::string(key) + "_value\nsecond line";
+		}
+		out << "DB_PRIMARY_HOST =\n\tduplicate\n";
+	}
+
+	// what the ordered queries should give, from a std::map
+	auto expected_prefix = [&expected](std::string prefix) {
+		std::vector<std::string> keys;
+
+		for (auto it = expected.lower_bound(prefix); it != expected.end()
+				&& it->first.compare(0, prefix.size(), prefix) == 0; it++) {
+			keys.push_back(it->first);
+		}
+		return keys;
+	};
+
+	auto check_file = [&](ckv::ConfigFile &file, const char *what) {
+		for (std::string prefix : {"", "DB", "DB_", "DB_PRIMARY", "DB_REPLICA_1", "Z", "DB_PRIMARY_HOSTS"}) {
+			std::vector<std::string_view> keys = file.keys_with_prefix(prefix);
+			std::vector<std::string> visited;
+
+			file.visit_prefix(prefix, [&](std::string_view key, std::string_view value) {
+				if (value != expected[std::string(key)]) {
+					std::cout << "Wrong value for " << key << " from " << what << "\n";
+					test_result = false;
+				}
+				visited.emplace_back(key);
+				return true;
+			});
+
+			if (std::vector<std::string>(keys.begin(), keys.end()) != expected_prefix(prefix)
+					|| visited != expected_prefix(prefix)) {
+				std::cout << "Wrong keys with prefix \"" << prefix << "\" from " << what << "\n";
+				test_result = false;
+			}
+		}
+
+		std::vector<std::string> in_range;
+
+		file.visit_range("DB_P", "DB_REPLICA_1", [&in_range](std::string_view key, std::string_view) {
+			in_range.emplace_back(key);
+			return true;
+		});
+
+		if (in_range != std::vector<std::string>{"DB_PRIMARY", "DB_PRIMARY_HOST", "DB_PRIMARY_PORT", "DB_REPLICA"}) {
+			std::cout << "Wrong keys in range from " << what << "\n";
+			test_result = false;
+		}
+
+		std::pair<const char *, const char *> matches[] = {
+			{"DB_REPLICA_1_HOST_X", "DB_REPLICA_1_HOST"}, {"DB_REPLICA_2_HOST", "DB_REPLICA"},
+			{"DB_PRIMARY_PORTS", "DB_PRIMARY_PORT"}, {"DB_PRIMARY_USER", "DB_PRIMARY"},
+			{"DBA", "DB"}, {"DB", "DB"}, {"CACHE", nullptr}, {"", nullptr}, {"ZZZ", nullptr}
+		};
+
+		for (auto &match : matches) {
+			std::string_view key;
+			bool found = file.longest_prefix_match(match.first, key);
+
+			if (found != (match.second != nullptr) || (found && key != match.second)) {
+				std::cout << "Wrong longest prefix match for " << match.first << " from " << what << "\n";
+				test_result = false;
+			}
+		}
+	};
+
+	try {
+		ckv::ConfigFile file(file_name);
+
+		check_file(file, "the key index");
+
+		// keys are sorted again once the file changes
+		file.set_value_for_key("DB_REPLICA_1", "new");
+		expected["DB_REPLICA_1"] = "new";
+
+		std::string_view match;
+
+		if (!file.longest_prefix_match("DB_REPLICA_1_PORT", match) || match != "DB_REPLICA_1"
+				|| file.keys_with_prefix("DB_REPLICA_1").size() != 3) {
+			std::cout << "Ordered queries didn't see a new key\n";
+			test_result = false;
+		}
+
+		file.compile();
+		check_file(file, "the compiled snapshot");
+		std::remove(ckv::compiled_path_for(file_name).c_str());
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ordered queries: %s", e.what());
+		test_result = false;
+	}
+
+#ifdef CKV_HAVE_ZLIB
+	try {
+		std::string compressed_name = file_name + ".gz";
+		std::ifstream in(file_name);
+		std::string plain((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		gzFile gz = gzopen(compressed_name.c_str(), "wb");
+
+		gzwrite(gz, plain.data(), plain.size());
+		gzclose(gz);
+
+		ckv::ConfigFile file(compressed_name);
+
+		check_file(file, "a gzip file");
+		std::remove(compressed_name.c_str());
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with ordered queries on a gzip file: %s", e.what());
+		test_result = false;
+	}
+#endif
+
+	std::remove(file_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void sample_ckv_files::run_tests_for_journal()
+{
+	std::cout << BOLD_ON << "\n>>> Testing journal writes of ckv::ConfigFile:\n" << BOLD_OFF;
+
+	std::string file_name = "sample_ckv_files/for_testing_journal.ckv";
+	std::string journal_name = ckv::journal_path_for(file_name);
+	std::string base = "FIRST =\n\tone\n\nSECOND =\n\ttwo\n\nTHIRD =\n\tthree\n\nSECOND =\n\tshadowed\n";
+
+	print_testing_file(file_name);
+
+	bool test_result = true;
+
+	{
+		std::ofstream out(file_name, std::ios::trunc);
+		out << base;
+	}
+	std::remove(journal_name.c_str());
+
+	auto read_file = [](const std::string &name) {
+		std::ifstream in(name);
+		std::stringstream contents;
+		contents << in.rdbuf();
+		return contents.str();
+	};
+
+	std::unordered_map<std::string, std::string> expected = {
+		{"FIRST", "changed\nover two lines"},
+		{"THIRD", "three"},
+		{"FOURTH", "4"},
+		{"FIFTH", "5"}
+	};
+
+	try {
+		ckv::ConfigFile file(file_name);
+		ckv::ConfigFile reader(file_name);
+		ckv::ConfigFile plain_reader(file_name);
+
+		file.set_write_mode(ckv::WriteMode::Journal);
+		reader.set_read_journal(true);
+		reader.get_value_for_key("FIRST");
+
+		file.set_value_for_key("FIRST", "first try");
+		file.set_value_for_key("FOURTH", "4");
+		file.remove_key("SECOND");
+		file.set_value_for_key("FIRST", "changed\nover two lines");
+		file.set_value_for_key("GONE", "soon");
+		file.remove_key("GONE");
+		file.set_value_for_key("FIFTH", "5");
+
+		if (read_file(file_name) != base) {
+			std::cout << "File changed before the journal was compacted\n";
+			test_result = false;
+		}
+
+		// the journal is only read by those asking for it
+		if (plain_reader.get_value_for_key("FIRST") != "one") {
+			std::cout << "Journal read without set_read_journal()\n";
+			test_result = false;
+		}
+
+		// output to a stream leaves the file and the journal alone
+		std::string journal_before = read_file(journal_name);
+		std::stringstream streamed;
+
+		plain_reader.set_value_for_key("STREAMED", "6", streamed);
+
+		if (read_file(file_name) != base || read_file(journal_name) != journal_before
+				|| streamed.str() != "FIRST =\n\tchanged\n\tover two lines\n\nTHIRD =\n\tthree\n\n"
+					"FOURTH =\n\t4\n\nFIFTH =\n\t5\n\nSTREAMED =\n\t6\n") {
+			std::cout << "Output to a stream with a journal is wrong or touched the files, found:\n" << streamed.str();
+			test_result = false;
+		}
+
+		streamed.str("");
+		file.remove_key("THIRD", streamed);
+
+		if (read_file(file_name) != base || read_file(journal_name) != journal_before
+				|| streamed.str().find("THIRD") != std::string::npos) {
+			std::cout << "Removing to a stream with a journal is wrong or touched the files\n";
+			test_result = false;
+		}
+
+		// a record cut short by a crash is ignored
+		{
+			std::ofstream out(journal_name, std::ios::app);
+			out << "S 5 100\nSIXTH";
+		}
+
+		for (ckv::ConfigFile *cur : {&file, &reader}) {
+			std::string buffer;
+
+			if (cur->import_to_map() != expected || cur->get_int("FOURTH") != 4
+					|| cur->try_get_value_for_key("SECOND", buffer).error != ckv::ErrorCode::KeyNotFound
+					|| cur->try_get_value_for_key("SIXTH", buffer).error != ckv::ErrorCode::KeyNotFound
+					|| cur->get_values_for_keys({"FIRST", "THIRD", "FIFTH"}).size() != 3
+					|| cur->keys_with_prefix("F") != std::vector<std::string_view>{"FIFTH", "FIRST", "FOURTH"}) {
+				std::cout << "Reads don't see the journal\n";
+				test_result = false;
+			}
+		}
+
+		std::vector<std::string> order;
+
+		reader.visit([&order](std::string_view key, std::string_view) {
+			order.emplace_back(key);
+			return true;
+		});
+
+		if (order != std::vector<std::string>{"FIRST", "THIRD", "FOURTH", "FIFTH"}) {
+			std::cout << "Wrong order of keys visited with a journal\n";
+			test_result = false;
+		}
+
+		// the next writer cuts it off so its own record can be read
+		ckv::ConfigFile other_reader(file_name);
+
+		other_reader.set_read_journal(true);
+		other_reader.get_value_for_key("FIRST");
+		file.set_value_for_key("SEVENTH", "7");
+
+		if (other_reader.get_value_for_key("SEVENTH") != "7"
+				|| read_file(journal_name).find("SIXTH") != std::string::npos) {
+			std::cout << "Records after a torn one aren't read\n";
+			test_result = false;
+		}
+
+		file.remove_key("SEVENTH");
+		file.compact();
+
+		if (read_file(file_name) != "FIRST =\n\tchanged\n\tover two lines\n\nTHIRD =\n\tthree\n\nFOURTH =\n\t4\n\nFIFTH =\n\t5\n"
+				|| std::ifstream(journal_name).good() || reader.import_to_map() != expected) {
+			std::cout << "Expected file contents after compaction don't match, found:\n" << read_file(file_name);
+			test_result = false;
+		}
+
+		// past the limit the journal is compacted on its own, in the background
+		file.set_journal_limit(200);
+
+		for (int i = 0; i < 20; i++) {
+			file.set_value_for_key("COUNTER", std::to_string(i));
+		}
+
+		for (int i = 0; i < 5000 && (read_file(journal_name).size() > 200
+				|| read_file(file_name).find("COUNTER") == std::string::npos); i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		if (read_file(journal_name).size() > 200 || reader.get_value_for_key("COUNTER") != "19"
+				|| read_file(file_name).find("COUNTER") == std::string::npos) {
+			std::cout << "Journal wasn't compacted past its limit\n";
+			test_result = false;
+		}
+
+		// reloaders follow the journal too
+		ckv::SnapshotReloader reloader(file_name);
+
+		file.set_value_for_key("RELOADED", "yes");
+
+		if (!reloader.reload() || reloader.current()->get_value_for_key("RELOADED") != "yes") {
+			std::cout << "Snapshot wasn't reloaded after a journal write\n";
+			test_result = false;
+		}
+
+		// writes in another mode fold the journal in first
+		file.set_value_for_key("COUNTER", "20");
+		file.set_write_mode(ckv::WriteMode::InPlace);
+		file.set_value_for_key("FIFTH", "five");
+
+		if (std::ifstream(journal_name).good() || reader.get_value_for_key("COUNTER") != "20"
+				|| ckv::ConfigFile(file_name).get_value_for_key("FIFTH") != "five") {
+			std::cout << "Journal wasn't compacted before an in place write\n";
+			test_result = false;
+		}
+	} catch(std::exception &e) {
+		EXCEPTION("Exception occured with journal writes: %s", e.what());
+		test_result = false;
+	}
+
+	std::remove(file_name.c_str());
+	std::remove(journal_name.c_str());
+
+	print_test_results(test_result, file_name);
+}
+
+void internals::run_tests()
+{
+	internals::run_tests_for_find_newline();
+}
+
+void internals::run_tests_for_find_newline()
+{
+	std::cout << BOLD_ON << "\n>>> Testing ckv::find_newline():\n" << BOLD_OFF;
+
+	std::string test_name = "ckv::find_newline()";
+
+	std::cout << "\n" << BOLD_ON << BLUE << "---> Testing " << test_name << RESET << BOLD_OFF << "\n";
+
+	// newlines at every alignment and both sparse and dense
+	std::string buffer;
+	for (size_t i = 0; i < 300; i++) {
+		buffer += random_string(i % 70);
+		buffer += '\n';
+		if (i % 7 == 0) {
+			buffer += "\n\n";
+		}
+	}
+	buffer += random_string(45);
+
+	auto newline_offsets = [&buffer]() {
+		std::vector<size_t> offsets;
+		const char *end = buffer.data() + buffer.size();
+		const char *cur = ckv::find_newline(buffer.data(), end);
+
+		while (cur != end) {
+			offsets.push_back(cur - buffer.data());
+			cur = ckv::find_newline(cur + 1, end);
+		}
+		return offsets;
+	};
+
+	std::vector<size_t> expected_offsets;
+	for (size_t i = 0; i < buffer.size(); i++) {
+		if (buffer[i] == '\n') {
+			expected_offsets.push_back(i);
+		}
+	}
+
+	bool test_result = true;
+	ckv::ScanMode default_mode = ckv::get_scan_mode();
+
+	for (auto mode : {ckv::ScanMode::Scalar, ckv::ScanMode::SSE2, ckv::ScanMode::AVX2}) {
+		if (!ckv::set_scan_mode(mode)) {
+			std::cout << "Scan mode " << static_cast<int>(mode) << " not supported, skipping\n";
+			continue;
+		}
+
+		if (newline_offsets() != expected_offsets) {
+			std::cout << "Scan mode " << static_cast<int>(mode) << " found wrong newlines\n";
+			test_result = false;
+		}
+	}
+
+	ckv::set_scan_mode(default_mode);
+
+	print_test_results(test_result, test_name);
+}
@@ -0,0 +1,36 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ckv.hpp>
+
+/*
+ * Compiles a ckv file into a .ckvb snapshot which
+ * ckv::ConfigFile reads instead of parsing the file
+ * for as long as the file doesn't change.
+ *
+ * Usage: ckv_compile FILE [OUTPUT]
+ *
+ * OUTPUT defaults to ckv::compiled_path_for(FILE), the
+ * path ckv::ConfigFile looks for the snapshot at.
+ */
+int main(int argc, char *argv[])
+{
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "Usage: %s FILE [OUTPUT]\n", argv[0]);
+		return (EXIT_FAILURE);
+	}
+
+	ckv::ConfigFile file(argv[1]);
+
+	try {
+		if (argc == 3) {
+			file.compile(argv[2]);
+		} else {
+			file.compile();
+		}
+	} catch (std::exception &e) {
+		CKV_EXCEPTION_NM(file, e);
+		return (EXIT_FAILURE);
+	}
+
+	return (EXIT_SUCCESS);
+}